@@ -0,0 +1,954 @@
+#include "Fat32Image.h"
+#include "HashVerifier.h"
+
+#include <filesystem>
+#include <sstream>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <array>
+#include <cctype>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace syncv {
+
+namespace {
+
+constexpr uint32_t kSectorSize      = 512;
+constexpr uint32_t kReservedSectors = 32;
+constexpr uint32_t kNumFats         = 2;
+constexpr uint32_t kRootCluster     = 2;
+constexpr uint32_t kFsInfoSector    = 1;
+constexpr uint32_t kBackupBoot      = 6;
+constexpr uint32_t kMinClusters     = 65525;      // below this it's FAT16 by definition
+constexpr uint32_t kMaxClusters     = 0x0FFFFFF5;
+constexpr uint32_t kFatMask         = 0x0FFFFFFF;
+constexpr uint32_t kFatEoc          = 0x0FFFFFFF;
+constexpr uint32_t kFatBad          = 0x0FFFFFF7;
+constexpr size_t   kEntrySize       = 32;
+constexpr size_t   kLfnChars        = 13;
+constexpr size_t   kMaxNameLen      = 255;
+constexpr int      kMaxDepth        = 32;
+constexpr size_t   kMaxRunBytes     = 64 * 1024;
+
+constexpr uint8_t kAttrVolumeId  = 0x08;
+constexpr uint8_t kAttrDirectory = 0x10;
+constexpr uint8_t kAttrArchive   = 0x20;
+constexpr uint8_t kAttrLfn       = 0x0F;
+
+void put16(uint8_t* p, uint16_t v) { p[0] = v & 0xFF; p[1] = v >> 8; }
+void put32(uint8_t* p, uint32_t v) { for (int i = 0; i < 4; i++) p[i] = (v >> (8 * i)) & 0xFF; }
+uint16_t get16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+uint32_t get32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+/// Microsoft's recommended FAT32 cluster sizes by volume size.
+uint32_t sectorsPerClusterFor(uint64_t totalSectors) {
+    if (totalSectors <= 532480)   return 1;    // up to 260 MB: 512 B
+    if (totalSectors <= 16777216) return 8;    // up to 8 GB:   4 KB
+    if (totalSectors <= 33554432) return 16;   // up to 16 GB:  8 KB
+    if (totalSectors <= 67108864) return 32;   // up to 32 GB: 16 KB
+    return 64;
+}
+
+std::string foldKey(const std::string& name) {
+    std::string key = name;
+    for (auto& c : key) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    return key;
+}
+
+bool validShortChar(char c) {
+    if (c >= 'A' && c <= 'Z') return true;
+    if (c >= '0' && c <= '9') return true;
+    return std::strchr("$%'-_@~`!(){}^#&", c) != nullptr && c != '\0';
+}
+
+bool validLongName(const std::string& name) {
+    if (name.empty() || name.size() > kMaxNameLen || name == "." || name == "..") return false;
+    for (unsigned char c : name) {
+        if (c < 0x20 || std::strchr("\\/:*?\"<>|", c)) return false;
+    }
+    return true;
+}
+
+/// True if `name` can be stored as a bare 8.3 entry without a long name.
+bool isPlainShortName(const std::string& name, std::array<uint8_t, 11>& out) {
+    auto dot = name.find('.');
+    std::string base = name.substr(0, dot);
+    std::string ext = dot == std::string::npos ? "" : name.substr(dot + 1);
+    if (base.empty() || base.size() > 8 || ext.size() > 3 ||
+        ext.find('.') != std::string::npos || (dot != std::string::npos && ext.empty())) {
+        return false;
+    }
+    for (char c : base + ext) {
+        if (!validShortChar(c)) return false;
+    }
+    out.fill(' ');
+    std::memcpy(out.data(), base.data(), base.size());
+    std::memcpy(out.data() + 8, ext.data(), ext.size());
+    if (out[0] == 0xE5) out[0] = 0x05;
+    return true;
+}
+
+uint8_t lfnChecksum(const uint8_t* shortName) {
+    uint8_t sum = 0;
+    for (int i = 0; i < 11; i++) {
+        sum = static_cast<uint8_t>(((sum & 1) ? 0x80 : 0) + (sum >> 1) + shortName[i]);
+    }
+    return sum;
+}
+
+std::vector<uint16_t> toUtf16(const std::string& s) {
+    std::vector<uint16_t> out;
+    for (size_t i = 0; i < s.size();) {
+        unsigned char c = static_cast<unsigned char>(s[i]);
+        uint32_t cp;
+        size_t len;
+        if (c < 0x80)               { cp = c;        len = 1; }
+        else if ((c >> 5) == 0x6)   { cp = c & 0x1F; len = 2; }
+        else if ((c >> 4) == 0xE)   { cp = c & 0x0F; len = 3; }
+        else if ((c >> 3) == 0x1E)  { cp = c & 0x07; len = 4; }
+        else                        { cp = '_';      len = 1; }
+        for (size_t k = 1; k < len; k++) {
+            if (i + k >= s.size()) { cp = '_'; len = 1; break; }
+            cp = (cp << 6) | (static_cast<unsigned char>(s[i + k]) & 0x3F);
+        }
+        if (cp > 0xFFFF) {                      // outside the BMP: surrogate pair
+            cp -= 0x10000;
+            out.push_back(static_cast<uint16_t>(0xD800 | (cp >> 10)));
+            out.push_back(static_cast<uint16_t>(0xDC00 | (cp & 0x3FF)));
+        } else {
+            out.push_back(static_cast<uint16_t>(cp));
+        }
+        i += len;
+    }
+    return out;
+}
+
+std::string fromUtf16(const std::vector<uint16_t>& u) {
+    std::string out;
+    for (size_t i = 0; i < u.size(); i++) {
+        uint32_t cp = u[i];
+        if (cp >= 0xD800 && cp < 0xDC00 && i + 1 < u.size() &&
+            u[i + 1] >= 0xDC00 && u[i + 1] < 0xE000) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (u[++i] - 0xDC00);
+        }
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+    return out;
+}
+
+void fatDateTime(int64_t t, uint16_t& date, uint16_t& time) {
+    date = (1 << 5) | 1;   // 1980-01-01, the FAT epoch
+    time = 0;
+    if (t < 315532800) return;
+    std::time_t tt = static_cast<std::time_t>(t);
+    std::tm tm{};
+#ifdef _WIN32
+    if (gmtime_s(&tm, &tt) != 0) return;
+#else
+    if (!gmtime_r(&tt, &tm)) return;
+#endif
+    int year = std::min(tm.tm_year + 1900, 2107);
+    date = static_cast<uint16_t>(((year - 1980) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+    time = static_cast<uint16_t>((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+}
+
+int64_t sourceMtime(const std::string& path) {
+#ifndef _WIN32
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0) return static_cast<int64_t>(st.st_mtime);
+#else
+    (void)path;
+#endif
+    return 0;
+}
+
+std::vector<std::string> splitPath(const std::string& name) {
+    std::vector<std::string> parts;
+    std::string part;
+    std::istringstream in(name);
+    while (std::getline(in, part, '/')) {
+        if (!part.empty() && part != ".") parts.push_back(part);
+    }
+    return parts;
+}
+
+bool writeAt(std::fstream& f, uint64_t offset, const void* data, size_t len) {
+    f.seekp(static_cast<std::streamoff>(offset));
+    f.write(static_cast<const char*>(data), static_cast<std::streamsize>(len));
+    return f.good();
+}
+
+bool readAt(std::fstream& f, uint64_t offset, void* data, size_t len) {
+    f.seekg(static_cast<std::streamoff>(offset));
+    f.read(static_cast<char*>(data), static_cast<std::streamsize>(len));
+    return f.good();
+}
+
+} // namespace
+
+struct Fat32Image::Node {
+    std::string name;
+    std::array<uint8_t, 11> shortName{};
+    bool     longName     = false;   // needs VFAT entries in front of the 8.3 one
+    bool     directory    = false;
+    bool     dirty        = false;   // directory entries must be rewritten
+    uint32_t firstCluster = 0;
+    uint32_t size         = 0;
+    uint16_t date         = (1 << 5) | 1;
+    uint16_t time         = 0;
+    std::map<std::string, std::unique_ptr<Node>> children;   // key: folded name
+    std::set<std::array<uint8_t, 11>> shortNames;             // of the children
+    uint32_t nextTail     = 1;       // first ~N to try for the next alias
+};
+
+Fat32Image::Fat32Image() = default;
+
+Fat32Image::~Fat32Image() {
+    close();
+}
+
+// ---------------------------------------------------------------------------
+// Formatting
+// ---------------------------------------------------------------------------
+
+bool Fat32Image::format(const std::string& path, uint64_t sizeBytes, const std::string& label) {
+    const uint64_t totalSectors = sizeBytes / kSectorSize;
+    if (totalSectors > 0xFFFFFFFFULL) return false;
+
+    const uint32_t spc = sectorsPerClusterFor(totalSectors);
+    // FAT size per the Microsoft FAT32 specification
+    const uint64_t tmp1 = totalSectors - kReservedSectors;
+    const uint64_t tmp2 = (256ULL * spc + kNumFats) / 2;
+    const uint32_t fatSz = static_cast<uint32_t>((tmp1 + tmp2 - 1) / tmp2);
+    const uint64_t dataSectors = totalSectors - kReservedSectors - kNumFats * fatSz;
+    const uint64_t clusters = dataSectors / spc;
+    if (totalSectors <= kReservedSectors || clusters < kMinClusters || clusters > kMaxClusters) {
+        return false;
+    }
+
+    // Truncating to zero first drops every old block, so the whole volume
+    // starts out as one hole that reads back as zeros: nothing but the
+    // non-zero metadata below is ever written, whatever the size
+    {
+        std::ofstream create(path, std::ios::binary | std::ios::trunc);
+        if (!create) return false;
+    }
+    std::error_code ec;
+    fs::resize_file(path, totalSectors * kSectorSize, ec);
+    if (ec) return false;
+
+    std::fstream f(path, std::ios::binary | std::ios::in | std::ios::out);
+    if (!f.is_open()) return false;
+
+    // Boot sector (also written to the backup location)
+    uint8_t boot[kSectorSize] = {};
+    boot[0] = 0xEB; boot[1] = 0x58; boot[2] = 0x90;
+    std::memcpy(boot + 3, "SYNCV1.0", 8);
+    put16(boot + 11, kSectorSize);
+    boot[13] = static_cast<uint8_t>(spc);
+    put16(boot + 14, kReservedSectors);
+    boot[16] = kNumFats;
+    boot[21] = 0xF8;                               // fixed disk
+    put16(boot + 24, 32);                          // sectors per track
+    put16(boot + 26, 64);                          // heads
+    put32(boot + 32, static_cast<uint32_t>(totalSectors));
+    put32(boot + 36, fatSz);
+    put32(boot + 44, kRootCluster);
+    put16(boot + 48, kFsInfoSector);
+    put16(boot + 50, kBackupBoot);
+    boot[64] = 0x80;                               // drive number
+    boot[66] = 0x29;                               // extended boot signature
+    put32(boot + 67, 0x53590000u ^ static_cast<uint32_t>(totalSectors));   // volume id
+    std::array<uint8_t, 11> volLabel;
+    volLabel.fill(' ');
+    for (size_t i = 0; i < label.size() && i < volLabel.size(); i++) {
+        volLabel[i] = static_cast<uint8_t>(std::toupper(static_cast<unsigned char>(label[i])));
+    }
+    std::memcpy(boot + 71, volLabel.data(), volLabel.size());
+    std::memcpy(boot + 82, "FAT32   ", 8);
+    boot[510] = 0x55; boot[511] = 0xAA;
+
+    uint8_t info[kSectorSize] = {};
+    put32(info + 0, 0x41615252);
+    put32(info + 484, 0x61417272);
+    put32(info + 488, static_cast<uint32_t>(clusters - 1));   // root uses one
+    put32(info + 492, kRootCluster + 1);
+    put32(info + 508, 0xAA550000);
+
+    for (uint32_t base : {0u, kBackupBoot}) {
+        if (!writeAt(f, (base + 0) * kSectorSize, boot, kSectorSize)) return false;
+        if (!writeAt(f, (base + kFsInfoSector) * kSectorSize, info, kSectorSize)) return false;
+    }
+
+    uint8_t fatHead[12];
+    put32(fatHead + 0, 0x0FFFFF00 | 0xF8);
+    put32(fatHead + 4, kFatEoc);
+    put32(fatHead + 8, kFatEoc);                   // root directory
+    for (uint32_t i = 0; i < kNumFats; i++) {
+        uint64_t off = (kReservedSectors + static_cast<uint64_t>(i) * fatSz) * kSectorSize;
+        if (!writeAt(f, off, fatHead, sizeof(fatHead))) return false;
+    }
+
+    uint8_t labelEntry[kEntrySize] = {};
+    std::memcpy(labelEntry, volLabel.data(), volLabel.size());
+    labelEntry[11] = kAttrVolumeId;
+    put16(labelEntry + 24, (1 << 5) | 1);
+    uint64_t rootOff = (kReservedSectors + kNumFats * static_cast<uint64_t>(fatSz)) * kSectorSize;
+    if (!writeAt(f, rootOff, labelEntry, sizeof(labelEntry))) return false;
+
+    f.flush();
+    return f.good();
+}
+
+// ---------------------------------------------------------------------------
+// Opening / closing
+// ---------------------------------------------------------------------------
+
+bool Fat32Image::fail(const std::string& message) {
+    error_ = message;
+    return false;
+}
+
+bool Fat32Image::open(const std::string& path) {
+    close();
+    error_.clear();
+    image_.open(path, std::ios::binary | std::ios::in | std::ios::out);
+    if (!image_.is_open()) return fail("Cannot open image " + path);
+    path_ = path;
+
+    uint8_t boot[kSectorSize];
+    if (!readAt(image_, 0, boot, sizeof(boot))) {
+        close();
+        return fail("Cannot read boot sector");
+    }
+    const uint32_t spc = boot[13];
+    const uint32_t totalSectors = get32(boot + 32);
+    if (boot[510] != 0x55 || boot[511] != 0xAA || get16(boot + 11) != kSectorSize ||
+        spc == 0 || (spc & (spc - 1)) != 0 || get16(boot + 14) == 0 || boot[16] == 0 ||
+        get16(boot + 17) != 0 || get16(boot + 22) != 0 || get32(boot + 36) == 0 ||
+        totalSectors == 0) {
+        close();
+        return fail("Not a FAT32 image");
+    }
+
+    sectorsPerCluster_ = spc;
+    reservedSectors_   = get16(boot + 14);
+    numFats_           = boot[16];
+    fatSectors_        = get32(boot + 36);
+    rootCluster_       = get32(boot + 44);
+    fsInfoSector_      = get16(boot + 48);
+    const uint64_t firstData = reservedSectors_ + static_cast<uint64_t>(numFats_) * fatSectors_;
+    if (firstData >= totalSectors) {
+        close();
+        return fail("Not a FAT32 image");
+    }
+    dataStart_    = firstData * kSectorSize;
+    clusterCount_ = static_cast<uint32_t>((totalSectors - firstData) / spc);
+    const uint64_t fatEntries = static_cast<uint64_t>(fatSectors_) * kSectorSize / 4;
+    if (clusterCount_ + 2ULL > fatEntries || !validCluster(rootCluster_)) {
+        close();
+        return fail("Inconsistent FAT32 geometry");
+    }
+
+    std::vector<uint8_t> raw(static_cast<size_t>(fatSectors_) * kSectorSize);
+    if (!readAt(image_, static_cast<uint64_t>(reservedSectors_) * kSectorSize, raw.data(), raw.size())) {
+        close();
+        return fail("Cannot read FAT");
+    }
+    fat_.assign(clusterCount_ + 2, 0);
+    freeCount_ = 0;
+    for (uint32_t c = 0; c < clusterCount_ + 2; c++) {
+        fat_[c] = get32(raw.data() + 4ULL * c);
+        if (c >= 2 && (fat_[c] & kFatMask) == 0) freeCount_++;
+    }
+    dirtyFatSectors_.assign(fatSectors_, false);
+    nextFree_ = 2;
+
+    root_ = std::make_unique<Node>();
+    root_->directory = true;
+    root_->firstCluster = rootCluster_;
+    if (!loadDirectory(*root_, 0)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool Fat32Image::isOpen() const {
+    return root_ != nullptr;
+}
+
+void Fat32Image::close() {
+    if (root_) flush();
+    root_.reset();
+    fat_.clear();
+    dirtyFatSectors_.clear();
+    if (image_.is_open()) image_.close();
+}
+
+const std::string& Fat32Image::lastError() const {
+    return error_;
+}
+
+// ---------------------------------------------------------------------------
+// Allocation table
+// ---------------------------------------------------------------------------
+
+uint64_t Fat32Image::clusterOffset(uint32_t cluster) const {
+    return dataStart_ + static_cast<uint64_t>(cluster - 2) * clusterBytes();
+}
+
+bool Fat32Image::validCluster(uint32_t cluster) const {
+    return cluster >= 2 && cluster < clusterCount_ + 2;
+}
+
+uint64_t Fat32Image::clusterBytes() const {
+    return static_cast<uint64_t>(sectorsPerCluster_) * kSectorSize;
+}
+
+uint64_t Fat32Image::freeBytes() const {
+    return static_cast<uint64_t>(freeCount_) * clusterBytes();
+}
+
+void Fat32Image::setFat(uint32_t cluster, uint32_t value) {
+    uint32_t old = fat_[cluster] & kFatMask;
+    value &= kFatMask;
+    if (old == value) return;
+    if (old == 0) freeCount_--;
+    if (value == 0) freeCount_++;
+    fat_[cluster] = (fat_[cluster] & ~kFatMask) | value;   // keep the reserved top bits
+    dirtyFatSectors_[cluster * 4ULL / kSectorSize] = true;
+}
+
+std::vector<uint32_t> Fat32Image::chainOf(uint32_t first) const {
+    std::vector<uint32_t> chain;
+    uint32_t c = first;
+    while (validCluster(c) && chain.size() <= clusterCount_) {
+        chain.push_back(c);
+        uint32_t next = fat_[c] & kFatMask;
+        if (next >= kFatBad || next < 2) break;
+        c = next;
+    }
+    return chain;
+}
+
+bool Fat32Image::resizeChain(std::vector<uint32_t>& chain, size_t clusters) {
+    if (chain.size() > clusters) {
+        for (size_t i = clusters; i < chain.size(); i++) setFat(chain[i], 0);
+        if (clusters > 0) setFat(chain[clusters - 1], kFatEoc);
+        chain.resize(clusters);
+        return true;
+    }
+    size_t extra = clusters - chain.size();
+    if (extra == 0) return true;
+    if (extra > freeCount_) return fail("Image is full");
+
+    // Prefer the cluster right after the chain so files stay contiguous
+    uint32_t hint = chain.empty() ? nextFree_ : chain.back() + 1;
+    uint32_t c = validCluster(hint) ? hint : 2;
+    for (; extra > 0; extra--) {
+        while ((fat_[c] & kFatMask) != 0) {
+            c = c + 1 < clusterCount_ + 2 ? c + 1 : 2;
+        }
+        setFat(c, kFatEoc);
+        if (!chain.empty()) setFat(chain.back(), c);
+        chain.push_back(c);
+    }
+    nextFree_ = c + 1 < clusterCount_ + 2 ? c + 1 : 2;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Directories
+// ---------------------------------------------------------------------------
+
+bool Fat32Image::loadDirectory(Node& dir, int depth) {
+    if (depth > kMaxDepth) return fail("Directory tree too deep");
+
+    auto chain = chainOf(dir.firstCluster);
+    std::vector<uint8_t> data(chain.size() * clusterBytes());
+    for (size_t i = 0; i < chain.size(); i++) {
+        if (!readAt(image_, clusterOffset(chain[i]), data.data() + i * clusterBytes(), clusterBytes())) {
+            return fail("Cannot read directory");
+        }
+    }
+
+    std::vector<uint16_t> lfn;
+    int lfnRemaining = 0;
+    uint8_t lfnSum = 0;
+    for (size_t off = 0; off + kEntrySize <= data.size(); off += kEntrySize) {
+        const uint8_t* e = data.data() + off;
+        if (e[0] == 0x00) break;
+        if (e[0] == 0xE5) { lfnRemaining = 0; continue; }
+
+        if (e[11] == kAttrLfn) {
+            int ord = e[0] & 0x1F;
+            if (e[0] & 0x40) {
+                lfn.assign(static_cast<size_t>(ord) * kLfnChars, 0xFFFF);
+                lfnRemaining = ord;
+                lfnSum = e[13];
+            }
+            if (lfnRemaining != ord || ord == 0 || e[13] != lfnSum) {
+                lfnRemaining = 0;
+                continue;
+            }
+            static const int pos[kLfnChars] = {1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30};
+            for (size_t k = 0; k < kLfnChars; k++) {
+                lfn[(ord - 1) * kLfnChars + k] = get16(e + pos[k]);
+            }
+            lfnRemaining--;
+            if (lfnRemaining == 0) lfnRemaining = -1;   // complete, waiting for 8.3 entry
+            continue;
+        }
+
+        bool haveLfn = lfnRemaining == -1 && lfnSum == lfnChecksum(e);
+        lfnRemaining = 0;
+        if (e[11] & kAttrVolumeId) continue;
+        if (e[0] == '.' && (e[1] == ' ' || e[1] == '.')) continue;
+
+        auto node = std::make_unique<Node>();
+        std::memcpy(node->shortName.data(), e, 11);
+        if (haveLfn) {
+            auto end = std::find(lfn.begin(), lfn.end(), 0);
+            node->name = fromUtf16(std::vector<uint16_t>(lfn.begin(), end));
+            node->longName = true;
+        } else {
+            std::string base(reinterpret_cast<const char*>(e), 8);
+            std::string ext(reinterpret_cast<const char*>(e + 8), 3);
+            base.erase(base.find_last_not_of(' ') + 1);
+            auto extEnd = ext.find_last_not_of(' ');
+            ext.erase(extEnd == std::string::npos ? 0 : extEnd + 1);
+            if (!base.empty() && static_cast<uint8_t>(base[0]) == 0x05) base[0] = static_cast<char>(0xE5);
+            // NT lower-case flags
+            auto lower = [](std::string& s) {
+                for (auto& c : s) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            };
+            if (e[12] & 0x08) lower(base);
+            if (e[12] & 0x10) lower(ext);
+            node->name = ext.empty() ? base : base + "." + ext;
+        }
+        node->directory = (e[11] & kAttrDirectory) != 0;
+        node->firstCluster = (static_cast<uint32_t>(get16(e + 20)) << 16) | get16(e + 26);
+        node->size = node->directory ? 0 : get32(e + 28);
+        node->time = get16(e + 22);
+        node->date = get16(e + 24);
+
+        if (node->directory) {
+            if (!validCluster(node->firstCluster) || node->firstCluster == dir.firstCluster) continue;
+            if (!loadDirectory(*node, depth + 1)) return false;
+        }
+        dir.shortNames.insert(node->shortName);
+        dir.children[foldKey(node->name)] = std::move(node);
+    }
+    return true;
+}
+
+std::vector<uint8_t> Fat32Image::serializeDirectory(const Node& dir, uint32_t parentCluster) const {
+    std::vector<uint8_t> out;
+    auto addEntry = [&out](const uint8_t* name, uint8_t attr, uint32_t cluster, uint32_t size,
+                           uint16_t date, uint16_t time) {
+        uint8_t e[kEntrySize] = {};
+        std::memcpy(e, name, 11);
+        e[11] = attr;
+        put16(e + 14, time);
+        put16(e + 16, date);
+        put16(e + 18, date);
+        put16(e + 20, static_cast<uint16_t>(cluster >> 16));
+        put16(e + 22, time);
+        put16(e + 24, date);
+        put16(e + 26, static_cast<uint16_t>(cluster & 0xFFFF));
+        put32(e + 28, size);
+        out.insert(out.end(), e, e + kEntrySize);
+    };
+
+    if (&dir == root_.get()) {
+        // Keep the volume label the formatter put first in the root
+        std::array<uint8_t, 11> label;
+        label.fill(' ');
+        std::memcpy(label.data(), "SYNCV", 5);
+        uint8_t boot[kSectorSize];
+        if (readAt(image_, 0, boot, sizeof(boot))) std::memcpy(label.data(), boot + 71, 11);
+        addEntry(label.data(), kAttrVolumeId, 0, 0, dir.date, dir.time);
+    } else {
+        static const uint8_t dot[11]    = {'.', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' '};
+        static const uint8_t dotdot[11] = {'.', '.', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' '};
+        addEntry(dot, kAttrDirectory, dir.firstCluster, 0, dir.date, dir.time);
+        addEntry(dotdot, kAttrDirectory, parentCluster == rootCluster_ ? 0 : parentCluster,
+                 0, dir.date, dir.time);
+    }
+
+    for (const auto& [_, child] : dir.children) {
+        if (child->longName) {
+            auto units = toUtf16(child->name);
+            size_t count = (units.size() + kLfnChars - 1) / kLfnChars;
+            units.push_back(0);
+            units.resize(count * kLfnChars, 0xFFFF);
+            uint8_t sum = lfnChecksum(child->shortName.data());
+            static const int pos[kLfnChars] = {1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30};
+            for (size_t ord = count; ord >= 1; ord--) {
+                uint8_t e[kEntrySize] = {};
+                e[0] = static_cast<uint8_t>(ord | (ord == count ? 0x40 : 0));
+                e[11] = kAttrLfn;
+                e[13] = sum;
+                for (size_t k = 0; k < kLfnChars; k++) {
+                    put16(e + pos[k], units[(ord - 1) * kLfnChars + k]);
+                }
+                out.insert(out.end(), e, e + kEntrySize);
+            }
+        }
+        addEntry(child->shortName.data(), child->directory ? kAttrDirectory : kAttrArchive,
+                 child->firstCluster, child->size, child->date, child->time);
+    }
+    return out;
+}
+
+bool Fat32Image::flushDirectory(Node& dir, uint32_t parentCluster) {
+    if (dir.dirty) {
+        auto bytes = serializeDirectory(dir, parentCluster);
+        size_t clusters = std::max<size_t>(1, (bytes.size() + clusterBytes() - 1) / clusterBytes());
+        auto chain = chainOf(dir.firstCluster);
+        if (!resizeChain(chain, clusters)) return false;
+        bytes.resize(chain.size() * clusterBytes(), 0);   // zeroed tail marks the end
+        for (size_t i = 0; i < chain.size(); i++) {
+            if (!writeAt(image_, clusterOffset(chain[i]), bytes.data() + i * clusterBytes(), clusterBytes())) {
+                return fail("Cannot write directory");
+            }
+        }
+        dir.dirty = false;
+    }
+    for (auto& [_, child] : dir.children) {
+        if (child->directory && !flushDirectory(*child, dir.firstCluster)) return false;
+    }
+    return true;
+}
+
+bool Fat32Image::flush() {
+    if (!root_) return fail("Image not open");
+    if (!flushDirectory(*root_, 0)) return false;
+
+    // Only the FAT sectors that changed, mirrored into every copy
+    for (uint32_t s = 0; s < fatSectors_; s++) {
+        if (!dirtyFatSectors_[s]) continue;
+        uint8_t sector[kSectorSize] = {};
+        for (uint32_t i = 0; i < kSectorSize / 4; i++) {
+            uint64_t c = static_cast<uint64_t>(s) * (kSectorSize / 4) + i;
+            if (c < fat_.size()) put32(sector + 4 * i, fat_[c]);
+        }
+        for (uint32_t copy = 0; copy < numFats_; copy++) {
+            uint64_t off = (reservedSectors_ + static_cast<uint64_t>(copy) * fatSectors_ + s) * kSectorSize;
+            if (!writeAt(image_, off, sector, kSectorSize)) return fail("Cannot write FAT");
+        }
+        dirtyFatSectors_[s] = false;
+    }
+
+    if (fsInfoSector_ > 0 && fsInfoSector_ < reservedSectors_) {
+        uint8_t info[8];
+        put32(info, freeCount_);
+        put32(info + 4, nextFree_);
+        writeAt(image_, static_cast<uint64_t>(fsInfoSector_) * kSectorSize + 488, info, sizeof(info));
+    }
+
+    image_.flush();
+    if (!image_.good()) return fail("Cannot write image");
+#ifndef _WIN32
+    int fd = ::open(path_.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+#endif
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Tree operations
+// ---------------------------------------------------------------------------
+
+Fat32Image::Node* Fat32Image::find(const std::string& name) const {
+    Node* node = root_.get();
+    if (!node) return nullptr;
+    for (const auto& part : splitPath(name)) {
+        if (!node->directory) return nullptr;
+        auto it = node->children.find(foldKey(part));
+        if (it == node->children.end()) return nullptr;
+        node = it->second.get();
+    }
+    return node;
+}
+
+Fat32Image::Node* Fat32Image::createChild(Node& parent, const std::string& name, bool directory) {
+    if (!validLongName(name)) {
+        fail("Invalid file name: " + name);
+        return nullptr;
+    }
+    auto node = std::make_unique<Node>();
+    node->name = name;
+    node->directory = directory;
+
+    if (isPlainShortName(name, node->shortName) && !parent.shortNames.count(node->shortName)) {
+        node->longName = false;
+    } else {
+        // Lossy 8.3 alias with a numeric tail, unique within the directory
+        node->longName = true;
+        std::string upper = foldKey(name);
+        auto dot = upper.find_last_of('.');
+        std::string base, ext;
+        for (size_t i = 0; i < upper.size() && i < dot; i++) {
+            char c = upper[i];
+            if (c == '.' || c == ' ') continue;
+            base += validShortChar(c) ? c : '_';
+        }
+        if (dot != std::string::npos) {
+            for (size_t i = dot + 1; i < upper.size() && ext.size() < 3; i++) {
+                char c = upper[i];
+                if (c == ' ') continue;
+                ext += validShortChar(c) ? c : '_';
+            }
+        }
+        if (base.empty()) base = "_";
+
+        // Tails carry on from the last one handed out in this directory, so
+        // filling a directory doesn't re-probe every alias already taken
+        for (uint32_t n = parent.nextTail;; n++) {
+            std::string tail = "~" + std::to_string(n);
+            if (tail.size() > 7) {
+                n = 0;                          // ~9999999 used: start over
+                continue;
+            }
+            std::string b = base.substr(0, 8 - tail.size()) + tail;
+            std::array<uint8_t, 11> sn;
+            sn.fill(' ');
+            std::memcpy(sn.data(), b.data(), b.size());
+            std::memcpy(sn.data() + 8, ext.data(), ext.size());
+            if (!parent.shortNames.count(sn)) {
+                node->shortName = sn;
+                parent.nextTail = n + 1;
+                break;
+            }
+        }
+    }
+
+    if (directory) {
+        std::vector<uint32_t> chain;
+        if (!resizeChain(chain, 1)) return nullptr;
+        node->firstCluster = chain[0];
+        node->dirty = true;
+    }
+    parent.dirty = true;
+    parent.shortNames.insert(node->shortName);
+    Node* raw = node.get();
+    parent.children[foldKey(name)] = std::move(node);
+    return raw;
+}
+
+Fat32Image::Node* Fat32Image::ensureDirectory(const std::vector<std::string>& parts) {
+    Node* node = root_.get();
+    for (const auto& part : parts) {
+        auto it = node->children.find(foldKey(part));
+        if (it == node->children.end()) {
+            node = createChild(*node, part, true);
+            if (!node) return nullptr;
+        } else if (!it->second->directory) {
+            fail("Not a directory: " + part);
+            return nullptr;
+        } else {
+            node = it->second.get();
+        }
+    }
+    return node;
+}
+
+bool Fat32Image::writeStream(const std::string& name, std::istream& in, uint64_t size,
+                             int64_t mtime, std::string* sha256) {
+    if (!root_) return fail("Image not open");
+    if (size > 0xFFFFFFFFULL) return fail("File too large for FAT32: " + name);
+
+    auto parts = splitPath(name);
+    if (parts.empty()) return fail("Invalid file name: " + name);
+    std::string leaf = parts.back();
+    parts.pop_back();
+    Node* parent = ensureDirectory(parts);
+    if (!parent) return false;
+
+    Node* node;
+    auto it = parent->children.find(foldKey(leaf));
+    if (it != parent->children.end()) {
+        node = it->second.get();
+        if (node->directory) return fail("Is a directory: " + name);
+    } else {
+        node = createChild(*parent, leaf, false);
+        if (!node) return false;
+    }
+
+    // The old contents are overwritten in place, so a copy that fails part
+    // way can't be undone: drop the entry instead of exposing a file whose
+    // size promises data it doesn't hold
+    auto discard = [&](uint32_t firstCluster) {
+        auto clusters = chainOf(firstCluster);
+        resizeChain(clusters, 0);
+        parent->shortNames.erase(node->shortName);
+        parent->children.erase(foldKey(leaf));
+        parent->dirty = true;
+    };
+
+    // Reuse the existing chain in place; grow or trim it to the new size
+    const uint64_t cb = clusterBytes();
+    auto chain = chainOf(node->firstCluster);
+    if (!resizeChain(chain, static_cast<size_t>((size + cb - 1) / cb))) {
+        discard(node->firstCluster);
+        return false;
+    }
+    node->firstCluster = chain.empty() ? 0 : chain[0];
+    node->size = static_cast<uint32_t>(size);
+    fatDateTime(mtime, node->date, node->time);
+    parent->dirty = true;
+
+    HashVerifier hasher;
+    if (sha256) hasher.begin();
+
+    // Write runs of contiguous clusters with one call each
+    const size_t perRun = std::max<size_t>(1, kMaxRunBytes / cb);
+    std::vector<char> buffer(perRun * cb);
+    uint64_t remaining = size;
+    for (size_t i = 0; i < chain.size();) {
+        size_t run = 1;
+        while (i + run < chain.size() && run < perRun && chain[i + run] == chain[i] + run) run++;
+        size_t bytes = static_cast<size_t>(std::min<uint64_t>(remaining, run * cb));
+        in.read(buffer.data(), static_cast<std::streamsize>(bytes));
+        if (static_cast<size_t>(in.gcount()) != bytes) {
+            discard(node->firstCluster);
+            return fail("Short read from source: " + name);
+        }
+        if (sha256) hasher.update(buffer.data(), bytes);
+        std::fill(buffer.begin() + static_cast<std::ptrdiff_t>(bytes),
+                  buffer.begin() + static_cast<std::ptrdiff_t>(run * cb), 0);
+        if (!writeAt(image_, clusterOffset(chain[i]), buffer.data(), run * cb)) {
+            discard(node->firstCluster);
+            return fail("Cannot write image");
+        }
+        remaining -= bytes;
+        i += run;
+    }
+    if (sha256) *sha256 = hasher.finish();
+    return true;
+}
+
+bool Fat32Image::writeFile(const std::string& name, const std::string& srcPath,
+                           std::string* sha256, uint64_t* size) {
+    std::error_code ec;
+    uint64_t bytes = fs::file_size(srcPath, ec);
+    if (ec) return fail("Source file not found: " + srcPath);
+    std::ifstream in(srcPath, std::ios::binary);
+    if (!in.is_open()) return fail("Cannot open source file: " + srcPath);
+    if (!writeStream(name, in, bytes, sourceMtime(srcPath), sha256)) return false;
+    if (size) *size = bytes;
+    return true;
+}
+
+bool Fat32Image::writeData(const std::string& name, const std::string& data) {
+    std::istringstream in(data);
+    return writeStream(name, in, data.size(), 0, nullptr);
+}
+
+bool Fat32Image::remove(const std::string& name) {
+    auto parts = splitPath(name);
+    if (parts.empty()) return fail("Cannot remove the root directory");
+    std::string leaf = parts.back();
+    parts.pop_back();
+
+    Node* parent = root_ ? root_.get() : nullptr;
+    for (const auto& part : parts) {
+        if (!parent) break;
+        auto it = parent->children.find(foldKey(part));
+        parent = (it != parent->children.end() && it->second->directory) ? it->second.get() : nullptr;
+    }
+    if (!parent) return fail("No such file: " + name);
+    auto it = parent->children.find(foldKey(leaf));
+    if (it == parent->children.end()) return fail("No such file: " + name);
+    if (it->second->directory && !it->second->children.empty()) {
+        return fail("Directory not empty: " + name);
+    }
+
+    auto chain = chainOf(it->second->firstCluster);
+    resizeChain(chain, 0);
+    parent->shortNames.erase(it->second->shortName);
+    parent->children.erase(it);
+    parent->dirty = true;
+    return true;
+}
+
+int64_t Fat32Image::fileSize(const std::string& name) const {
+    Node* node = find(name);
+    return (node && !node->directory) ? static_cast<int64_t>(node->size) : -1;
+}
+
+bool Fat32Image::readFile(const std::string& name, std::string& out) const {
+    Node* node = find(name);
+    if (!node || node->directory) return false;
+    out.clear();
+    out.reserve(node->size);
+    uint64_t remaining = node->size;
+    std::vector<char> buffer(clusterBytes());
+    for (uint32_t c : chainOf(node->firstCluster)) {
+        if (remaining == 0) break;
+        size_t n = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+        if (!readAt(image_, clusterOffset(c), buffer.data(), n)) return false;
+        out.append(buffer.data(), n);
+        remaining -= n;
+    }
+    return remaining == 0;
+}
+
+void Fat32Image::collect(const Node& dir, const std::string& prefix,
+                         std::vector<std::string>& files, std::vector<std::string>& dirs) const {
+    for (const auto& [_, child] : dir.children) {
+        std::string path = prefix.empty() ? child->name : prefix + "/" + child->name;
+        if (child->directory) {
+            dirs.push_back(path);
+            collect(*child, path, files, dirs);
+        } else {
+            files.push_back(path);
+        }
+    }
+}
+
+std::vector<std::string> Fat32Image::listFiles() const {
+    std::vector<std::string> files, dirs;
+    if (root_) collect(*root_, "", files, dirs);
+    return files;
+}
+
+std::vector<std::string> Fat32Image::listDirectories() const {
+    std::vector<std::string> files, dirs;
+    if (root_) collect(*root_, "", files, dirs);
+    return dirs;
+}
+
+} // namespace syncv
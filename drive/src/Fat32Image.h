@@ -0,0 +1,130 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <cstdint>
+
+namespace syncv {
+
+/// Reads and writes a FAT32 filesystem directly inside an image file, so the
+/// USB backing image can be prepared without a loop mount or root.
+///
+///   - format() lays out boot sector, FSInfo, both FATs and the root
+///     directory; the result is byte-for-byte deterministic for a given size
+///   - open() loads the FAT and the directory tree into memory
+///   - writeFile()/remove() allocate and free clusters in memory and write
+///     file data straight to its clusters (existing chains are reused)
+///   - flush() rewrites only the directories that changed and only the FAT
+///     sectors that changed, in every FAT copy, then the FSInfo sector
+///
+/// Long file names (VFAT) are written for anything that isn't a plain
+/// upper-case 8.3 name. Only 512-byte sectors are supported.
+class Fat32Image {
+public:
+    Fat32Image();
+    ~Fat32Image();
+
+    Fat32Image(const Fat32Image&) = delete;
+    Fat32Image& operator=(const Fat32Image&) = delete;
+
+    /// Smallest image format() accepts: below this the cluster count makes
+    /// it FAT16 by definition, which is not supported.
+    static constexpr uint64_t kMinSizeMB = 33;
+
+    /// Create (or overwrite) a FAT32 filesystem of sizeBytes at path. The
+    /// file is sparse: only the boot sectors, FSInfo, the first FAT entries
+    /// and the root directory are written, so it takes the same time for
+    /// any size. Fails below kMinSizeMB.
+    static bool format(const std::string& path, uint64_t sizeBytes,
+                       const std::string& label = "SYNCV");
+
+    /// Open an existing FAT32 image. Returns false if it isn't one.
+    bool open(const std::string& path);
+    bool isOpen() const;
+
+    /// Flush pending metadata and close the image.
+    void close();
+
+    /// Copy srcPath into the image as `name` ("dir/sub/file.log"), creating
+    /// directories as needed and replacing an existing file. When sha256 is
+    /// given it receives the SHA-256 of the data, hashed while copying, and
+    /// `size` the number of bytes that digest covers.
+    bool writeFile(const std::string& name, const std::string& srcPath,
+                   std::string* sha256 = nullptr, uint64_t* size = nullptr);
+
+    /// Copy `size` bytes from `in` into the image as `name`, stamped with
+    /// `mtime` (Unix time; 0 = the FAT epoch). If the stream ends early (a source
+    /// truncated mid-copy) or the write fails, the file is dropped from the
+    /// image rather than left with its new size over partial contents.
+    bool writeStream(const std::string& name, std::istream& in, uint64_t size,
+                     int64_t mtime, std::string* sha256 = nullptr);
+
+    /// Store `data` as a file in the image.
+    bool writeData(const std::string& name, const std::string& data);
+
+    /// Remove a file or an empty directory.
+    bool remove(const std::string& name);
+
+    /// Size of a file in the image, or -1 if there is no such file.
+    int64_t fileSize(const std::string& name) const;
+
+    /// Read a whole file from the image.
+    bool readFile(const std::string& name, std::string& out) const;
+
+    /// All regular files as "dir/name" paths, and all directories.
+    std::vector<std::string> listFiles() const;
+    std::vector<std::string> listDirectories() const;
+
+    uint64_t freeBytes() const;
+    uint64_t clusterBytes() const;
+
+    /// Write changed directories, FAT sectors and FSInfo, and sync the image.
+    bool flush();
+
+    /// Description of the last failure.
+    const std::string& lastError() const;
+
+private:
+    struct Node;
+
+    std::string           path_;
+    mutable std::fstream  image_;
+    std::unique_ptr<Node> root_;
+    std::string           error_;
+
+    uint32_t sectorsPerCluster_ = 0;
+    uint32_t reservedSectors_   = 0;
+    uint32_t numFats_           = 0;
+    uint32_t fatSectors_        = 0;
+    uint32_t rootCluster_       = 0;
+    uint32_t clusterCount_      = 0;
+    uint32_t fsInfoSector_      = 0;
+    uint64_t dataStart_         = 0;   // byte offset of cluster 2
+    uint32_t freeCount_         = 0;
+    uint32_t nextFree_          = 2;
+
+    std::vector<uint32_t> fat_;
+    std::vector<bool>     dirtyFatSectors_;
+
+    bool fail(const std::string& message);
+    uint64_t clusterOffset(uint32_t cluster) const;
+    bool validCluster(uint32_t cluster) const;
+
+    void setFat(uint32_t cluster, uint32_t value);
+    std::vector<uint32_t> chainOf(uint32_t first) const;
+    bool resizeChain(std::vector<uint32_t>& chain, size_t clusters);
+
+    bool loadDirectory(Node& dir, int depth);
+    bool flushDirectory(Node& dir, uint32_t parentCluster);
+    std::vector<uint8_t> serializeDirectory(const Node& dir, uint32_t parentCluster) const;
+
+    Node* find(const std::string& name) const;
+    Node* ensureDirectory(const std::vector<std::string>& parts);
+    Node* createChild(Node& parent, const std::string& name, bool directory);
+    void collect(const Node& dir, const std::string& prefix,
+                 std::vector<std::string>& files, std::vector<std::string>& dirs) const;
+};
+
+} // namespace syncv
@@ -173,6 +173,18 @@ std::string HashVerifier::hashFile(const std::string& filePath) {
     return toHex(sha256Final(ctx));
 }
 
+void HashVerifier::begin() {
+    sha256Init(streamCtx_);
+}
+
+void HashVerifier::update(const void* data, size_t len) {
+    sha256Update(streamCtx_, static_cast<const uint8_t*>(data), len);
+}
+
+std::string HashVerifier::finish() {
+    return toHex(sha256Final(streamCtx_));
+}
+
 bool HashVerifier::verifyFile(const std::string& filePath, const std::string& expectedHash) {
     std::string actualHash = hashFile(filePath);
     if (actualHash.empty() || actualHash.size() != expectedHash.size()) return false;
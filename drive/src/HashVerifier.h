@@ -19,6 +19,13 @@ public:
     /// Verify that a file's SHA256 matches the expected hash.
     bool verifyFile(const std::string& filePath, const std::string& expectedHash);
 
+    /// Streaming interface for callers that already read the data (e.g. a
+    /// copy loop): begin(), update() for each piece in order, then finish()
+    /// for the hex digest.
+    void begin();
+    void update(const void* data, size_t len);
+    std::string finish();
+
 private:
     // Minimal SHA256 implementation (no external dependency)
     struct SHA256Context {
@@ -33,6 +40,8 @@ private:
     void sha256Transform(SHA256Context& ctx, const uint8_t block[64]);
 
     std::string toHex(const std::array<uint8_t, 32>& hash);
+
+    SHA256Context streamCtx_{};
 };
 
 } // namespace syncv
@@ -0,0 +1,164 @@
+#include "ImageManifest.h"
+#include "HashVerifier.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <unordered_set>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace syncv {
+
+namespace {
+
+bool statSource(const std::string& path, ManifestEntry& out) {
+    std::error_code ec;
+    auto size = fs::file_size(path, ec);
+    if (ec) return false;
+    auto mtime = fs::last_write_time(path, ec);
+    if (ec) return false;
+    out.size = static_cast<uint64_t>(size);
+    out.mtimeNs = static_cast<int64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch()).count());
+    return true;
+}
+
+/// fsync a file or directory by path.
+bool syncPath(const std::string& path, bool directory) {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), directory ? (O_RDONLY | O_DIRECTORY) : O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#else
+    (void)path;
+    (void)directory;
+    return true;  // no portable directory sync; NTFS journals renames itself
+#endif
+}
+
+} // namespace
+
+std::string ImageManifest::normalizeName(const std::string& name) {
+    std::string n = fs::path(name).lexically_normal().generic_string();
+    while (!n.empty() && n.front() == '/') n.erase(0, 1);
+    return n;
+}
+
+bool ImageManifest::load(const std::string& path) {
+    entries_.clear();
+    std::error_code ec;
+    if (!fs::exists(path, ec)) return true;
+
+    std::ifstream in(path);
+    if (!in.is_open()) return false;
+
+    // One entry per line: size \t mtimeNs \t sha256 \t name
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        ManifestEntry entry;
+        std::string name;
+        if (!(fields >> entry.size >> entry.mtimeNs >> entry.sha256)) continue;
+        if (entry.sha256 == "-") entry.sha256.clear();
+        fields.get();  // the tab before the name
+        std::getline(fields, name);
+        if (name.empty()) continue;
+        entries_[name] = entry;
+    }
+    return true;
+}
+
+bool ImageManifest::save(const std::string& path) const {
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out.is_open()) return false;
+        for (const auto& [name, entry] : entries_) {
+            out << entry.size << '\t' << entry.mtimeNs << '\t'
+                << (entry.sha256.empty() ? "-" : entry.sha256) << '\t' << name << '\n';
+        }
+        out.flush();
+        if (!out.good()) return false;
+    }
+    // Incremental prepare trusts whatever is here, so the data must be on
+    // disk before the rename can expose it, and the rename before we return
+    if (!syncPath(tmp, false)) return false;
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    if (ec) return false;
+    auto parent = fs::path(path).parent_path();
+    return syncPath(parent.empty() ? std::string(".") : parent.string(), true);
+}
+
+ManifestPlan ImageManifest::plan(
+    const std::vector<std::pair<std::string, std::string>>& files) {
+    ManifestPlan result;
+    std::unordered_set<std::string> wanted;
+    wanted.reserve(files.size());
+    HashVerifier hasher;
+
+    for (const auto& [src, dstName] : files) {
+        ManifestChange change;
+        change.srcPath = src;
+        change.name = normalizeName(dstName);
+        if (!wanted.insert(change.name).second) continue;  // duplicate name: first wins
+
+        bool haveStat = statSource(src, change.stat);
+        auto it = entries_.find(change.name);
+        if (haveStat && it != entries_.end() && it->second.size == change.stat.size) {
+            if (it->second.mtimeNs == change.stat.mtimeNs) {
+                result.unchanged.push_back(change.name);
+                continue;
+            }
+            // Same size, new mtime: only a hash can tell whether it changed
+            if (!it->second.sha256.empty() && hasher.hashFile(src) == it->second.sha256) {
+                it->second.mtimeNs = change.stat.mtimeNs;
+                result.unchanged.push_back(change.name);
+                continue;
+            }
+        }
+        result.changedBytes += change.stat.size;
+        result.changed.push_back(std::move(change));
+    }
+
+    for (const auto& [name, _] : entries_) {
+        if (!wanted.count(name)) result.removed.push_back(name);
+    }
+    return result;
+}
+
+void ImageManifest::record(const ManifestChange& change, const std::string& sha256,
+                           uint64_t size) {
+    ManifestEntry entry = change.stat;
+    entry.size = size;
+    entry.sha256 = sha256;
+    entries_[change.name] = entry;
+}
+
+void ImageManifest::erase(const std::string& name) {
+    entries_.erase(name);
+}
+
+void ImageManifest::clear() {
+    entries_.clear();
+}
+
+const ManifestEntry* ImageManifest::find(const std::string& name) const {
+    auto it = entries_.find(name);
+    return it == entries_.end() ? nullptr : &it->second;
+}
+
+size_t ImageManifest::size() const {
+    return entries_.size();
+}
+
+} // namespace syncv
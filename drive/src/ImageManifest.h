@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <unordered_map>
+
+namespace syncv {
+
+/// What the image holds for one file, as of the last time it was written.
+struct ManifestEntry {
+    uint64_t    size    = 0;
+    int64_t     mtimeNs = 0;   // source mtime when it was copied
+    std::string sha256;        // hex digest of the copied data
+};
+
+/// A file that has to be (re)written into the image.
+struct ManifestChange {
+    std::string   srcPath;
+    std::string   name;        // normalized path inside the image
+    ManifestEntry stat;        // source size/mtime seen while planning
+};
+
+/// Result of comparing the wanted file set against the manifest.
+struct ManifestPlan {
+    std::vector<ManifestChange> changed;
+    std::vector<std::string>    unchanged;   // names already up to date
+    std::vector<std::string>    removed;     // in the manifest, no longer wanted
+    uint64_t                    changedBytes = 0;
+};
+
+/// Records what has already been written into a USB image so a refresh
+/// only has to copy additions and changes.
+///
+/// A file counts as unchanged when its size and mtime match the entry.
+/// If only the mtime moved (touched, rewritten with the same bytes), the
+/// source is re-hashed and compared with the stored SHA-256 before it is
+/// scheduled for a copy.
+class ImageManifest {
+public:
+    /// Load entries from disk. A missing file is an empty manifest; returns
+    /// false only if an existing file cannot be read.
+    bool load(const std::string& path);
+
+    /// Write all entries to disk (atomically, via a temp file and rename;
+    /// both the file and its directory are fsynced).
+    bool save(const std::string& path) const;
+
+    /// Compare (source path, image name) pairs against the manifest.
+    /// Entries whose content was confirmed unchanged by hash get their
+    /// mtime refreshed so the next plan is stat-only again.
+    ManifestPlan plan(const std::vector<std::pair<std::string, std::string>>& files);
+
+    /// Record that `change` was written as `size` bytes with the given
+    /// digest. Both come from the copy itself: a log that grew since it
+    /// was planned keeps a size that matches its hash.
+    void record(const ManifestChange& change, const std::string& sha256, uint64_t size);
+
+    void erase(const std::string& name);
+    void clear();
+
+    /// Entry for an image name, or nullptr.
+    const ManifestEntry* find(const std::string& name) const;
+    size_t size() const;
+
+    /// Canonical form of a path inside the image ("a//b/../c" → "a/c").
+    static std::string normalizeName(const std::string& name);
+
+private:
+    std::unordered_map<std::string, ManifestEntry> entries_;
+};
+
+} // namespace syncv
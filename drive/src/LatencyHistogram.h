@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+namespace syncv {
+
+/// Log-linear bucketing shared by the timing histograms. Values below
+/// kSubBuckets get a bucket each; above that every power of two is split
+/// into kSubBuckets, so a bucket's upper bound is within 25% of its values.
+namespace latency {
+
+constexpr size_t kSubBuckets = 4;
+
+inline size_t bucketOf(uint64_t value, size_t bucketCount) {
+    if (value < kSubBuckets) return static_cast<size_t>(value);
+    size_t msb = 0;
+    while ((value >> msb) > 1) msb++;
+    size_t frac = static_cast<size_t>((value >> (msb - 2)) & (kSubBuckets - 1));
+    return std::min(msb * kSubBuckets + frac, bucketCount - 1);
+}
+
+inline uint64_t bucketUpperBound(size_t bucket) {
+    if (bucket < kSubBuckets) return bucket;
+    size_t msb = bucket / kSubBuckets;
+    uint64_t frac = bucket % kSubBuckets;
+    return ((kSubBuckets + frac + 1) << (msb - 2)) - 1;
+}
+
+/// Upper bound of the bucket holding the p-th percentile (p in [0, 100]) of
+/// `count` values, capped at the largest value seen.
+template <typename Buckets>
+uint64_t percentile(const Buckets& histogram, uint64_t count, uint64_t max, double p) {
+    if (count == 0) return 0;
+    p = std::clamp(p, 0.0, 100.0);
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(count) + 0.5);
+    rank = std::clamp<uint64_t>(rank, 1, count);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < histogram.size(); i++) {
+        seen += histogram[i];
+        if (seen >= rank) return std::min(bucketUpperBound(i), max);
+    }
+    return max;
+}
+
+} // namespace latency
+
+} // namespace syncv
@@ -1,12 +1,417 @@
 #include "MetadataExtractor.h"
-#include <sstream>
+#include <string_view>
+#include <vector>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+#include <filesystem>
+#include <cstring>
+#include <cstdint>
 
 namespace syncv {
 
+namespace {
+
+std::string_view trim(std::string_view s) {
+    constexpr std::string_view kSpace = " \t\r\n";
+    size_t first = s.find_first_not_of(kSpace);
+    if (first == std::string_view::npos) return {};
+    return s.substr(first, s.find_last_not_of(kSpace) - first + 1);
+}
+
+// ---------------------------------------------------------------------------
+// Type B JSON: stage 1 finds the structural characters, stage 2 walks them
+// ---------------------------------------------------------------------------
+
+constexpr uint64_t kOnes  = 0x0101010101010101ULL;
+constexpr uint64_t kHighs = 0x8080808080808080ULL;
+
+constexpr uint64_t broadcast(char c) {
+    return kOnes * static_cast<uint8_t>(c);
+}
+
+/// Non-zero if any byte of `word` equals the byte broadcast in `pattern`.
+inline uint64_t hasByte(uint64_t word, uint64_t pattern) {
+    uint64_t x = word ^ pattern;
+    return (x - kOnes) & ~x & kHighs;
+}
+
+/// Stage 1: positions of every unescaped quote, and of { } [ ] : , outside
+/// strings. Eight bytes are classified at a time (SWAR), so runs of plain
+/// text, which are most of a status dump, are skipped a word at a time.
+std::vector<uint32_t> scanStructure(std::string_view json) {
+    std::vector<uint32_t> tape;
+    tape.reserve(json.size() / 8 + 16);
+
+    const char* p = json.data();
+    const size_t n = json.size();
+    bool inString = false;
+    size_t i = 0;
+    while (i < n) {
+        if (i + 8 <= n) {
+            uint64_t w;
+            std::memcpy(&w, p + i, 8);
+            uint64_t hits = hasByte(w, broadcast('"')) | hasByte(w, broadcast('\\'));
+            if (!inString) {
+                // '[' and ']' differ from '{' and '}' only in bit 5
+                uint64_t folded = w | broadcast(0x20);
+                hits |= hasByte(folded, broadcast('{')) | hasByte(folded, broadcast('}')) |
+                        hasByte(w, broadcast(':')) | hasByte(w, broadcast(','));
+            }
+            if (!hits) {
+                i += 8;
+                continue;
+            }
+        }
+
+        // Something interesting in this word: classify it byte by byte
+        const size_t end = std::min(i + 8, n);
+        for (; i < end; i++) {
+            const char c = p[i];
+            if (inString) {
+                if (c == '\\') {
+                    i++;                    // the escaped byte is never structural
+                } else if (c == '"') {
+                    tape.push_back(static_cast<uint32_t>(i));
+                    inString = false;
+                }
+            } else if (c == '"' || c == '{' || c == '}' || c == '[' || c == ']' ||
+                       c == ':' || c == ',') {
+                tape.push_back(static_cast<uint32_t>(i));
+                if (c == '"') inString = true;
+            }
+        }
+    }
+    return tape;
+}
+
+void appendUtf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+/// Four hex digits at s[pos], or -1.
+int32_t hex4(std::string_view s, size_t pos) {
+    if (pos + 4 > s.size()) return -1;
+    int32_t v = 0;
+    for (size_t i = pos; i < pos + 4; i++) {
+        char c = s[i];
+        int d = (c >= '0' && c <= '9') ? c - '0'
+              : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+              : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+        if (d < 0) return -1;
+        v = v * 16 + d;
+    }
+    return v;
+}
+
+/// JSON string body (between the quotes) into `out`, resolving escapes.
+/// Unknown escapes keep the escaped character.
+void unescapeJson(std::string_view body, std::string& out) {
+    out.clear();
+    size_t slash = body.find('\\');
+    if (slash == std::string_view::npos) {
+        out.assign(body);
+        return;
+    }
+    out.reserve(body.size());
+    out.append(body.substr(0, slash));
+    for (size_t i = slash; i < body.size(); i++) {
+        char c = body[i];
+        if (c != '\\' || i + 1 >= body.size()) {
+            out += c;
+            continue;
+        }
+        char e = body[++i];
+        switch (e) {
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                int32_t cp = hex4(body, i + 1);
+                if (cp < 0) {
+                    out += e;
+                    break;
+                }
+                i += 4;
+                if (cp >= 0xD800 && cp < 0xDC00 && i + 6 < body.size() &&
+                    body[i + 1] == '\\' && body[i + 2] == 'u') {
+                    int32_t low = hex4(body, i + 3);
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        i += 6;
+                    }
+                }
+                appendUtf8(out, static_cast<uint32_t>(cp));
+                break;
+            }
+            default: out += e; break;    // \" \\ \/ and anything unknown
+        }
+    }
+}
+
+/// Stage 2: walk the structural tape, flattening nested objects and arrays
+/// into dotted keys ("sensors.0.temp"). Stops at the first syntax error,
+/// keeping whatever was read before it.
+class JsonFlattener {
+public:
+    JsonFlattener(std::string_view json, DeviceMetadata& m)
+        : json_(json), tape_(scanStructure(json)), m_(m) {}
+
+    /// Returns true if at least one value was stored.
+    bool run() {
+        if (tape_.empty() || tape_[0] != 0 || json_[0] != '{') return false;
+
+        // About one value per ':' or ','; fields grow if this falls short.
+        // The value buffer grows as values are stored and is trimmed at the
+        // end: the document's size says little about how much of it is kept
+        size_t values = 1;
+        for (uint32_t pos : tape_) {
+            if (json_[pos] == ':' || json_[pos] == ',') values++;
+        }
+        m_.fields.reserve(values, 0);
+        parseValue(0);
+        m_.fields.shrinkToFit();
+        return found_;
+    }
+
+private:
+    static constexpr int kMaxDepth = 64;
+
+    std::string_view      json_;
+    std::vector<uint32_t> tape_;
+    DeviceMetadata&       m_;
+    size_t                next_ = 0;       // index into tape_
+    std::string           path_;
+    std::string           text_;           // scratch for unescaped strings
+    bool                  found_ = false;
+
+    bool atEnd() const { return next_ >= tape_.size(); }
+    char peek() const { return json_[tape_[next_]]; }
+
+    /// The quoted string starting at the next tape entry, unescaped into text_.
+    bool readString() {
+        if (next_ + 1 >= tape_.size() || peek() != '"') return false;
+        size_t open = tape_[next_], close = tape_[next_ + 1];
+        next_ += 2;
+        unescapeJson(json_.substr(open + 1, close - open - 1), text_);
+        return true;
+    }
+
+    void store(std::string_view value) {
+        if (path_ == "id") {
+            m_.deviceId.assign(value);
+        } else if (path_ == "fw") {
+            m_.firmwareVersion.assign(value);
+        } else {
+            m_.fields.set(path_, value);
+        }
+        found_ = true;
+    }
+
+    bool parseValue(int depth) {
+        if (depth > kMaxDepth) return false;
+        if (!atEnd()) {
+            char c = peek();
+            if (c == '{') return parseObject(depth);
+            if (c == '[') return parseArray(depth);
+            if (c == '"') {
+                if (!readString()) return false;
+                store(text_);
+                return true;
+            }
+        }
+        // Number or literal: the text up to the next structural character
+        size_t from = next_ == 0 ? 0 : tape_[next_ - 1] + 1;
+        size_t to = atEnd() ? json_.size() : tape_[next_];
+        std::string_view scalar = trim(json_.substr(from, to - from));
+        if (scalar.empty()) return false;
+        store(scalar);
+        return true;
+    }
+
+    bool parseObject(int depth) {
+        next_++;                                   // '{'
+        if (!atEnd() && peek() == '}') {
+            next_++;
+            return true;
+        }
+        const size_t base = path_.size();
+        while (true) {
+            if (!readString()) return false;
+            if (base > 0) path_ += '.';
+            path_ += text_;
+            if (atEnd() || peek() != ':') return false;
+            next_++;
+            bool ok = parseValue(depth + 1);
+            path_.resize(base);
+            if (!ok || atEnd()) return false;
+            char c = json_[tape_[next_++]];
+            if (c == '}') return true;
+            if (c != ',') return false;
+        }
+    }
+
+    bool parseArray(int depth) {
+        next_++;                                   // '['
+        if (!atEnd() && peek() == ']') {
+            next_++;
+            return true;
+        }
+        const size_t base = path_.size();
+        for (size_t index = 0;; index++) {
+            if (base > 0) path_ += '.';
+            path_ += std::to_string(index);
+            bool ok = parseValue(depth + 1);
+            path_.resize(base);
+            if (!ok || atEnd()) return false;
+            char c = json_[tape_[next_++]];
+            if (c == ']') return true;
+            if (c != ',') return false;
+        }
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Device type detection
+// ---------------------------------------------------------------------------
+
+constexpr size_t kDetectHeadBytes = 1024;   // detectors only look at this much
+constexpr size_t kMaxCachedTypes  = 4096;   // typeCache_ is cleared beyond this
+constexpr unsigned kDirectoryAgreement = 3; // same-type files before a directory is trusted
+
+/// The part of a file detectors see: leading BOM and whitespace removed.
+std::string_view detectionHead(std::string_view raw) {
+    if (raw.substr(0, 3) == "\xEF\xBB\xBF") raw.remove_prefix(3);
+    size_t first = raw.find_first_not_of(" \t\r\n");
+    if (first == std::string_view::npos) return {};
+    return raw.substr(first, kDetectHeadBytes);
+}
+
+/// Cache key for the directory holding sourcePath.
+std::string directoryKey(const std::string& sourcePath) {
+    return std::filesystem::path(sourcePath).parent_path().string() + '/';
+}
+
+/// Type A: share of lines that look like key=value, bonus for device_id.
+float detectKeyValue(std::string_view head) {
+    size_t lines = 0, pairs = 0;
+    bool hasDeviceId = false;
+    while (!head.empty()) {
+        size_t eol = head.find('\n');
+        if (eol == std::string_view::npos && head.size() == kDetectHeadBytes) break;  // cut off
+        std::string_view line = trim(head.substr(0, eol));
+        head = eol == std::string_view::npos ? std::string_view() : head.substr(eol + 1);
+        if (line.empty()) continue;
+        lines++;
+
+        size_t eq = line.find('=');
+        if (eq == std::string_view::npos || eq == 0) continue;
+        std::string_view key = trim(line.substr(0, eq));
+        if (key.empty() || key.find_first_of(" \t{\"") != std::string_view::npos) continue;
+        pairs++;
+        if (key == "device_id") hasDeviceId = true;
+    }
+    if (lines == 0) return 0;
+    return 0.8f * static_cast<float>(pairs) / static_cast<float>(lines) +
+           (hasDeviceId ? 0.15f : 0.0f);
+}
+
+/// Type B: a JSON object, more likely still if it names an "id".
+float detectJson(std::string_view head) {
+    if (head.empty() || head.front() != '{') return 0;
+    return head.find("\"id\"") != std::string_view::npos ? 0.95f : 0.6f;
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// Batch workers
+// ---------------------------------------------------------------------------
+
+namespace detail {
+
+/// Threads that sleep between batches. run() hands the same job to every
+/// thread, takes part itself and returns once all of them are done.
+struct ParsePool {
+    std::mutex              mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::function<void()>   job;
+    uint64_t                generation = 0;
+    size_t                  busy = 0;
+    bool                    stopping = false;
+    std::vector<std::thread> threads;
+
+    explicit ParsePool(unsigned count) {
+        for (unsigned i = 0; i < count; i++) threads.emplace_back([this] { loop(); });
+    }
+
+    ~ParsePool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+    void run(const std::function<void()>& work) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = work;
+            generation++;
+            busy = threads.size();
+        }
+        wake.notify_all();
+        work();
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busy == 0; });
+    }
+
+    void loop() {
+        uint64_t seen = 0;
+        for (;;) {
+            std::function<void()> work;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+                work = job;
+            }
+            work();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0) done.notify_all();
+        }
+    }
+};
+
+} // namespace detail
+
+MetadataExtractor::~MetadataExtractor() = default;
+
 MetadataExtractor::MetadataExtractor() {
     parsers_["typeA"] = parseTypeA;
     parsers_["typeB"] = parseTypeB;
+    detectors_["typeA"] = detectKeyValue;
+    detectors_["typeB"] = detectJson;
 }
 
 DeviceMetadata MetadataExtractor::extract(const std::string& rawData,
@@ -24,10 +429,175 @@ DeviceMetadata MetadataExtractor::extract(const std::string& rawData,
     return metadata;
 }
 
+DeviceMetadata MetadataExtractor::extractAny(const std::string& rawData,
+                                             const std::string& sourcePath) const {
+    TypeDetection detected = detectType(rawData, sourcePath);
+    if (!detected.deviceType.empty()) {
+        auto it = parsers_.find(detected.deviceType);
+        if (it != parsers_.end()) {
+            auto metadata = it->second(rawData);
+            if (metadata.parseSuccessful) {
+                metadata.deviceType = detected.deviceType;
+                return metadata;
+            }
+        }
+        // Wrong guess, or this path now holds something else
+        forgetType(sourcePath);
+    }
+
+    for (const auto& [type, parser] : parsers_) {
+        if (type == detected.deviceType) continue;
+        auto metadata = parser(rawData);
+        if (metadata.parseSuccessful) {
+            metadata.deviceType = type;
+            rememberType(sourcePath, {type, 1.0f, false});
+            return metadata;
+        }
+    }
+    return DeviceMetadata{};
+}
+
+TypeDetection MetadataExtractor::detectType(const std::string& rawData,
+                                            const std::string& sourcePath) const {
+    if (!sourcePath.empty()) {
+        std::lock_guard<std::mutex> lock(typeCacheMutex_);
+        auto it = typeCache_.find(sourcePath);
+        if (it == typeCache_.end()) {
+            it = typeCache_.find(directoryKey(sourcePath));
+            if (it != typeCache_.end() && it->second.agreed < kDirectoryAgreement)
+                it = typeCache_.end();
+        }
+        if (it != typeCache_.end()) {
+            TypeDetection hit = it->second.detection;
+            hit.cached = true;
+            return hit;
+        }
+    }
+
+    std::string_view head = detectionHead(rawData);
+    TypeDetection best;
+    if (head.empty()) return best;
+    for (const auto& [type, detector] : detectors_) {
+        if (parsers_.count(type) == 0) continue;
+        float confidence = std::min(detector(head), 1.0f);
+        if (confidence > best.confidence) best = {type, confidence, false};
+    }
+    if (best.confidence < kMinConfidence) return TypeDetection{};
+
+    rememberType(sourcePath, best);
+    return best;
+}
+
+void MetadataExtractor::rememberType(const std::string& sourcePath,
+                                     const TypeDetection& detection) const {
+    if (sourcePath.empty()) return;
+    std::lock_guard<std::mutex> lock(typeCacheMutex_);
+    if (typeCache_.size() >= kMaxCachedTypes) typeCache_.clear();
+    CachedType& path = typeCache_[sourcePath];
+    bool repeat = path.detection.deviceType == detection.deviceType;
+    path = {detection, 1};
+
+    // A directory of mixed types never builds up agreement, so its files
+    // keep their per-path entries instead of thrashing a shared one
+    CachedType& dir = typeCache_[directoryKey(sourcePath)];
+    if (dir.detection.deviceType != detection.deviceType) {
+        dir = {detection, 1};
+    } else if (!repeat) {
+        ++dir.agreed;
+    }
+}
+
+void MetadataExtractor::forgetType(const std::string& sourcePath) const {
+    if (sourcePath.empty()) return;
+    std::lock_guard<std::mutex> lock(typeCacheMutex_);
+    typeCache_.erase(sourcePath);
+    typeCache_.erase(directoryKey(sourcePath));
+}
+
+size_t MetadataExtractor::extractBatch(const std::vector<LogEntry>& logs,
+                                       std::vector<DeviceMetadata>& results,
+                                       unsigned workers) const {
+    results.resize(logs.size());
+    if (logs.empty()) return 0;
+
+    if (workers == 0) workers = std::max(1u, std::thread::hardware_concurrency());
+
+    // Log sizes vary a lot, so workers pull one entry at a time rather than
+    // taking fixed slices
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> parsed{0};
+    auto work = [&] {
+        size_t ok = 0;
+        for (size_t i = next++; i < logs.size(); i = next++) {
+            try {
+                results[i] = extractAny(logs[i].content, logs[i].fullPath);
+            } catch (...) {
+                // A throwing parser must not take the other entries (or,
+                // on a worker thread, the process) down with it
+                results[i] = DeviceMetadata{};
+            }
+            if (results[i].parseSuccessful) ok++;
+        }
+        parsed += ok;
+    };
+
+    if (workers == 1 || logs.size() == 1) {
+        work();
+        return parsed;
+    }
+
+    // The caller is worker 0; the pool supplies the rest and is kept for
+    // the next batch unless a different worker count is asked for
+    std::lock_guard<std::mutex> lock(batchMutex_);
+    if (!pool_ || pool_->threads.size() != workers - 1) {
+        pool_.reset();
+        pool_ = std::make_unique<detail::ParsePool>(workers - 1);
+    }
+    pool_->run(work);
+    return parsed;
+}
+
 void MetadataExtractor::registerParser(const std::string& deviceType, ParserFunction parser) {
     parsers_[deviceType] = std::move(parser);
 }
 
+void MetadataExtractor::registerDetector(const std::string& deviceType,
+                                         DetectorFunction detector) {
+    detectors_[deviceType] = std::move(detector);
+    std::lock_guard<std::mutex> lock(typeCacheMutex_);
+    typeCache_.clear();
+}
+
+DetectorFunction MetadataExtractor::bannerDetector(const std::string& banner) {
+    return [banner](std::string_view head) {
+        return head.substr(0, banner.size()) == banner ? 0.95f : 0.0f;
+    };
+}
+
+DetectorFunction MetadataExtractor::csvHeaderDetector(const std::vector<std::string>& columns) {
+    return [columns](std::string_view head) {
+        std::string_view header = head.substr(0, head.find('\n'));
+        std::vector<std::string_view> names;
+        while (!header.empty()) {
+            size_t comma = header.find(',');
+            std::string_view name = trim(header.substr(0, comma));
+            if (name.size() >= 2 && name.front() == '"' && name.back() == '"') {
+                name = name.substr(1, name.size() - 2);
+            }
+            names.push_back(name);
+            if (comma == std::string_view::npos) break;
+            header.remove_prefix(comma + 1);
+        }
+        if (names.size() < 2 || columns.empty()) return 0.0f;
+
+        size_t found = 0;
+        for (const auto& column : columns) {
+            if (std::find(names.begin(), names.end(), column) != names.end()) found++;
+        }
+        return 0.9f * static_cast<float>(found) / static_cast<float>(columns.size());
+    };
+}
+
 std::vector<std::string> MetadataExtractor::getRegisteredTypes() const {
     std::vector<std::string> types;
     for (const auto& pair : parsers_) {
@@ -45,119 +615,51 @@ DeviceMetadata MetadataExtractor::parseTypeA(const std::string& raw) {
         return m;
     }
 
-    std::istringstream stream(raw);
-    std::string line;
+    // Lines, keys and values are views into raw; only stored values are
+    // copied. Storage grows with the fields found and is trimmed at the end,
+    // since a long log may hold only a few key=value lines
+    std::string_view rest(raw);
     bool foundAnyValid = false;
 
-    while (std::getline(stream, line)) {
+    while (!rest.empty()) {
+        size_t eol = rest.find('\n');
+        std::string_view line = rest.substr(0, eol);
+        rest = eol == std::string_view::npos ? std::string_view() : rest.substr(eol + 1);
         if (line.empty()) continue;
 
         auto eqPos = line.find('=');
-        if (eqPos == std::string::npos || eqPos == 0) continue;
-
-        std::string key = line.substr(0, eqPos);
-        std::string value = line.substr(eqPos + 1);
+        if (eqPos == std::string_view::npos || eqPos == 0) continue;
 
-        // Trim whitespace
-        key.erase(key.find_last_not_of(" \t\r\n") + 1);
-        key.erase(0, key.find_first_not_of(" \t\r\n"));
-        value.erase(value.find_last_not_of(" \t\r\n") + 1);
-        value.erase(0, value.find_first_not_of(" \t\r\n"));
+        std::string_view key = trim(line.substr(0, eqPos));
+        std::string_view value = trim(line.substr(eqPos + 1));
 
         if (key == "device_id") {
-            m.deviceId = value;
+            m.deviceId.assign(value);
         } else if (key == "firmware_version") {
-            m.firmwareVersion = value;
+            m.firmwareVersion.assign(value);
         } else {
-            m.fields[key] = value;
+            m.fields.set(key, value);
         }
         foundAnyValid = true;
     }
 
+    m.fields.shrinkToFit();
     m.parseSuccessful = foundAnyValid && !m.deviceId.empty();
     return m;
 }
 
 DeviceMetadata MetadataExtractor::parseTypeB(const std::string& raw) {
-    // Type B: Simple JSON format (hand-parsed to avoid external dependency)
+    // Type B: JSON (hand-parsed to avoid external dependency). Nested
+    // objects and arrays are flattened into dotted keys: "a.b", "list.0"
     DeviceMetadata m;
 
-    if (raw.empty() || raw[0] != '{') {
+    std::string_view json = trim(raw);
+    if (json.empty() || json.front() != '{' || json.back() != '}') {
         m.parseSuccessful = false;
         return m;
     }
 
-    // Find matching closing brace
-    if (raw.back() != '}') {
-        m.parseSuccessful = false;
-        return m;
-    }
-
-    // Simple JSON key-value parser (flat objects only)
-    std::string content = raw.substr(1, raw.size() - 2);
-
-    auto parseString = [](const std::string& s, size_t& pos) -> std::string {
-        if (pos >= s.size() || s[pos] != '"') return "";
-        pos++; // skip opening quote
-        std::string result;
-        while (pos < s.size() && s[pos] != '"') {
-            if (s[pos] == '\\' && pos + 1 < s.size()) {
-                pos++;
-            }
-            result += s[pos++];
-        }
-        if (pos < s.size()) pos++; // skip closing quote
-        return result;
-    };
-
-    auto parseValue = [](const std::string& s, size_t& pos) -> std::string {
-        if (pos >= s.size()) return "";
-        if (s[pos] == '"') {
-            pos++;
-            std::string result;
-            while (pos < s.size() && s[pos] != '"') {
-                result += s[pos++];
-            }
-            if (pos < s.size()) pos++;
-            return result;
-        }
-        // Number or literal
-        std::string result;
-        while (pos < s.size() && s[pos] != ',' && s[pos] != '}') {
-            result += s[pos++];
-        }
-        return result;
-    };
-
-    size_t pos = 0;
-    bool foundAny = false;
-
-    while (pos < content.size()) {
-        // Skip whitespace and commas
-        while (pos < content.size() && (content[pos] == ' ' || content[pos] == ',' ||
-               content[pos] == '\n' || content[pos] == '\t' || content[pos] == '\r')) {
-            pos++;
-        }
-        if (pos >= content.size()) break;
-
-        std::string key = parseString(content, pos);
-        if (key.empty()) break;
-
-        // Skip colon
-        while (pos < content.size() && (content[pos] == ' ' || content[pos] == ':')) pos++;
-
-        std::string value = parseValue(content, pos);
-
-        if (key == "id") {
-            m.deviceId = value;
-        } else if (key == "fw") {
-            m.firmwareVersion = value;
-        } else {
-            m.fields[key] = value;
-        }
-        foundAny = true;
-    }
-
+    bool foundAny = JsonFlattener(json, m).run();
     m.parseSuccessful = foundAny && !m.deviceId.empty();
     return m;
 }
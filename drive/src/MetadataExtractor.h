@@ -1,37 +1,111 @@
 #pragma once
 
+#include "LogCollector.h"
+#include "MetadataFields.h"
+
 #include <string>
+#include <string_view>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <functional>
+#include <memory>
+#include <mutex>
 
 namespace syncv {
 
+namespace detail { struct ParsePool; }
+
 struct DeviceMetadata {
     std::string deviceId;
     std::string deviceType;
     std::string firmwareVersion;
-    std::map<std::string, std::string> fields;
+    MetadataFields fields;             // everything else the device reported
     bool parseSuccessful = false;
 };
 
 using ParserFunction = std::function<DeviceMetadata(const std::string&)>;
 
+/// Scores how likely `head` (the start of a file, leading whitespace
+/// stripped) is in a device type's format: 0 = no, 1 = certain.
+using DetectorFunction = std::function<float(std::string_view head)>;
+
+/// Result of content sniffing.
+struct TypeDetection {
+    std::string deviceType;        // empty when nothing matched
+    float       confidence = 0;
+    bool        cached = false;    // decided earlier for this path or directory
+};
+
 class MetadataExtractor {
 public:
     MetadataExtractor();
+    ~MetadataExtractor();
 
     /// Extract metadata from raw data using the appropriate parser for deviceType.
     DeviceMetadata extract(const std::string& rawData, const std::string& deviceType);
 
+    /// Extract metadata without a known device type. The type is sniffed
+    /// with detectType(); if that parser fails, every registered parser is
+    /// tried and the first that succeeds wins. Unsuccessful result if none does.
+    DeviceMetadata extractAny(const std::string& rawData,
+                              const std::string& sourcePath = "") const;
+
+    /// Guess the device type from the first bytes of rawData. With a
+    /// sourcePath the decision is cached for that file, and once several
+    /// files in a directory agree, for the directory too, so later files
+    /// from the same place skip detection.
+    TypeDetection detectType(const std::string& rawData,
+                             const std::string& sourcePath = "") const;
+
+    /// Extract metadata for every collected log, spreading entries across
+    /// `workers` threads (0 = one per core). The threads are kept between
+    /// calls. results[i] belongs to logs[i]: `results` is resized, so the
+    /// vector can be kept across collection cycles, and each entry is
+    /// replaced by its parser's result. Parsers run concurrently and must be
+    /// thread-safe; one that throws leaves its entry unsuccessful.
+    /// @return Number of entries parsed successfully.
+    size_t extractBatch(const std::vector<LogEntry>& logs,
+                        std::vector<DeviceMetadata>& results,
+                        unsigned workers = 0) const;
+
     /// Register a custom parser for a device type.
     void registerParser(const std::string& deviceType, ParserFunction parser);
 
+    /// Register a content detector for a device type (replaces any previous one).
+    void registerDetector(const std::string& deviceType, DetectorFunction detector);
+
+    /// Detector for files that start with a fixed vendor banner.
+    static DetectorFunction bannerDetector(const std::string& banner);
+
+    /// Detector for CSV files whose header row names all of `columns`.
+    static DetectorFunction csvHeaderDetector(const std::vector<std::string>& columns);
+
+    /// Detections below this are treated as "unknown".
+    static constexpr float kMinConfidence = 0.5f;
+
     /// Get list of registered device type parsers.
     std::vector<std::string> getRegisteredTypes() const;
 
 private:
     std::map<std::string, ParserFunction> parsers_;
+    std::map<std::string, DetectorFunction> detectors_;
+
+    // Detected type per source path and per directory ("dir/"). A directory
+    // entry is only used once `agreed` files in a row were of its type.
+    struct CachedType {
+        TypeDetection detection;
+        unsigned      agreed = 0;
+    };
+    mutable std::mutex typeCacheMutex_;
+    mutable std::unordered_map<std::string, CachedType> typeCache_;
+
+    // Worker threads for extractBatch(), created on first use
+    mutable std::mutex batchMutex_;
+    mutable std::unique_ptr<detail::ParsePool> pool_;
+
+    void rememberType(const std::string& sourcePath, const TypeDetection& detection) const;
+    void forgetType(const std::string& sourcePath) const;
 
     static DeviceMetadata parseTypeA(const std::string& raw);
     static DeviceMetadata parseTypeB(const std::string& raw);
@@ -0,0 +1,244 @@
+#include "MetadataFields.h"
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+
+namespace syncv {
+
+namespace {
+
+/// Open-addressing hash table over the interned names. Slots hold id + 1
+/// (0 = empty) and are kept at most half full, so probes stay short.
+struct KeyTable {
+    std::shared_mutex       mutex;
+    std::deque<std::string> names;         // deque: names never move once added
+    std::vector<uint32_t>   slots = std::vector<uint32_t>(64, 0);
+
+    /// Slot holding `name`, or the empty slot where it belongs.
+    size_t probe(std::string_view name) const {
+        const size_t mask = slots.size() - 1;
+        size_t i = std::hash<std::string_view>{}(name) & mask;
+        while (slots[i] != 0 && names[slots[i] - 1] != name) i = (i + 1) & mask;
+        return i;
+    }
+
+    void grow() {
+        std::vector<uint32_t> old(slots.size() * 2, 0);
+        old.swap(slots);
+        for (uint32_t id = 0; id < names.size(); id++) {
+            slots[probe(names[id])] = id + 1;
+        }
+    }
+};
+
+KeyTable& keyTable() {
+    static KeyTable table;
+    return table;
+}
+
+/// Home slot of a key id in a MetadataFields index (Fibonacci hashing).
+size_t indexSlot(FieldKeys::Id key, size_t mask) {
+    return (static_cast<size_t>(key) * 0x9E3779B1u) & mask;
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// FieldKeys
+// ---------------------------------------------------------------------------
+
+FieldKeys::Id FieldKeys::intern(std::string_view name) {
+    Id id;
+    if (lookup(name, id)) return id;
+
+    KeyTable& t = keyTable();
+    std::unique_lock<std::shared_mutex> lock(t.mutex);
+    size_t slot = t.probe(name);
+    if (t.slots[slot] != 0) return t.slots[slot] - 1;   // another thread added it
+    if (t.names.size() >= kMaxKeys) return kNoId;
+
+    if ((t.names.size() + 1) * 2 > t.slots.size()) {
+        t.grow();
+        slot = t.probe(name);
+    }
+    t.names.emplace_back(name);
+    t.slots[slot] = static_cast<uint32_t>(t.names.size());
+    return static_cast<Id>(t.names.size() - 1);
+}
+
+bool FieldKeys::lookup(std::string_view name, Id& id) {
+    KeyTable& t = keyTable();
+    std::shared_lock<std::shared_mutex> lock(t.mutex);
+    uint32_t slot = t.slots[t.probe(name)];
+    if (slot == 0) return false;
+    id = slot - 1;
+    return true;
+}
+
+std::string_view FieldKeys::name(Id id) {
+    KeyTable& t = keyTable();
+    std::shared_lock<std::shared_mutex> lock(t.mutex);
+    return id < t.names.size() ? std::string_view(t.names[id]) : std::string_view();
+}
+
+size_t FieldKeys::size() {
+    KeyTable& t = keyTable();
+    std::shared_lock<std::shared_mutex> lock(t.mutex);
+    return t.names.size();
+}
+
+// ---------------------------------------------------------------------------
+// MetadataFields
+// ---------------------------------------------------------------------------
+
+MetadataFields::const_iterator::value_type MetadataFields::const_iterator::operator*() const {
+    const Entry& e = owner_->entries_[pos_];
+    return {owner_->keyOf(e), std::string_view(owner_->values_).substr(e.offset, e.length)};
+}
+
+void MetadataFields::set(std::string_view key, std::string_view value) {
+    FieldKeys::Id id = FieldKeys::intern(key);
+    if (id == FieldKeys::kNoId) {
+        setInline(key, value);
+    } else {
+        set(id, value);
+    }
+}
+
+void MetadataFields::set(FieldKeys::Id key, std::string_view value) {
+    Entry* entry = const_cast<Entry*>(find(key));
+    if (entry && value.size() <= entry->length) {
+        // Replacement fits where the old value was
+        values_.replace(entry->offset, value.size(), value);
+        entry->length = static_cast<uint32_t>(value.size());
+        return;
+    }
+
+    const auto offset = static_cast<uint32_t>(values_.size());
+    values_.append(value);
+    if (entry) {
+        entry->offset = offset;
+        entry->length = static_cast<uint32_t>(value.size());
+    } else {
+        entries_.push_back({key, offset, static_cast<uint32_t>(value.size())});
+        if (entries_.size() * 2 > index_.size()) {
+            if (entries_.size() > kLinearScan) rebuildIndex();
+        } else {
+            addToIndex(static_cast<uint32_t>(entries_.size() - 1));
+        }
+    }
+}
+
+std::string_view MetadataFields::get(std::string_view key) const {
+    FieldKeys::Id id;
+    if (FieldKeys::lookup(key, id)) return get(id);
+    const Entry* entry = findInline(key);
+    if (!entry) return {};
+    return std::string_view(values_).substr(entry->offset, entry->length);
+}
+
+std::string_view MetadataFields::get(FieldKeys::Id key) const {
+    const Entry* entry = find(key);
+    if (!entry) return {};
+    return std::string_view(values_).substr(entry->offset, entry->length);
+}
+
+bool MetadataFields::contains(std::string_view key) const {
+    FieldKeys::Id id;
+    if (FieldKeys::lookup(key, id)) return find(id) != nullptr;
+    return findInline(key) != nullptr;
+}
+
+void MetadataFields::clear() {
+    entries_.clear();
+    values_.clear();
+    index_.clear();
+    inlineKeys_ = 0;
+}
+
+void MetadataFields::reserve(size_t fields, size_t valueBytes) {
+    entries_.reserve(fields);
+    values_.reserve(valueBytes);
+}
+
+void MetadataFields::shrinkToFit() {
+    entries_.shrink_to_fit();
+    values_.shrink_to_fit();
+}
+
+size_t MetadataFields::capacityBytes() const {
+    return entries_.capacity() * sizeof(Entry) + values_.capacity() +
+           index_.capacity() * sizeof(uint32_t);
+}
+
+const MetadataFields::Entry* MetadataFields::find(FieldKeys::Id key) const {
+    if (index_.empty()) {
+        // Most records hold a handful of fields: scanning 12-byte entries beats hashing
+        for (const Entry& e : entries_) {
+            if (e.key == key) return &e;
+        }
+        return nullptr;
+    }
+
+    const size_t mask = index_.size() - 1;
+    for (size_t i = indexSlot(key, mask); index_[i] != 0; i = (i + 1) & mask) {
+        const Entry& e = entries_[index_[i] - 1];
+        if (e.key == key) return &e;
+    }
+    return nullptr;
+}
+
+std::string_view MetadataFields::keyOf(const Entry& e) const {
+    if (!(e.key & kInlineKey)) return FieldKeys::name(e.key);
+    const uint32_t keyLength = e.key & ~kInlineKey;
+    return std::string_view(values_).substr(e.offset - keyLength, keyLength);
+}
+
+const MetadataFields::Entry* MetadataFields::findInline(std::string_view key) const {
+    if (inlineKeys_ == 0) return nullptr;
+    for (const Entry& e : entries_) {
+        if ((e.key & kInlineKey) && keyOf(e) == key) return &e;
+    }
+    return nullptr;
+}
+
+void MetadataFields::setInline(std::string_view key, std::string_view value) {
+    Entry* entry = const_cast<Entry*>(findInline(key));
+    if (entry && value.size() <= entry->length) {
+        values_.replace(entry->offset, value.size(), value);
+        entry->length = static_cast<uint32_t>(value.size());
+        return;
+    }
+
+    // The name goes right before the value, so both move together
+    values_.append(key);
+    const auto offset = static_cast<uint32_t>(values_.size());
+    values_.append(value);
+    if (entry) {
+        entry->offset = offset;
+        entry->length = static_cast<uint32_t>(value.size());
+    } else {
+        entries_.push_back({kInlineKey | static_cast<uint32_t>(key.size()), offset,
+                            static_cast<uint32_t>(value.size())});
+        inlineKeys_++;
+    }
+}
+
+void MetadataFields::addToIndex(uint32_t pos) {
+    if (entries_[pos].key & kInlineKey) return;   // found by name, not by id
+    const size_t mask = index_.size() - 1;
+    size_t i = indexSlot(entries_[pos].key, mask);
+    while (index_[i] != 0) i = (i + 1) & mask;
+    index_[i] = pos + 1;
+}
+
+void MetadataFields::rebuildIndex() {
+    size_t slots = 64;
+    while (slots < entries_.size() * 4) slots *= 2;
+    index_.assign(slots, 0);
+    for (uint32_t pos = 0; pos < entries_.size(); pos++) addToIndex(pos);
+}
+
+} // namespace syncv
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+namespace syncv {
+
+/// Process-wide table of metadata field names. Every distinct key is
+/// stored once and referred to by a small integer id. Thread-safe.
+///
+/// Names are never evicted, so the table stops growing at kMaxKeys: keys
+/// built from data (array indices, serial numbers) cannot grow it for the
+/// life of the process.
+class FieldKeys {
+public:
+    using Id = uint32_t;
+
+    static constexpr size_t kMaxKeys = 4096;
+    static constexpr Id     kNoId    = UINT32_MAX;
+
+    /// Id for `name`, adding it on first use; kNoId once the table is full.
+    static Id intern(std::string_view name);
+
+    /// Id for `name` if it has been interned; never adds.
+    static bool lookup(std::string_view name, Id& id);
+
+    /// The name behind `id`; stays valid for the life of the process.
+    static std::string_view name(Id id);
+
+    /// Number of distinct names interned so far.
+    static size_t size();
+};
+
+/// Metadata fields of one parsed record: (key id, value) pairs in insertion
+/// order, with every value packed into a single buffer. A typical record
+/// costs two allocations however many fields it has, and keys are never
+/// copied. Small records are searched linearly; large ones (big JSON
+/// dumps) get a flat hash index over the key ids. Keys the FieldKeys
+/// table has no room for are kept in the record, just before their value.
+///
+/// Views returned by get() and by iteration point into the value buffer
+/// and are invalidated by the next set() or clear().
+class MetadataFields {
+public:
+    /// Iterates (key, value) pairs in insertion order.
+    class const_iterator {
+    public:
+        using value_type = std::pair<std::string_view, std::string_view>;
+
+        value_type operator*() const;
+        const_iterator& operator++() { ++pos_; return *this; }
+        bool operator==(const const_iterator& o) const { return pos_ == o.pos_; }
+        bool operator!=(const const_iterator& o) const { return pos_ != o.pos_; }
+
+    private:
+        friend class MetadataFields;
+        const_iterator(const MetadataFields* owner, size_t pos) : owner_(owner), pos_(pos) {}
+        const MetadataFields* owner_;
+        size_t pos_;
+    };
+
+    /// Add or replace a field. `key` ids must come from a successful intern().
+    void set(std::string_view key, std::string_view value);
+    void set(FieldKeys::Id key, std::string_view value);
+
+    /// Value of a field, or an empty view if it is not set.
+    std::string_view get(std::string_view key) const;
+    std::string_view get(FieldKeys::Id key) const;
+
+    bool contains(std::string_view key) const;
+    size_t count(std::string_view key) const { return contains(key) ? 1 : 0; }
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+
+    /// Drop every field but keep the storage for the next record.
+    void clear();
+
+    /// Expect about `fields` fields holding `valueBytes` bytes in total.
+    void reserve(size_t fields, size_t valueBytes);
+
+    /// Release spare capacity once a record is complete, so a record kept
+    /// around costs what its fields hold, not what parsing reserved.
+    void shrinkToFit();
+
+    /// Heap bytes held by this record, spare capacity included.
+    size_t capacityBytes() const;
+
+    const_iterator begin() const { return {this, 0}; }
+    const_iterator end() const { return {this, entries_.size()}; }
+
+private:
+    struct Entry {
+        FieldKeys::Id key;                 // or kInlineKey | name length
+        uint32_t      offset;              // into values_
+        uint32_t      length;
+    };
+
+    static constexpr size_t        kLinearScan = 16;   // index records larger than this
+    static constexpr FieldKeys::Id kInlineKey  = 0x80000000u;
+
+    std::vector<Entry>    entries_;
+    std::string           values_;
+    std::vector<uint32_t> index_;                // entry position + 1, 0 = empty
+    size_t                inlineKeys_ = 0;       // entries with kInlineKey
+
+    std::string_view keyOf(const Entry& e) const;
+    const Entry* find(FieldKeys::Id key) const;
+    const Entry* findInline(std::string_view key) const;
+    void setInline(std::string_view key, std::string_view value);
+    void addToIndex(uint32_t pos);
+    void rebuildIndex();
+};
+
+} // namespace syncv
@@ -1,14 +1,293 @@
 #include "TransferManager.h"
+#include "HashVerifier.h"
 #include <filesystem>
 #include <fstream>
 #include <chrono>
 #include <thread>
 #include <cstring>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+#include <cerrno>
+#include <cctype>
+#include <array>
+#include <mutex>
+#include <condition_variable>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace fs = std::filesystem;
 
 namespace syncv {
 
+namespace {
+
+// Adaptive chunking: chunks per measurement window, minimum relative gain that
+// counts as an improvement, and a latency ceiling that forces a shrink so
+// progress callbacks and journal checkpoints stay responsive.
+constexpr int    kAdaptWindowChunks   = 8;
+constexpr double kAdaptMinGain        = 1.05;
+constexpr double kAdaptMaxChunkSecs   = 0.25;
+
+constexpr uint64_t kFnvOffset = 0xcbf29ce484222325ULL;
+constexpr uint64_t kFnvPrime  = 0x100000001b3ULL;
+
+uint64_t fnv1a(uint64_t h, const char* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        h ^= static_cast<uint8_t>(data[i]);
+        h *= kFnvPrime;
+    }
+    return h;
+}
+
+/// Splits a byte stream into fixed-size blocks and emits one digest per
+/// completed block, independent of how the stream is chunked for I/O.
+class BlockDigester {
+public:
+    explicit BlockDigester(size_t blockSize) : blockSize_(blockSize) {}
+
+    void update(const char* data, size_t len, std::vector<uint64_t>& out) {
+        while (len > 0) {
+            size_t take = std::min(len, blockSize_ - filled_);
+            state_ = fnv1a(state_, data, take);
+            filled_ += take;
+            data += take;
+            len -= take;
+            if (filled_ == blockSize_) {
+                out.push_back(state_);
+                state_ = kFnvOffset;
+                filled_ = 0;
+            }
+        }
+    }
+
+    /// Feed `len` zero bytes without materializing them. FNV-1a over a zero
+    /// byte is just a multiply, so a run of n zeros is a multiply by P^n.
+    void updateZeros(uint64_t len, std::vector<uint64_t>& out) {
+        while (len > 0) {
+            size_t take = static_cast<size_t>(std::min<uint64_t>(len, blockSize_ - filled_));
+            state_ *= power(kFnvPrime, take);
+            filled_ += take;
+            len -= take;
+            if (filled_ == blockSize_) {
+                out.push_back(state_);
+                state_ = kFnvOffset;
+                filled_ = 0;
+            }
+        }
+    }
+
+private:
+    static uint64_t power(uint64_t base, uint64_t exp) {
+        uint64_t result = 1;
+        while (exp > 0) {
+            if (exp & 1) result *= base;
+            base *= base;
+            exp >>= 1;
+        }
+        return result;
+    }
+
+    size_t blockSize_;
+    size_t filled_ = 0;
+    uint64_t state_ = kFnvOffset;
+};
+
+/// rsync's weak checksum: two 16-bit running sums that can be rolled forward
+/// one byte at a time in O(1).
+struct RollingChecksum {
+    uint32_t a = 0;
+    uint32_t b = 0;
+
+    void init(const char* data, size_t len) {
+        a = b = 0;
+        for (size_t i = 0; i < len; i++) {
+            uint32_t x = static_cast<uint8_t>(data[i]);
+            a += x;
+            b += static_cast<uint32_t>(len - i) * x;
+        }
+    }
+
+    void roll(char out, char in, size_t len) {
+        uint32_t xo = static_cast<uint8_t>(out);
+        uint32_t xi = static_cast<uint8_t>(in);
+        a = a - xo + xi;
+        b = b - static_cast<uint32_t>(len) * xo + a;
+    }
+
+    uint32_t value() const { return (a & 0xffff) | ((b & 0xffff) << 16); }
+};
+
+bool hashesEqual(const std::string& a, const std::string& b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return std::tolower(static_cast<unsigned char>(x)) ==
+                      std::tolower(static_cast<unsigned char>(y));
+           });
+}
+
+bool isZeroBlock(const char* data, size_t len) {
+    return len > 0 && data[0] == 0 && std::memcmp(data, data + 1, len - 1) == 0;
+}
+
+/// Walks the source's data extents with SEEK_DATA/SEEK_HOLE. Where that isn't
+/// available everything is reported as data and zero-block detection in the
+/// copy loop still turns runs of zeros into holes.
+class ExtentCursor {
+public:
+    ExtentCursor(const std::string& path, uint64_t size) : size_(size) {
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+        if (!path.empty()) fd_ = ::open(path.c_str(), O_RDONLY);
+#else
+        (void)path;
+#endif
+    }
+
+    ~ExtentCursor() {
+#ifndef _WIN32
+        if (fd_ >= 0) ::close(fd_);
+#endif
+    }
+
+    ExtentCursor(const ExtentCursor&) = delete;
+    ExtentCursor& operator=(const ExtentCursor&) = delete;
+
+    /// Start of the first data byte at or after pos (size if none), and the
+    /// end of that data extent in dataEnd.
+    uint64_t nextData(uint64_t pos, uint64_t& dataEnd) {
+        if (pos >= cachedStart_ && pos < cachedEnd_) {
+            dataEnd = cachedEnd_;
+            return pos;
+        }
+        dataEnd = size_;
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+        if (fd_ < 0) return pos;
+        off_t data = ::lseek(fd_, static_cast<off_t>(pos), SEEK_DATA);
+        if (data < 0) {
+            // ENXIO: only a hole remains. Anything else: no extent support.
+            return errno == ENXIO ? size_ : pos;
+        }
+        off_t hole = ::lseek(fd_, data, SEEK_HOLE);
+        cachedStart_ = static_cast<uint64_t>(data);
+        cachedEnd_ = hole < 0 ? size_ : std::min(static_cast<uint64_t>(hole), size_);
+        dataEnd = cachedEnd_;
+        return cachedStart_;
+#else
+        return pos;
+#endif
+    }
+
+private:
+    uint64_t size_;
+    uint64_t cachedStart_ = 0;
+    uint64_t cachedEnd_ = 0;
+    int fd_ = -1;
+};
+
+uint64_t elapsedNs(std::chrono::steady_clock::time_point from,
+                   std::chrono::steady_clock::time_point to) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+}
+
+constexpr const char* kPartSuffix = ".syncv-part";
+
+/// fsync a file or directory by path.
+bool syncPath(const std::string& path, bool directory) {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), directory ? (O_RDONLY | O_DIRECTORY) : O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#else
+    (void)path;
+    (void)directory;
+    return true;  // no portable directory sync; NTFS journals renames itself
+#endif
+}
+
+/// Make the data of every file in `paths` durable with as few syncs as
+/// possible: one syncfs() per filesystem on Linux, per-file fsync elsewhere.
+/// Returns the number of sync calls issued, or -1 on failure.
+int syncFilesGrouped(const std::vector<std::string>& paths) {
+    int calls = 0;
+#ifdef __linux__
+    std::set<dev_t> synced;
+    for (const auto& path : paths) {
+        struct stat st {};
+        if (::stat(path.c_str(), &st) != 0) return -1;
+        if (!synced.insert(st.st_dev).second) continue;
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return -1;
+        bool ok = ::syncfs(fd) == 0;
+        ::close(fd);
+        if (!ok) return -1;
+        calls++;
+    }
+#else
+    for (const auto& path : paths) {
+        if (!syncPath(path, false)) return -1;
+        calls++;
+    }
+#endif
+    return calls;
+}
+
+std::string parentDir(const std::string& path) {
+    auto parent = fs::path(path).parent_path();
+    return parent.empty() ? std::string(".") : parent.string();
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// TransferTelemetry
+// ---------------------------------------------------------------------------
+
+void TransferTelemetry::recordChunk(uint64_t ns) {
+    chunks++;
+    maxChunkNs = std::max(maxChunkNs, ns);
+    latencyHistogram[latency::bucketOf(ns, kBuckets)]++;
+}
+
+uint64_t TransferTelemetry::percentileNs(double p) const {
+    return latency::percentile(latencyHistogram, chunks, maxChunkNs, p);
+}
+
+double TransferTelemetry::bytesPerSecond() const {
+    return totalNs > 0 ? static_cast<double>(bytes) * 1e9 / static_cast<double>(totalNs) : 0.0;
+}
+
+void TransferTelemetry::merge(const TransferTelemetry& other) {
+    transfers += other.transfers;
+    bytes += other.bytes;
+    chunks += other.chunks;
+    totalNs += other.totalNs;
+    readNs += other.readNs;
+    writeNs += other.writeNs;
+    checkpointNs += other.checkpointNs;
+    syncNs += other.syncNs;
+    syncs += other.syncs;
+    holeBytes += other.holeBytes;
+    maxChunkNs = std::max(maxChunkNs, other.maxChunkNs);
+    stalls += other.stalls;
+    stalledNs += other.stalledNs;
+    for (size_t i = 0; i < kBuckets; i++) {
+        latencyHistogram[i] += other.latencyHistogram[i];
+    }
+}
+
+// ---------------------------------------------------------------------------
+// TransferManager
+// ---------------------------------------------------------------------------
+
 TransferManager::TransferManager() {}
 
 TransferResult TransferManager::transfer(const std::string& srcPath,
@@ -16,10 +295,26 @@ TransferResult TransferManager::transfer(const std::string& srcPath,
     return transferWithOffset(srcPath, dstPath, 0);
 }
 
+TransferResult TransferManager::transferVerified(const std::string& srcPath,
+                                                  const std::string& dstPath,
+                                                  const std::string& expectedSha256) {
+    static const std::string none;
+    return transferWithOffset(srcPath, dstPath, 0, false,
+                              expectedSha256.empty() ? &none : &expectedSha256);
+}
+
+std::string TransferManager::writePathFor(const std::string& dstPath) const {
+    return atomicCommit_ ? dstPath + kPartSuffix : dstPath;
+}
+
 TransferResult TransferManager::transferWithOffset(const std::string& srcPath,
                                                      const std::string& dstPath,
-                                                     uint64_t offset) {
+                                                     uint64_t offset,
+                                                     bool deferCommit,
+                                                     const std::string* expectedHash) {
     TransferResult result;
+    const std::string writePath = writePathFor(dstPath);
+    const bool hashing = hashTransfers_ || expectedHash != nullptr;
 
     if (!fs::exists(srcPath)) {
         result.success = false;
@@ -36,17 +331,36 @@ TransferResult TransferManager::transferWithOffset(const std::string& srcPath,
         return result;
     }
 
+    // Never trust the offset beyond what the destination actually holds, and
+    // drop anything written after the last checkpoint so appending can't
+    // duplicate bytes. A stale (conservative) journal is therefore always safe.
+    if (offset > 0) {
+        std::error_code ec;
+        uint64_t dstSize = fs::exists(writePath, ec)
+            ? static_cast<uint64_t>(fs::file_size(writePath, ec)) : 0;
+        if (ec) dstSize = 0;
+        if (dstSize < offset) {
+            offset = dstSize;
+        } else if (dstSize > offset) {
+            fs::resize_file(writePath, offset, ec);
+            if (ec) offset = 0;
+        }
+        if (offset > totalSize) offset = 0;
+    }
+
     // Seek to offset for resume
     if (offset > 0) {
         src.seekg(static_cast<std::streamoff>(offset));
     }
 
-    // Open destination in append mode for resume, or write mode for fresh transfer
+    // Open destination positioned at the offset for resume (not append mode,
+    // so sparse copies can seek over holes), or truncate for a fresh transfer
     std::ofstream dst;
     if (offset > 0) {
-        dst.open(dstPath, std::ios::binary | std::ios::app);
+        dst.open(writePath, std::ios::binary | std::ios::in | std::ios::out);
+        dst.seekp(static_cast<std::streamoff>(offset));
     } else {
-        dst.open(dstPath, std::ios::binary);
+        dst.open(writePath, std::ios::binary);
     }
 
     if (!dst.is_open()) {
@@ -55,59 +369,689 @@ TransferResult TransferManager::transferWithOffset(const std::string& srcPath,
         return result;
     }
 
+    // Block digests are only tracked while the stream position lines up with
+    // the digests already on record; otherwise the journal falls back to a
+    // plain (clamped) offset for this transfer.
+    bool trackBlocks = false;
+    if (!journalPath_.empty()) {
+        auto it = partialTransfers_.find(srcPath);
+        if (offset == 0) {
+            if (it != partialTransfers_.end()) it->second.blockDigests.clear();
+            std::error_code ec;
+            fs::remove(blockFilePath(srcPath), ec);
+            trackBlocks = true;
+        } else if (it != partialTransfers_.end() &&
+                   it->second.blockSize == verifyBlockSize_ &&
+                   offset == it->second.blockDigests.size() * verifyBlockSize_) {
+            trackBlocks = true;
+        }
+    }
+    BlockDigester digester(verifyBlockSize_);
+    std::vector<uint64_t> newDigests;
+
+    result.resumedFrom = offset;
     auto startTime = std::chrono::steady_clock::now();
     uint64_t bytesWritten = offset;
     std::vector<char> buffer(chunkSize_);
+    TransferTelemetry& tm = result.telemetry;
+    tm.transfers = 1;
 
-    while (src.read(buffer.data(), static_cast<std::streamsize>(chunkSize_)) || src.gcount() > 0) {
-        auto bytesRead = src.gcount();
-        dst.write(buffer.data(), bytesRead);
+    // Every exit from here on folds its telemetry into the manager aggregate
+    auto finish = [&](bool success, const char* error) {
+        tm.totalNs = elapsedNs(startTime, std::chrono::steady_clock::now());
+        tm.bytes = bytesWritten - offset;
+        telemetry_.merge(tm);
+        result.success = success;
+        if (error) result.errorMessage = error;
+        if (!success && atomicCommit_ && journalPath_.empty()) {
+            // Nothing could resume from a staged file without a journal
+            dst.close();
+            std::error_code ec;
+            fs::remove(writePath, ec);
+        }
+        result.bytesTransferred = bytesWritten;
+        return result;
+    };
 
-        if (!dst.good()) {
-            result.success = false;
-            result.errorMessage = "Write error during transfer";
-            return result;
+    ExtentCursor extents(sparseCopy_ ? srcPath : std::string(), totalSize);
+
+    // Fused hashing: the digest covers the whole file, so a resume first
+    // folds in the prefix that was copied earlier.
+    HashVerifier hasher;
+    if (hashing) {
+        hasher.begin();
+        if (offset > 0) {
+            std::ifstream prefix(srcPath, std::ios::binary);
+            uint64_t remaining = offset;
+            while (remaining > 0 && prefix.read(buffer.data(), static_cast<std::streamsize>(
+                       std::min<uint64_t>(remaining, buffer.size())))) {
+                hasher.update(buffer.data(), static_cast<size_t>(prefix.gcount()));
+                remaining -= static_cast<uint64_t>(prefix.gcount());
+            }
+        }
+    }
+
+    // Checkpoints are throttled; digests of the blocks since the last one
+    // wait in newDigests
+    uint64_t checkpointedBytes = offset;
+    auto checkpointedAt = startTime;
+    auto saveProgress = [&]() {
+        dst.flush();
+        checkpoint(srcPath, dstPath, bytesWritten, trackBlocks ? &newDigests : nullptr);
+        newDigests.clear();
+        checkpointedBytes = bytesWritten;
+        checkpointedAt = std::chrono::steady_clock::now();
+    };
+
+    for (;;) {
+        if (abortCheck_ && abortCheck_()) {
+            // Keep what was copied so the transfer can be resumed
+            if (!journalPath_.empty() && bytesWritten > checkpointedBytes) saveProgress();
+            return finish(false, "Transfer aborted");
+        }
+        // Sparse copies stop at the size seen at start; images don't grow
+        if (sparseCopy_ && bytesWritten >= totalSize) break;
+
+        auto chunkStart = std::chrono::steady_clock::now();
+        size_t thisChunk = chunkSize_;
+        if (buffer.size() < thisChunk) buffer.resize(thisChunk);
+
+        uint64_t holeLen = 0;
+        if (sparseCopy_) {
+            uint64_t dataEnd = totalSize;
+            uint64_t dataStart = extents.nextData(bytesWritten, dataEnd);
+            if (dataStart > bytesWritten) {
+                holeLen = dataStart - bytesWritten;
+            } else if (dataEnd > bytesWritten) {
+                thisChunk = static_cast<size_t>(std::min<uint64_t>(thisChunk, dataEnd - bytesWritten));
+            }
+        }
+
+        std::chrono::steady_clock::time_point writeDone;
+        if (holeLen > 0) {
+            // Source hole: nothing to read or write, dst keeps the gap as a hole
+            bytesWritten += holeLen;
+            tm.holeBytes += holeLen;
+            src.seekg(static_cast<std::streamoff>(bytesWritten));
+            dst.seekp(static_cast<std::streamoff>(bytesWritten));
+            if (trackBlocks) digester.updateZeros(holeLen, newDigests);
+            if (hashing) {
+                std::fill(buffer.begin(), buffer.end(), 0);
+                for (uint64_t left = holeLen; left > 0;) {
+                    size_t n = static_cast<size_t>(std::min<uint64_t>(left, buffer.size()));
+                    hasher.update(buffer.data(), n);
+                    left -= n;
+                }
+            }
+        } else {
+            bool gotData = src.read(buffer.data(), static_cast<std::streamsize>(thisChunk)) ||
+                           src.gcount() > 0;
+            auto readDone = std::chrono::steady_clock::now();
+            tm.readNs += elapsedNs(chunkStart, readDone);
+            if (!gotData) break;
+
+            auto bytesRead = src.gcount();
+            if (hashing) hasher.update(buffer.data(), static_cast<size_t>(bytesRead));
+            if (sparseCopy_ && isZeroBlock(buffer.data(), static_cast<size_t>(bytesRead))) {
+                // Allocated zeros (e.g. a dd-created image) become a hole too
+                dst.seekp(static_cast<std::streamoff>(bytesWritten + bytesRead));
+                tm.holeBytes += static_cast<uint64_t>(bytesRead);
+            } else {
+                dst.write(buffer.data(), bytesRead);
+            }
+            writeDone = std::chrono::steady_clock::now();
+            tm.writeNs += elapsedNs(readDone, writeDone);
+
+            if (!dst.good()) {
+                return finish(false, "Write error during transfer");
+            }
+
+            if (adaptive_.enabled && static_cast<size_t>(bytesRead) == thisChunk) {
+                std::chrono::duration<double> elapsed = writeDone - chunkStart;
+                adaptChunkSize(static_cast<uint64_t>(bytesRead), elapsed.count());
+            }
+
+            bytesWritten += static_cast<uint64_t>(bytesRead);
+            if (trackBlocks) {
+                digester.update(buffer.data(), static_cast<size_t>(bytesRead), newDigests);
+            }
         }
 
-        bytesWritten += static_cast<uint64_t>(bytesRead);
+        if (!journalPath_.empty() &&
+            (bytesWritten - checkpointedBytes >= checkpointBytes_ ||
+             elapsedNs(checkpointedAt, std::chrono::steady_clock::now()) >= checkpointNs_)) {
+            saveProgress();
+        }
+
+        if (holeLen == 0) {
+            auto chunkDone = std::chrono::steady_clock::now();
+            tm.checkpointNs += elapsedNs(writeDone, chunkDone);
+            uint64_t chunkNs = elapsedNs(chunkStart, chunkDone);
+            tm.recordChunk(chunkNs);
+            if (chunkNs > stallThresholdNs_) {
+                tm.stalls++;
+                tm.stalledNs += chunkNs;
+            }
+        }
 
         if (progressCallback_ && totalSize > 0) {
             float progress = (static_cast<float>(bytesWritten) / static_cast<float>(totalSize)) * 100.0f;
             progressCallback_(progress);
         }
 
-        if (src.eof()) break;
+        if (holeLen == 0 && src.eof()) break;
     }
 
-    auto endTime = std::chrono::steady_clock::now();
-    auto durationMs = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
+    dst.close();
+    if (dst.fail()) {
+        return finish(false, "Write error during transfer");
+    }
+    if (sparseCopy_) {
+        // A trailing hole was only seeked over; extend dst to its full size
+        std::error_code ec;
+        if (static_cast<uint64_t>(fs::file_size(writePath, ec)) < bytesWritten && !ec) {
+            fs::resize_file(writePath, bytesWritten, ec);
+        }
+        if (ec) {
+            return finish(false, "Failed to size sparse destination");
+        }
+    }
 
-    result.success = true;
-    result.bytesTransferred = bytesWritten;
-    result.bytesPerSecond = durationMs > 0
-        ? (static_cast<double>(bytesWritten) / (static_cast<double>(durationMs) / 1000.0))
-        : static_cast<double>(bytesWritten);
+    if (hashing) {
+        result.sha256 = hasher.finish();
+        if (expectedHash && !expectedHash->empty() &&
+            !hashesEqual(result.sha256, *expectedHash)) {
+            // Never leave (or commit) data that failed verification
+            std::error_code ec;
+            fs::remove(writePath, ec);
+            clearCheckpoint(srcPath);
+            return finish(false, "Hash mismatch");
+        }
+    }
+
+    if (atomicCommit_ && !deferCommit) {
+        // data → rename → directory entry, each durable before the next step
+        auto syncStart = std::chrono::steady_clock::now();
+        std::error_code ec;
+        if (!syncPath(writePath, false)) {
+            return finish(false, "Failed to sync destination");
+        }
+        fs::rename(writePath, dstPath, ec);
+        if (ec) {
+            return finish(false, "Failed to commit destination");
+        }
+        syncPath(parentDir(dstPath), true);
+        tm.syncs += 2;
+        tm.syncNs += elapsedNs(syncStart, std::chrono::steady_clock::now());
+    }
+    if (!deferCommit) {
+        clearCheckpoint(srcPath);
+    }
+
+    result.chunkSize = chunkSize_;
+    finish(true, nullptr);
+    result.bytesPerSecond = tm.bytesPerSecond();
+    return result;
+}
+
+TransferResult TransferManager::transferDelta(const std::string& srcPath,
+                                              const std::string& dstPath) {
+    std::error_code ec;
+    if (atomicCommit_ || !fs::exists(srcPath, ec) || !fs::is_regular_file(dstPath, ec)) {
+        return transfer(srcPath, dstPath);
+    }
+
+    TransferResult result;
+    TransferTelemetry& tm = result.telemetry;
+    tm.transfers = 1;
+    auto startTime = std::chrono::steady_clock::now();
+    const uint64_t srcSize = static_cast<uint64_t>(fs::file_size(srcPath));
+    const size_t B = deltaBlockSize_;
+
+    // 1. Signature of the destination: weak checksum → candidate blocks,
+    //    strong hash per block to confirm a weak hit
+    std::unordered_map<uint32_t, std::vector<uint32_t>> index;
+    std::vector<uint64_t> strong;
+    {
+        std::ifstream old(dstPath, std::ios::binary);
+        std::vector<char> block(B);
+        RollingChecksum sum;
+        while (old.read(block.data(), static_cast<std::streamsize>(B))) {
+            sum.init(block.data(), B);
+            index[sum.value()].push_back(static_cast<uint32_t>(strong.size()));
+            strong.push_back(fnv1a(kFnvOffset, block.data(), B));
+        }
+    }
+
+    std::ifstream src(srcPath, std::ios::binary);
+    std::ofstream out(dstPath, std::ios::binary | std::ios::in | std::ios::out);
+    if (!src.is_open() || !out.is_open()) {
+        result.errorMessage = "Cannot open files for delta transfer";
+        return result;
+    }
+
+    // 2. Roll the source over the index. Output offsets equal source offsets,
+    //    so a block that matches at its own offset needs no write at all.
+    //    Shifted matches are written from the source bytes already in hand;
+    //    reading them back from the old copy wouldn't save a single write.
+    std::vector<char> buf;
+    size_t pos = 0;           // window start within buf
+    uint64_t base = 0;        // absolute offset of buf[0]
+    uint64_t literalStart = 0;
+    uint64_t written = 0;
+    uint64_t hashed = 0;
+    bool srcEof = false;
+    HashVerifier hasher;
+    hasher.begin();
+
+    auto writeRange = [&](uint64_t at, const char* data, size_t len) {
+        auto writeStart = std::chrono::steady_clock::now();
+        out.seekp(static_cast<std::streamoff>(at));
+        out.write(data, static_cast<std::streamsize>(len));
+        tm.writeNs += elapsedNs(writeStart, std::chrono::steady_clock::now());
+        written += len;
+    };
+    auto flushLiteral = [&] {
+        uint64_t end = base + pos;
+        if (end > literalStart) {
+            writeRange(literalStart, buf.data() + (literalStart - base),
+                       static_cast<size_t>(end - literalStart));
+            literalStart = end;
+        }
+    };
+    // Keep at least B+1 bytes ahead of the window so it can roll
+    auto refill = [&] {
+        if (buf.size() - pos > B || srcEof) return;
+        if (base + pos - literalStart >= chunkSize_) flushLiteral();
+        size_t keep = static_cast<size_t>(literalStart - base);
+        buf.erase(buf.begin(), buf.begin() + static_cast<std::ptrdiff_t>(keep));
+        base += keep;
+        pos -= keep;
+        size_t old = buf.size();
+        size_t want = std::max(chunkSize_, B + 1);
+        buf.resize(old + want);
+        auto readStart = std::chrono::steady_clock::now();
+        src.read(buf.data() + old, static_cast<std::streamsize>(want));
+        tm.readNs += elapsedNs(readStart, std::chrono::steady_clock::now());
+        buf.resize(old + static_cast<size_t>(src.gcount()));
+        if (static_cast<size_t>(src.gcount()) < want) srcEof = true;
+        // Source bytes arrive in order exactly once: hash them here
+        hasher.update(buf.data() + old, buf.size() - old);
+        hashed += buf.size() - old;
+        if (progressCallback_ && srcSize > 0) {
+            progressCallback_(static_cast<float>(base + pos) / static_cast<float>(srcSize) * 100.0f);
+        }
+    };
 
+    RollingChecksum sum;
+    bool haveSum = false;
+    for (;;) {
+        if (abortCheck_ && abortCheck_()) {
+            // Leave dst as the source's prefix followed by the old tail: a
+            // later delta pass re-matches the prefix without writing it
+            flushLiteral();
+            out.close();
+            tm.totalNs = elapsedNs(startTime, std::chrono::steady_clock::now());
+            tm.bytes = written;
+            telemetry_.merge(tm);
+            result.bytesTransferred = out.fail() ? 0 : base + pos;
+            result.errorMessage = "Transfer aborted";
+            return result;
+        }
+        refill();
+        size_t avail = buf.size() - pos;
+        if (avail < B) break;
+        if (!haveSum) {
+            sum.init(buf.data() + pos, B);
+            haveSum = true;
+        }
+
+        long match = -1;
+        auto it = index.find(sum.value());
+        if (it != index.end()) {
+            uint64_t digest = fnv1a(kFnvOffset, buf.data() + pos, B);
+            uint64_t aligned = (base + pos) / B;
+            for (uint32_t j : it->second) {
+                if (strong[j] != digest) continue;
+                match = static_cast<long>(j);
+                if (j == aligned) break;  // prefer the match that needs no write
+            }
+        }
+
+        if (match >= 0) {
+            flushLiteral();
+            uint64_t at = base + pos;
+            if (static_cast<uint64_t>(match) * B == at) {
+                result.bytesSkipped += B;
+            } else {
+                writeRange(at, buf.data() + pos, B);
+            }
+            pos += B;
+            literalStart = base + pos;
+            haveSum = false;
+        } else if (avail > B) {
+            sum.roll(buf[pos], buf[pos + B], B);
+            pos++;
+        } else {
+            break;  // last partial window at EOF
+        }
+    }
+    pos = buf.size();
+    flushLiteral();
+    out.close();
+    if (out.fail()) {
+        result.errorMessage = "Write error during delta transfer";
+        return result;
+    }
+    if (static_cast<uint64_t>(fs::file_size(dstPath, ec)) != srcSize) {
+        fs::resize_file(dstPath, srcSize, ec);
+    }
+
+    // 3. End-to-end check against the source hash taken while rolling.
+    //    Untouched blocks were only matched by a 64-bit hash, so dst is read
+    //    once unless verification is off. Anything off, including a source
+    //    that changed size under us, is repaired with a full copy.
+    result.sha256 = hasher.finish();
+    if (ec || hashed != srcSize ||
+        (deltaVerify_ && !hashesEqual(HashVerifier().hashFile(dstPath), result.sha256))) {
+        return transfer(srcPath, dstPath);
+    }
+
+    tm.totalNs = elapsedNs(startTime, std::chrono::steady_clock::now());
+    tm.bytes = written;
+    telemetry_.merge(tm);
+    result.success = true;
+    result.chunkSize = chunkSize_;
+    result.bytesTransferred = srcSize;
+    result.bytesPerSecond = tm.totalNs > 0
+        ? static_cast<double>(srcSize) * 1e9 / static_cast<double>(tm.totalNs) : 0.0;
     return result;
 }
 
 std::vector<TransferResult> TransferManager::transferBatch(
     const std::vector<std::pair<std::string, std::string>>& files) {
     std::vector<TransferResult> results;
-    for (const auto& pair : files) {
-        results.push_back(transfer(pair.first, pair.second));
+    if (!atomicCommit_) {
+        for (const auto& pair : files) {
+            results.push_back(transfer(pair.first, pair.second));
+        }
+        return results;
     }
+
+    // Group commit: stage everything, then pay for durability once
+    std::vector<size_t> staged;
+    std::vector<std::string> stagedPaths;
+    for (size_t i = 0; i < files.size(); i++) {
+        results.push_back(transferWithOffset(files[i].first, files[i].second, 0, true));
+        if (results.back().success) {
+            staged.push_back(i);
+            stagedPaths.push_back(writePathFor(files[i].second));
+        }
+    }
+    if (staged.empty()) return results;
+
+    auto syncStart = std::chrono::steady_clock::now();
+    TransferTelemetry commit;
+    int dataSyncs = syncFilesGrouped(stagedPaths);
+    std::set<std::string> dirs;
+    for (size_t i : staged) {
+        std::error_code ec;
+        const std::string writePath = writePathFor(files[i].second);
+        if (dataSyncs >= 0) fs::rename(writePath, files[i].second, ec);
+        if (dataSyncs < 0 || ec) {
+            // Staged data of unknown durability is not worth resuming from
+            results[i].success = false;
+            results[i].errorMessage = dataSyncs < 0 ? "Failed to sync destination"
+                                                    : "Failed to commit destination";
+            fs::remove(writePath, ec);
+        } else {
+            dirs.insert(parentDir(files[i].second));
+        }
+        clearCheckpoint(files[i].first);
+    }
+    for (const auto& dir : dirs) {
+        syncPath(dir, true);
+        commit.syncs++;
+    }
+    if (dataSyncs > 0) commit.syncs += static_cast<uint64_t>(dataSyncs);
+    commit.syncNs = elapsedNs(syncStart, std::chrono::steady_clock::now());
+    telemetry_.merge(commit);
+    return results;
+}
+
+std::vector<TransferResult> TransferManager::transferFanOut(
+    const std::string& srcPath, const std::vector<std::string>& dstPaths) {
+    std::vector<TransferResult> results(dstPaths.size());
+    auto failAll = [&](const std::string& message) {
+        for (auto& r : results) {
+            r.success = false;
+            r.errorMessage = message;
+        }
+        return results;
+    };
+    if (dstPaths.empty()) return results;
+    if (!fs::exists(srcPath)) {
+        return failAll("Source file not found: " + srcPath);
+    }
+    const uint64_t totalSize = static_cast<uint64_t>(fs::file_size(srcPath));
+    std::ifstream src(srcPath, std::ios::binary);
+    if (!src.is_open()) {
+        return failAll("Cannot open source file");
+    }
+
+    struct Sink {
+        std::string writePath;
+        std::ofstream out;
+        const char* error = nullptr;    // set once; the sink is then skipped
+        uint64_t written = 0;
+        uint64_t writeNs = 0;
+        uint64_t consumed = 0;          // chunks processed, guarded by mutex
+    };
+    std::vector<Sink> sinks(dstPaths.size());
+    size_t live = 0;
+    for (size_t i = 0; i < dstPaths.size(); i++) {
+        sinks[i].writePath = writePathFor(dstPaths[i]);
+        sinks[i].out.open(sinks[i].writePath, std::ios::binary);
+        if (sinks[i].out.is_open()) {
+            live++;
+        } else {
+            sinks[i].error = "Cannot open destination file";
+        }
+    }
+
+    // Two slots: the reader fills one while the writers drain the other
+    struct Slot {
+        std::vector<char> data;
+        size_t len = 0;
+        bool zero = false;
+    };
+    std::array<Slot, 2> slots;
+    std::mutex mutex;
+    std::condition_variable produced;
+    std::condition_variable consumed;
+    uint64_t published = 0;
+    bool done = false;
+
+    auto writer = [&](Sink& sink) {
+        for (uint64_t k = 0;; k++) {
+            const Slot* slot;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                produced.wait(lock, [&] { return published > k || done; });
+                if (published <= k) return;
+                slot = &slots[k % slots.size()];
+            }
+            const char* error = sink.error;
+            if (!error) {
+                auto t0 = std::chrono::steady_clock::now();
+                if (sparseCopy_ && slot->zero) {
+                    sink.out.seekp(static_cast<std::streamoff>(sink.written + slot->len));
+                } else {
+                    sink.out.write(slot->data.data(), static_cast<std::streamsize>(slot->len));
+                }
+                sink.writeNs += elapsedNs(t0, std::chrono::steady_clock::now());
+                if (sink.out.good()) {
+                    sink.written += slot->len;
+                } else {
+                    error = "Write error during transfer";
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (error && !sink.error) {
+                    sink.error = error;
+                    live--;
+                }
+                sink.consumed = k + 1;
+            }
+            consumed.notify_all();
+        }
+    };
+
+    TransferTelemetry tm;
+    auto startTime = std::chrono::steady_clock::now();
+    HashVerifier hasher;
+    if (hashTransfers_) hasher.begin();
+
+    std::vector<std::thread> writers;
+    writers.reserve(sinks.size());
+    for (auto& sink : sinks) {
+        writers.emplace_back(writer, std::ref(sink));
+    }
+
+    const char* readError = nullptr;
+    uint64_t bytesRead = 0;
+    for (uint64_t k = 0;; k++) {
+        if (abortCheck_ && abortCheck_()) {
+            readError = "Transfer aborted";
+            break;
+        }
+        auto chunkStart = std::chrono::steady_clock::now();
+        Slot& slot = slots[k % slots.size()];
+        {
+            // Wait until every writer has finished with this slot's last chunk
+            std::unique_lock<std::mutex> lock(mutex);
+            consumed.wait(lock, [&] {
+                return std::all_of(sinks.begin(), sinks.end(), [&](const Sink& s) {
+                    return s.consumed + slots.size() > k;
+                });
+            });
+            if (live == 0) break;
+        }
+
+        if (slot.data.size() < chunkSize_) slot.data.resize(chunkSize_);
+        auto readStart = std::chrono::steady_clock::now();
+        src.read(slot.data.data(), static_cast<std::streamsize>(chunkSize_));
+        slot.len = static_cast<size_t>(src.gcount());
+        tm.readNs += elapsedNs(readStart, std::chrono::steady_clock::now());
+        if (slot.len == 0) break;
+
+        if (hashTransfers_) hasher.update(slot.data.data(), slot.len);
+        slot.zero = sparseCopy_ && isZeroBlock(slot.data.data(), slot.len);
+        if (slot.zero) tm.holeBytes += slot.len;
+        bytesRead += slot.len;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            published = k + 1;
+        }
+        produced.notify_all();
+
+        uint64_t chunkNs = elapsedNs(chunkStart, std::chrono::steady_clock::now());
+        tm.recordChunk(chunkNs);
+        if (chunkNs > stallThresholdNs_) {
+            tm.stalls++;
+            tm.stalledNs += chunkNs;
+        }
+        if (progressCallback_ && totalSize > 0) {
+            progressCallback_(static_cast<float>(bytesRead) / static_cast<float>(totalSize) * 100.0f);
+        }
+        if (src.eof()) break;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    produced.notify_all();
+    for (auto& t : writers) t.join();
+
+    const std::string digest = hashTransfers_ ? hasher.finish() : std::string();
+    std::vector<size_t> staged;
+    std::vector<std::string> stagedPaths;
+    for (size_t i = 0; i < sinks.size(); i++) {
+        Sink& sink = sinks[i];
+        TransferResult& r = results[i];
+        sink.out.close();
+        if (!sink.error && sink.out.fail()) sink.error = "Write error during transfer";
+        if (!sink.error && readError) sink.error = readError;
+        if (!sink.error && sparseCopy_) {
+            std::error_code ec;
+            if (static_cast<uint64_t>(fs::file_size(sink.writePath, ec)) < sink.written && !ec) {
+                fs::resize_file(sink.writePath, sink.written, ec);
+            }
+            if (ec) sink.error = "Failed to size sparse destination";
+        }
+
+        r.bytesTransferred = sink.written;
+        r.chunkSize = chunkSize_;
+        r.telemetry.transfers = 1;
+        r.telemetry.bytes = sink.written;
+        r.telemetry.writeNs = sink.writeNs;
+        r.telemetry.totalNs = elapsedNs(startTime, std::chrono::steady_clock::now());
+        r.bytesPerSecond = r.telemetry.bytesPerSecond();
+        tm.writeNs += sink.writeNs;
+        tm.bytes += sink.written;
+        if (sink.error) {
+            r.success = false;
+            r.errorMessage = sink.error;
+            if (atomicCommit_) {
+                std::error_code ec;
+                fs::remove(sink.writePath, ec);
+            }
+            continue;
+        }
+        r.success = true;
+        r.sha256 = digest;
+        tm.transfers++;
+        if (atomicCommit_) {
+            staged.push_back(i);
+            stagedPaths.push_back(sink.writePath);
+        }
+    }
+
+    if (!staged.empty()) {
+        // Same group commit as transferBatch: one data sync, renames, dir syncs
+        auto syncStart = std::chrono::steady_clock::now();
+        int dataSyncs = syncFilesGrouped(stagedPaths);
+        std::set<std::string> dirs;
+        for (size_t i : staged) {
+            std::error_code ec;
+            if (dataSyncs >= 0) fs::rename(sinks[i].writePath, dstPaths[i], ec);
+            if (dataSyncs < 0 || ec) {
+                results[i].success = false;
+                results[i].errorMessage = dataSyncs < 0 ? "Failed to sync destination"
+                                                        : "Failed to commit destination";
+                fs::remove(sinks[i].writePath, ec);
+                continue;
+            }
+            dirs.insert(parentDir(dstPaths[i]));
+        }
+        for (const auto& dir : dirs) {
+            syncPath(dir, true);
+            tm.syncs++;
+        }
+        if (dataSyncs > 0) tm.syncs += static_cast<uint64_t>(dataSyncs);
+        tm.syncNs = elapsedNs(syncStart, std::chrono::steady_clock::now());
+    }
+
+    tm.totalNs = elapsedNs(startTime, std::chrono::steady_clock::now());
+    telemetry_.merge(tm);
     return results;
 }
 
 void TransferManager::recordPartialTransfer(const std::string& srcPath,
                                               const std::string& dstPath,
                                               uint64_t bytesCompleted) {
-    PartialTransferInfo info;
-    info.srcPath = srcPath;
-    info.dstPath = dstPath;
-    info.bytesCompleted = bytesCompleted;
-    partialTransfers_[srcPath] = info;
+    checkpoint(srcPath, dstPath, bytesCompleted);
 }
 
 TransferResult TransferManager::resumeTransfer(const std::string& srcPath,
@@ -117,11 +1061,195 @@ TransferResult TransferManager::resumeTransfer(const std::string& srcPath,
         return transfer(srcPath, dstPath);
     }
 
-    uint64_t offset = it->second.bytesCompleted;
-    partialTransfers_.erase(it);
+    // The entry stays in place until the transfer completes, so a second
+    // interruption can resume again from the latest checkpoint.
+    uint64_t offset = verifiedPrefix(it->second);
     return transferWithOffset(srcPath, dstPath, offset);
 }
 
+uint64_t TransferManager::verifiedPrefix(PartialTransferInfo& info) const {
+    // Entries without digests (manual recordPartialTransfer) are trusted as-is;
+    // transferWithOffset still clamps them to the destination size.
+    if (info.blockSize == 0) {
+        return info.bytesCompleted;
+    }
+
+    // Re-hash only the destination and compare against the digests recorded
+    // while the data was written; the source is not re-read.
+    std::ifstream dst(writePathFor(info.dstPath), std::ios::binary);
+    size_t good = 0;
+    if (dst.is_open()) {
+        std::vector<char> block(info.blockSize);
+        size_t limit = static_cast<size_t>(std::min<uint64_t>(
+            info.blockDigests.size(), info.bytesCompleted / info.blockSize));
+        while (good < limit) {
+            dst.read(block.data(), static_cast<std::streamsize>(info.blockSize));
+            if (static_cast<size_t>(dst.gcount()) != info.blockSize) break;
+            if (fnv1a(kFnvOffset, block.data(), info.blockSize) != info.blockDigests[good]) break;
+            ++good;
+        }
+    }
+
+    if (good < info.blockDigests.size()) {
+        info.blockDigests.resize(good);
+        saveBlockDigests(info);
+    }
+    info.bytesCompleted = static_cast<uint64_t>(good) * info.blockSize;
+    return info.bytesCompleted;
+}
+
+bool TransferManager::setJournalPath(const std::string& path) {
+    journalPath_ = path;
+    return loadJournal();
+}
+
+uint64_t TransferManager::getCompletedBytes(const std::string& srcPath) const {
+    auto it = partialTransfers_.find(srcPath);
+    return it == partialTransfers_.end() ? 0 : it->second.bytesCompleted;
+}
+
+// ---------------------------------------------------------------------------
+// Resume journal
+//
+// One line per in-flight transfer:
+//   "<bytesCompleted>\t<blockSize>\t<srcPath>\t<dstPath>"
+// Rewritten via temp file + rename so a crash leaves either the previous or
+// the new journal, never a torn one; the temp file and then the directory are
+// fsynced so the rename survives power loss. Each entry's block digests live
+// in an append-only sidecar (<journal>.<hash>.blk) so checkpoints stay O(1).
+// Transfers checkpoint every checkpointBytes_ / checkpointNs_, not per chunk.
+// ---------------------------------------------------------------------------
+
+bool TransferManager::loadJournal() {
+    if (journalPath_.empty() || !fs::exists(journalPath_)) return true;
+
+    std::ifstream in(journalPath_);
+    if (!in.is_open()) return false;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        std::vector<std::string> parts;
+        std::istringstream fields(line);
+        std::string part;
+        while (std::getline(fields, part, '\t')) parts.push_back(part);
+        if (parts.size() != 4) continue;  // torn or foreign line
+
+        PartialTransferInfo info;
+        try {
+            info.bytesCompleted = std::stoull(parts[0]);
+            info.blockSize = std::stoull(parts[1]);
+        } catch (const std::exception&) {
+            continue;
+        }
+        info.srcPath = parts[2];
+        info.dstPath = parts[3];
+        if (info.srcPath.empty() || info.dstPath.empty()) continue;
+
+        std::ifstream blk(blockFilePath(info.srcPath), std::ios::binary);
+        uint64_t digest;
+        while (blk.read(reinterpret_cast<char*>(&digest), sizeof(digest))) {
+            info.blockDigests.push_back(digest);
+        }
+        partialTransfers_[info.srcPath] = std::move(info);
+    }
+    return true;
+}
+
+std::string TransferManager::blockFilePath(const std::string& srcPath) const {
+    std::ostringstream ss;
+    ss << journalPath_ << '.' << std::hex << std::setw(16) << std::setfill('0')
+       << fnv1a(kFnvOffset, srcPath.data(), srcPath.size()) << ".blk";
+    return ss.str();
+}
+
+bool TransferManager::saveBlockDigests(const PartialTransferInfo& info) const {
+    if (journalPath_.empty()) return true;
+
+    std::ofstream out(blockFilePath(info.srcPath), std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) return false;
+    out.write(reinterpret_cast<const char*>(info.blockDigests.data()),
+              static_cast<std::streamsize>(info.blockDigests.size() * sizeof(uint64_t)));
+    return out.good();
+}
+
+bool TransferManager::saveJournal() const {
+    if (journalPath_.empty()) return true;
+
+    std::error_code ec;
+    if (partialTransfers_.empty()) {
+        fs::remove(journalPath_, ec);
+        return !ec;
+    }
+
+    std::ostringstream ss;
+    for (const auto& [_, info] : partialTransfers_) {
+        ss << info.bytesCompleted << '\t' << info.blockSize << '\t'
+           << info.srcPath << '\t' << info.dstPath << '\n';
+    }
+
+    const std::string tmpPath = journalPath_ + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::trunc);
+        if (!out.is_open()) return false;
+        out << ss.str();
+        out.flush();
+        if (!out.good()) return false;
+    }
+    // The new contents must be on disk before the rename makes them the
+    // journal, and the rename itself before anyone relies on it
+    if (!syncPath(tmpPath, false)) return false;
+    fs::rename(tmpPath, journalPath_, ec);
+    if (ec) return false;
+    syncPath(parentDir(journalPath_), true);
+    return true;
+}
+
+void TransferManager::checkpoint(const std::string& srcPath,
+                                 const std::string& dstPath,
+                                 uint64_t bytesCompleted,
+                                 const std::vector<uint64_t>* newDigests) {
+    PartialTransferInfo& info = partialTransfers_[srcPath];
+    info.srcPath = srcPath;
+    info.dstPath = dstPath;
+    info.bytesCompleted = bytesCompleted;
+
+    if (!newDigests) {
+        if (info.blockSize != 0) {
+            info.blockSize = 0;
+            info.blockDigests.clear();
+            saveBlockDigests(info);
+        }
+        saveJournal();
+        return;
+    }
+
+    // Digests must reach disk before the journal that claims the bytes
+    info.blockSize = verifyBlockSize_;
+    if (!newDigests->empty()) {
+        info.blockDigests.insert(info.blockDigests.end(), newDigests->begin(), newDigests->end());
+        if (!journalPath_.empty()) {
+            const std::string blkPath = blockFilePath(srcPath);
+            {
+                std::ofstream blk(blkPath, std::ios::binary | std::ios::app);
+                blk.write(reinterpret_cast<const char*>(newDigests->data()),
+                          static_cast<std::streamsize>(newDigests->size() * sizeof(uint64_t)));
+            }
+            syncPath(blkPath, false);
+        }
+    }
+    saveJournal();
+}
+
+void TransferManager::clearCheckpoint(const std::string& srcPath) {
+    if (partialTransfers_.erase(srcPath) > 0) {
+        if (!journalPath_.empty()) {
+            std::error_code ec;
+            fs::remove(blockFilePath(srcPath), ec);
+        }
+        saveJournal();
+    }
+}
+
 bool TransferManager::retryWithBackoff(std::function<bool()> operation) {
     for (int attempt = 0; attempt < maxRetries_; attempt++) {
         if (operation()) {
@@ -140,6 +1268,34 @@ void TransferManager::onProgress(std::function<void(float)> callback) {
     progressCallback_ = std::move(callback);
 }
 
+void TransferManager::setHashTransfers(bool enabled) {
+    hashTransfers_ = enabled;
+}
+
+void TransferManager::setSparseCopy(bool enabled) {
+    sparseCopy_ = enabled;
+}
+
+void TransferManager::setAtomicCommit(bool enabled) {
+    atomicCommit_ = enabled;
+}
+
+void TransferManager::setStallThresholdMs(int ms) {
+    stallThresholdNs_ = static_cast<uint64_t>(std::max(ms, 0)) * 1000000ULL;
+}
+
+const TransferTelemetry& TransferManager::getTelemetry() const {
+    return telemetry_;
+}
+
+void TransferManager::resetTelemetry() {
+    telemetry_ = TransferTelemetry{};
+}
+
+void TransferManager::setAbortCheck(std::function<bool()> check) {
+    abortCheck_ = std::move(check);
+}
+
 void TransferManager::setMaxRetries(int retries) {
     maxRetries_ = retries;
 }
@@ -148,8 +1304,87 @@ void TransferManager::setBaseBackoffMs(int ms) {
     baseBackoffMs_ = ms;
 }
 
+int TransferManager::getMaxRetries() const {
+    return maxRetries_;
+}
+
+int TransferManager::getBaseBackoffMs() const {
+    return baseBackoffMs_;
+}
+
 void TransferManager::setChunkSize(size_t bytes) {
-    chunkSize_ = bytes;
+    chunkSize_ = adaptive_.enabled
+        ? std::clamp(bytes, adaptive_.minBytes, adaptive_.maxBytes) : bytes;
+}
+
+void TransferManager::setCheckpointInterval(uint64_t bytes, int ms) {
+    checkpointBytes_ = bytes;
+    checkpointNs_ = static_cast<uint64_t>(std::max(ms, 0)) * 1000000ULL;
+}
+
+void TransferManager::setVerifyBlockSize(size_t bytes) {
+    if (bytes > 0) verifyBlockSize_ = bytes;
+}
+
+void TransferManager::setDeltaBlockSize(size_t bytes) {
+    if (bytes > 0) deltaBlockSize_ = bytes;
+}
+
+void TransferManager::setDeltaVerify(bool enabled) {
+    deltaVerify_ = enabled;
+}
+
+void TransferManager::setAdaptiveChunking(bool enabled, size_t minBytes, size_t maxBytes) {
+    adaptive_ = AdaptiveState{};
+    adaptive_.enabled = enabled;
+    adaptive_.minBytes = std::max<size_t>(minBytes, 512);
+    adaptive_.maxBytes = std::max(maxBytes, adaptive_.minBytes);
+    if (enabled) {
+        chunkSize_ = std::clamp(chunkSize_, adaptive_.minBytes, adaptive_.maxBytes);
+    }
+}
+
+size_t TransferManager::getChunkSize() const {
+    return chunkSize_;
+}
+
+double TransferManager::getMeasuredBytesPerSecond() const {
+    return adaptive_.rate;
+}
+
+void TransferManager::adaptChunkSize(uint64_t bytes, double seconds) {
+    AdaptiveState& a = adaptive_;
+    a.windowChunks++;
+    a.windowBytes += bytes;
+    a.windowSeconds += seconds;
+
+    // A single chunk that blocks for too long is worse than any throughput
+    // gain: shrink immediately and start a fresh window.
+    bool tooSlow = seconds > kAdaptMaxChunkSecs && chunkSize_ > a.minBytes;
+    if (!tooSlow && a.windowChunks < kAdaptWindowChunks) return;
+
+    double windowRate = a.windowSeconds > 0.0
+        ? static_cast<double>(a.windowBytes) / a.windowSeconds
+        : static_cast<double>(a.windowBytes) * 1e9;
+    a.rate = windowRate;
+    a.windowChunks = 0;
+    a.windowBytes = 0;
+    a.windowSeconds = 0.0;
+
+    if (tooSlow) {
+        a.direction = -1;
+    } else if (a.previousRate > 0.0 && windowRate < a.previousRate * kAdaptMinGain) {
+        // The last step didn't pay off: head back the other way
+        a.direction = -a.direction;
+    }
+    a.previousRate = windowRate;
+
+    size_t next = a.direction > 0 ? chunkSize_ * 2 : chunkSize_ / 2;
+    next = std::clamp(next, a.minBytes, a.maxBytes);
+    if (next == chunkSize_) {
+        a.direction = -a.direction;  // pinned at a bound; probe inward next time
+    }
+    chunkSize_ = next;
 }
 
 } // namespace syncv
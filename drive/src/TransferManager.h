@@ -1,18 +1,60 @@
 #pragma once
 
+#include "LatencyHistogram.h"
+
 #include <string>
 #include <vector>
 #include <functional>
 #include <cstdint>
 #include <map>
+#include <array>
 
 namespace syncv {
 
+/// Nanosecond-resolution timing for one transfer, or an aggregate of many.
+/// Per-chunk latency (read + write + checkpoint, excluding progress callbacks)
+/// goes into a log-linear histogram: 4 sub-buckets per power of two, so
+/// percentiles are accurate to within 25%.
+struct TransferTelemetry {
+    static constexpr size_t kSubBuckets = latency::kSubBuckets;
+    static constexpr size_t kBuckets = 41 * kSubBuckets;  // up to ~2^41 ns (~36 min)
+
+    uint64_t transfers = 0;
+    uint64_t bytes = 0;
+    uint64_t chunks = 0;
+    uint64_t totalNs = 0;
+    uint64_t readNs = 0;
+    uint64_t writeNs = 0;
+    uint64_t checkpointNs = 0;  // journal and digest bookkeeping
+    uint64_t syncNs = 0;        // fsync/syncfs and directory syncs at commit
+    uint64_t syncs = 0;
+    uint64_t holeBytes = 0;     // bytes skipped as holes by sparse copies
+    uint64_t maxChunkNs = 0;
+    uint64_t stalls = 0;        // chunks slower than the stall threshold
+    uint64_t stalledNs = 0;
+    std::array<uint64_t, kBuckets> latencyHistogram{};
+
+    void recordChunk(uint64_t ns);
+
+    /// Upper bound of the bucket holding the p-th percentile (p in [0, 100]).
+    uint64_t percentileNs(double p) const;
+
+    /// Average throughput over totalNs.
+    double bytesPerSecond() const;
+
+    void merge(const TransferTelemetry& other);
+};
+
 struct TransferResult {
     bool success = false;
     std::string errorMessage;
     uint64_t bytesTransferred = 0;
     double bytesPerSecond = 0.0;
+    uint64_t resumedFrom = 0;   // offset the transfer continued from (0 = fresh)
+    size_t chunkSize = 0;       // chunk size in effect when the transfer finished
+    uint64_t bytesSkipped = 0;  // delta transfers: bytes already present in dst
+    std::string sha256;         // hex digest of the data, when hashing is on
+    TransferTelemetry telemetry;
 };
 
 class TransferManager {
@@ -22,11 +64,41 @@ public:
     /// Transfer a file from source to destination.
     TransferResult transfer(const std::string& srcPath, const std::string& dstPath);
 
-    /// Transfer multiple files sequentially.
+    /// Transfer and SHA-256 the data in the same pass, returning the digest
+    /// in TransferResult::sha256. If expectedSha256 is given and doesn't
+    /// match, the transfer fails and the destination is removed (with atomic
+    /// commit it is never renamed into place).
+    TransferResult transferVerified(const std::string& srcPath, const std::string& dstPath,
+                                    const std::string& expectedSha256 = "");
+
+    /// Update an existing destination in place, rsync-style: index dst's
+    /// blocks (rolling weak checksum + strong hash), roll the source over that
+    /// index, and write only the ranges whose content differs at that offset.
+    /// The source is SHA-256 hashed as it streams past and, unless
+    /// setDeltaVerify(false), dst is hashed once at the end; on mismatch (or
+    /// when dst doesn't exist, or atomic commit is on) it falls back to
+    /// transfer(). An aborted delta leaves dst holding the source's first
+    /// bytesTransferred bytes followed by its old tail; running transferDelta
+    /// again picks up from there at the cost of re-reading the prefix.
+    TransferResult transferDelta(const std::string& srcPath, const std::string& dstPath);
+
+    /// Transfer multiple files sequentially. With atomic commit enabled the
+    /// batch is group-committed: one data sync for all files, then renames,
+    /// then one sync per destination directory.
     std::vector<TransferResult> transferBatch(
         const std::vector<std::pair<std::string, std::string>>& files);
 
+    /// Copy one source to several destinations in a single read pass. Each
+    /// destination has its own writer thread; chunks are double-buffered so
+    /// the next read overlaps the writes. A destination that fails is dropped
+    /// and the others carry on; results are returned in dstPaths order.
+    /// Honours atomic commit (group-committed), sparse zero chunks and
+    /// hashing (one digest shared by all results). Not journalled.
+    std::vector<TransferResult> transferFanOut(const std::string& srcPath,
+                                               const std::vector<std::string>& dstPaths);
+
     /// Record that a transfer was partially completed (for resume support).
+    /// Persisted to the journal when one is configured.
     void recordPartialTransfer(const std::string& srcPath,
                                 const std::string& dstPath,
                                 uint64_t bytesCompleted);
@@ -34,33 +106,139 @@ public:
     /// Resume a previously interrupted transfer.
     TransferResult resumeTransfer(const std::string& srcPath, const std::string& dstPath);
 
+    /// Enable the on-disk resume journal at the given path and load any
+    /// entries left behind by a previous run (e.g. after a power loss).
+    /// Transfers then checkpoint their progress every checkpoint interval
+    /// and when they are aborted. Returns false if an existing journal
+    /// cannot be read.
+    bool setJournalPath(const std::string& path);
+
+    /// Bytes recorded as completed for srcPath, or 0 if none.
+    uint64_t getCompletedBytes(const std::string& srcPath) const;
+
     /// Retry a callable with exponential backoff.
     bool retryWithBackoff(std::function<bool()> operation);
 
     /// Set progress callback.
     void onProgress(std::function<void(float)> callback);
 
+    /// Set a check polled between chunks; returning true aborts the running
+    /// transfer. Its journal checkpoint is kept, so it can be resumed later.
+    void setAbortCheck(std::function<bool()> check);
+
     /// Configuration
     void setMaxRetries(int retries);
     void setBaseBackoffMs(int ms);
     void setChunkSize(size_t bytes);
+    void setVerifyBlockSize(size_t bytes);
+    /// Checkpoint once this many bytes or milliseconds have passed since
+    /// the last one, whichever comes first (0, 0 = after every chunk).
+    /// Each checkpoint is fsynced, so fewer of them spare the SD card.
+    void setCheckpointInterval(uint64_t bytes, int ms);
+    void setDeltaBlockSize(size_t bytes);
+    /// Hash dst after a delta transfer instead of trusting block matches
+    /// (64-bit strong hashes) for the bytes that were not rewritten.
+    void setDeltaVerify(bool enabled);
+    int getMaxRetries() const;
+    int getBaseBackoffMs() const;
+
+    /// Let the manager tune the chunk size from measured per-chunk throughput,
+    /// staying within [minBytes, maxBytes]. The tuned size carries over to
+    /// later transfers, so use one manager per kind of sink (SD, USB, network).
+    void setAdaptiveChunking(bool enabled, size_t minBytes = 16 * 1024,
+                             size_t maxBytes = 1024 * 1024);
+
+    /// Current chunk size (the tuned value when adaptive chunking is on).
+    size_t getChunkSize() const;
+
+    /// Smoothed throughput observed at the current chunk size (bytes/second).
+    /// 0 until adaptive chunking has measured at least one window.
+    double getMeasuredBytesPerSecond() const;
+
+    /// Hash every transfer (including batches and resumes) in the copy loop
+    /// so TransferResult::sha256 is always filled in. Off by default.
+    void setHashTransfers(bool enabled);
+
+    /// Atomic commit: write to "<dst>.syncv-part", sync it, rename over dst
+    /// and sync the directory, so a power cut never leaves a partial file
+    /// under the final name. Off by default.
+    void setAtomicCommit(bool enabled);
+
+    /// Sparse copy: skip source holes (SEEK_DATA/SEEK_HOLE) and all-zero
+    /// chunks, leaving holes in the destination instead of writing zeros.
+    /// Meant for disk and firmware images; off by default.
+    void setSparseCopy(bool enabled);
+
+    /// A chunk taking longer than this counts as a stall (default 500ms).
+    void setStallThresholdMs(int ms);
+
+    /// Telemetry aggregated over every transfer since the last reset,
+    /// including batches and failed attempts.
+    const TransferTelemetry& getTelemetry() const;
+    void resetTelemetry();
 
 private:
     int maxRetries_ = 3;
     int baseBackoffMs_ = 1000;
     size_t chunkSize_ = 65536; // 64KB default
+    size_t verifyBlockSize_ = 65536; // granularity of resume digests
+    uint64_t checkpointBytes_ = 4 * 1024 * 1024;
+    uint64_t checkpointNs_ = 2000000000ULL;
+    size_t deltaBlockSize_ = 4096;   // granularity of delta matching
+    bool deltaVerify_ = true;
     std::function<void(float)> progressCallback_;
+    std::function<bool()> abortCheck_;
+    uint64_t stallThresholdNs_ = 500000000ULL;
+    bool atomicCommit_ = false;
+    bool sparseCopy_ = false;
+    bool hashTransfers_ = false;
+    TransferTelemetry telemetry_;
+
+    // Adaptive chunk sizing: hill-climb in powers of two, one step per
+    // measurement window, reversing direction when throughput drops.
+    struct AdaptiveState {
+        bool enabled = false;
+        size_t minBytes = 16 * 1024;
+        size_t maxBytes = 1024 * 1024;
+        int direction = 1;          // +1 = grow, -1 = shrink
+        int windowChunks = 0;
+        uint64_t windowBytes = 0;
+        double windowSeconds = 0.0;
+        double previousRate = 0.0;  // rate of the window before the last step
+        double rate = 0.0;          // smoothed rate at the current size
+    };
+    AdaptiveState adaptive_;
+
+    void adaptChunkSize(uint64_t bytes, double seconds);
 
     struct PartialTransferInfo {
         std::string srcPath;
         std::string dstPath;
         uint64_t bytesCompleted;
+        uint64_t blockSize = 0;              // 0 = untracked, offset trusted as-is
+        std::vector<uint64_t> blockDigests;  // FNV-1a per verify block, in order
     };
     std::map<std::string, PartialTransferInfo> partialTransfers_;
+    std::string journalPath_;
+
+    bool loadJournal();
+    bool saveJournal() const;
+    std::string blockFilePath(const std::string& srcPath) const;
+    bool saveBlockDigests(const PartialTransferInfo& info) const;
+    void checkpoint(const std::string& srcPath, const std::string& dstPath,
+                    uint64_t bytesCompleted,
+                    const std::vector<uint64_t>* newDigests = nullptr);
+    uint64_t verifiedPrefix(PartialTransferInfo& info) const;
+    void clearCheckpoint(const std::string& srcPath);
 
     TransferResult transferWithOffset(const std::string& srcPath,
                                        const std::string& dstPath,
-                                       uint64_t offset);
+                                       uint64_t offset,
+                                       bool deferCommit = false,
+                                       const std::string* expectedHash = nullptr);
+
+    /// Where data is written before commit (dst itself unless atomic).
+    std::string writePathFor(const std::string& dstPath) const;
 };
 
 } // namespace syncv
@@ -0,0 +1,325 @@
+#include "TransferScheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace syncv {
+
+using Clock = std::chrono::steady_clock;
+
+namespace detail {
+
+struct TransferJob {
+    uint64_t id = 0;
+    uint64_t seq = 0;               // FIFO order within a priority
+    TransferRequest request;
+    int maxAttempts = 1;
+    int attempts = 0;
+    Clock::time_point notBefore;    // earliest start (backoff timer)
+
+    std::atomic<TransferState> state{TransferState::Queued};
+    std::atomic<bool> cancelRequested{false};
+    std::atomic<bool> finished{false};
+    std::promise<TransferResult> promise;
+    std::shared_future<TransferResult> future;
+    std::weak_ptr<SchedulerCore> core;
+};
+
+using JobPtr = std::shared_ptr<TransferJob>;
+
+struct SchedulerCore {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::condition_variable idleCv;
+    std::vector<JobPtr> queue;
+    std::vector<JobPtr> running;        // one slot per busy worker
+    uint64_t nextId = 1;
+    uint64_t nextSeq = 0;
+    bool stopping = false;
+
+    static void finish(const JobPtr& job, TransferState state, TransferResult result) {
+        if (job->finished.exchange(true)) return;
+        job->state = state;
+        job->promise.set_value(std::move(result));
+    }
+
+    static TransferResult failure(const std::string& message) {
+        TransferResult r;
+        r.success = false;
+        r.errorMessage = message;
+        return r;
+    }
+
+    void cancel(const JobPtr& job) {
+        bool dequeued = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = std::find(queue.begin(), queue.end(), job);
+            if (it != queue.end()) {
+                queue.erase(it);
+                dequeued = true;
+            }
+        }
+        // A running job notices the flag at its next chunk boundary
+        if (dequeued) {
+            finish(job, TransferState::Cancelled, failure("Transfer cancelled"));
+            idleCv.notify_all();
+        }
+    }
+
+    /// Pick the best eligible job. Expired jobs are moved to `expired` so they
+    /// can be failed outside the lock. `wakeAt` is set to the next time the
+    /// queue can change on its own (backoff or deadline).
+    JobPtr takeNextLocked(Clock::time_point now, Clock::time_point& wakeAt,
+                          std::vector<JobPtr>& expired) {
+        wakeAt = Clock::time_point::max();
+        JobPtr best;
+        for (auto it = queue.begin(); it != queue.end();) {
+            const JobPtr& job = *it;
+            if (now >= job->request.deadline) {
+                expired.push_back(job);
+                it = queue.erase(it);
+                continue;
+            }
+            wakeAt = std::min(wakeAt, job->request.deadline);
+            if (job->notBefore > now) {
+                wakeAt = std::min(wakeAt, job->notBefore);
+            } else if (!best ||
+                       job->request.priority > best->request.priority ||
+                       (job->request.priority == best->request.priority && job->seq < best->seq)) {
+                best = job;
+            }
+            ++it;
+        }
+        if (best) {
+            queue.erase(std::find(queue.begin(), queue.end(), best));
+        }
+        return best;
+    }
+};
+
+} // namespace detail
+
+// ---------------------------------------------------------------------------
+// TransferHandle
+// ---------------------------------------------------------------------------
+
+TransferHandle::TransferHandle(std::shared_ptr<detail::TransferJob> job)
+    : job_(std::move(job)) {}
+
+uint64_t TransferHandle::id() const {
+    return job_ ? job_->id : 0;
+}
+
+TransferState TransferHandle::state() const {
+    return job_ ? job_->state.load() : TransferState::Cancelled;
+}
+
+std::shared_future<TransferResult> TransferHandle::result() const {
+    return job_ ? job_->future : std::shared_future<TransferResult>();
+}
+
+void TransferHandle::cancel() {
+    if (!job_ || job_->finished) return;
+    job_->cancelRequested = true;
+    if (auto core = job_->core.lock()) {
+        core->cancel(job_);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// TransferScheduler
+// ---------------------------------------------------------------------------
+
+TransferScheduler::TransferScheduler(TransferManager& manager)
+    : TransferScheduler(std::vector<TransferManager*>{&manager}) {}
+
+TransferScheduler::TransferScheduler(const std::vector<TransferManager*>& managers)
+    : managers_(managers), core_(std::make_shared<detail::SchedulerCore>()) {
+    for (TransferManager* manager : managers_) {
+        workers_.emplace_back(&TransferScheduler::workerLoop, this, std::ref(*manager));
+    }
+}
+
+TransferScheduler::~TransferScheduler() {
+    shutdown();
+}
+
+TransferHandle TransferScheduler::submit(const TransferRequest& request) {
+    auto job = std::make_shared<detail::TransferJob>();
+    job->request = request;
+    job->maxAttempts = std::max(1, request.maxRetries >= 0 ? request.maxRetries
+                                                           : managers_.front()->getMaxRetries());
+    job->notBefore = Clock::now();
+    job->future = job->promise.get_future().share();
+    job->core = core_;
+
+    {
+        std::lock_guard<std::mutex> lock(core_->mutex);
+        job->id = core_->nextId++;
+        job->seq = core_->nextSeq++;
+        if (core_->stopping) {
+            detail::SchedulerCore::finish(job, TransferState::Cancelled,
+                detail::SchedulerCore::failure("Scheduler is shut down"));
+            return TransferHandle(job);
+        }
+        core_->queue.push_back(job);
+    }
+    core_->cv.notify_one();
+    return TransferHandle(job);
+}
+
+TransferHandle TransferScheduler::submit(const std::string& srcPath,
+                                         const std::string& dstPath,
+                                         TransferPriority priority) {
+    TransferRequest request;
+    request.srcPath = srcPath;
+    request.dstPath = dstPath;
+    request.priority = priority;
+    return submit(request);
+}
+
+void TransferScheduler::cancelAll() {
+    std::vector<detail::JobPtr> dropped;
+    {
+        std::lock_guard<std::mutex> lock(core_->mutex);
+        dropped.swap(core_->queue);
+        for (const auto& job : core_->running) job->cancelRequested = true;
+    }
+    for (const auto& job : dropped) {
+        job->cancelRequested = true;
+        detail::SchedulerCore::finish(job, TransferState::Cancelled,
+            detail::SchedulerCore::failure("Transfer cancelled"));
+    }
+    core_->idleCv.notify_all();
+}
+
+size_t TransferScheduler::pendingCount() const {
+    std::lock_guard<std::mutex> lock(core_->mutex);
+    return core_->queue.size();
+}
+
+void TransferScheduler::waitIdle() {
+    std::unique_lock<std::mutex> lock(core_->mutex);
+    core_->idleCv.wait(lock, [this] {
+        return core_->stopping || (core_->queue.empty() && core_->running.empty());
+    });
+}
+
+void TransferScheduler::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(core_->mutex);
+        if (core_->stopping) return;
+    }
+    cancelAll();
+    {
+        std::lock_guard<std::mutex> lock(core_->mutex);
+        core_->stopping = true;
+    }
+    core_->cv.notify_all();
+    core_->idleCv.notify_all();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) worker.join();
+    }
+    for (TransferManager* manager : managers_) manager->setAbortCheck(nullptr);
+}
+
+void TransferScheduler::workerLoop(TransferManager& manager) {
+    auto& core = *core_;
+
+    // Only this thread touches `active`; its manager polls it between chunks.
+    detail::TransferJob* active = nullptr;
+    manager.setAbortCheck([&active] {
+        return active && (active->cancelRequested || Clock::now() >= active->request.deadline);
+    });
+
+    for (;;) {
+        detail::JobPtr job;
+        std::vector<detail::JobPtr> expired;
+        {
+            std::unique_lock<std::mutex> lock(core.mutex);
+            for (;;) {
+                if (core.stopping) return;
+                Clock::time_point wakeAt;
+                job = core.takeNextLocked(Clock::now(), wakeAt, expired);
+                if (job || !expired.empty()) break;
+                if (wakeAt == Clock::time_point::max()) {
+                    core.cv.wait(lock);
+                } else {
+                    core.cv.wait_until(lock, wakeAt);
+                }
+            }
+            if (job) {
+                core.running.push_back(job);
+                job->state = TransferState::Running;
+            }
+        }
+
+        for (const auto& e : expired) {
+            detail::SchedulerCore::finish(e, TransferState::Failed,
+                detail::SchedulerCore::failure("Deadline exceeded"));
+        }
+        if (!job) {
+            core.idleCv.notify_all();
+            continue;
+        }
+
+        TransferResult result;
+        active = job.get();
+        try {
+            // Retries continue from the journal checkpoint when there is one
+            result = job->attempts == 0
+                ? manager.transfer(job->request.srcPath, job->request.dstPath)
+                : manager.resumeTransfer(job->request.srcPath, job->request.dstPath);
+        } catch (const std::exception& e) {
+            result = detail::SchedulerCore::failure(e.what());
+        }
+        active = nullptr;
+        job->attempts++;
+
+        bool requeued = false;
+        auto now = Clock::now();
+        if (job->cancelRequested) {
+            result.success = false;
+            result.errorMessage = "Transfer cancelled";
+            detail::SchedulerCore::finish(job, TransferState::Cancelled, std::move(result));
+        } else if (result.success) {
+            detail::SchedulerCore::finish(job, TransferState::Completed, std::move(result));
+        } else if (now >= job->request.deadline) {
+            result.errorMessage = "Deadline exceeded";
+            detail::SchedulerCore::finish(job, TransferState::Failed, std::move(result));
+        } else if (job->attempts < job->maxAttempts) {
+            // Backoff is a timer on the queue, not a sleep: other jobs run meanwhile
+            int shift = std::min(job->attempts - 1, 16);
+            job->notBefore = now + std::chrono::milliseconds(
+                static_cast<int64_t>(manager.getBaseBackoffMs()) << shift);
+            job->state = TransferState::Waiting;
+            requeued = true;
+        } else {
+            detail::SchedulerCore::finish(job, TransferState::Failed, std::move(result));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(core.mutex);
+            core.running.erase(std::find(core.running.begin(), core.running.end(), job));
+            if (requeued) {
+                if (job->cancelRequested) {
+                    requeued = false;
+                } else {
+                    core.queue.push_back(job);
+                }
+            }
+        }
+        if (!requeued && !job->finished) {
+            detail::SchedulerCore::finish(job, TransferState::Cancelled,
+                detail::SchedulerCore::failure("Transfer cancelled"));
+        }
+        core.idleCv.notify_all();
+    }
+}
+
+} // namespace syncv
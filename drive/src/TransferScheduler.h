@@ -0,0 +1,117 @@
+#pragma once
+
+#include "TransferManager.h"
+
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace syncv {
+
+enum class TransferPriority {
+    Low = 0,
+    Normal = 1,
+    High = 2
+};
+
+struct TransferRequest {
+    std::string srcPath;
+    std::string dstPath;
+    TransferPriority priority = TransferPriority::Normal;
+    /// Fail the transfer if it hasn't finished by then (default: no deadline).
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::time_point::max();
+    /// Maximum attempts, as for TransferManager::setMaxRetries; -1 uses the
+    /// manager's setting.
+    int maxRetries = -1;
+};
+
+enum class TransferState {
+    Queued,
+    Running,
+    Waiting,    // failed attempt, backing off before the next one
+    Completed,
+    Failed,
+    Cancelled
+};
+
+namespace detail { struct TransferJob; struct SchedulerCore; }
+
+/// Handle to a scheduled transfer. Cheap to copy; all copies refer to the
+/// same job.
+class TransferHandle {
+public:
+    TransferHandle() = default;
+
+    uint64_t id() const;
+    TransferState state() const;
+
+    /// Result of the transfer; ready once the job completes, fails or is cancelled.
+    std::shared_future<TransferResult> result() const;
+
+    /// Request cancellation. Queued jobs are dropped immediately; a running
+    /// job stops at the next chunk boundary (its resume checkpoint is kept).
+    void cancel();
+
+private:
+    friend class TransferScheduler;
+    explicit TransferHandle(std::shared_ptr<detail::TransferJob> job);
+    std::shared_ptr<detail::TransferJob> job_;
+};
+
+/// Runs TransferManager transfers on background threads so the caller's
+/// loop never blocks on slow I/O.
+///
+///   - Highest priority first, FIFO within a priority
+///   - Failed attempts are re-queued with exponential backoff on a timer
+///     instead of sleeping, so other transfers keep flowing meanwhile
+///   - Retries continue from the manager's resume checkpoint
+///
+/// Each manager gets a worker thread of its own, so with several managers a
+/// transfer stuck on a slow sink only holds up its own worker. Managers that
+/// keep a journal need one each. The scheduler installs its own abort check;
+/// don't call the managers directly while it is running.
+class TransferScheduler {
+public:
+    explicit TransferScheduler(TransferManager& manager);
+    /// One worker per manager; `managers` must not be empty.
+    explicit TransferScheduler(const std::vector<TransferManager*>& managers);
+    ~TransferScheduler();
+
+    TransferScheduler(const TransferScheduler&) = delete;
+    TransferScheduler& operator=(const TransferScheduler&) = delete;
+
+    /// Queue a transfer and return immediately.
+    TransferHandle submit(const TransferRequest& request);
+
+    /// Convenience overload with default priority and no deadline.
+    TransferHandle submit(const std::string& srcPath, const std::string& dstPath,
+                          TransferPriority priority = TransferPriority::Normal);
+
+    /// Cancel every queued and running transfer.
+    void cancelAll();
+
+    /// Number of jobs queued or backing off (excludes running ones).
+    size_t pendingCount() const;
+
+    /// Block until the queue is empty and nothing is running.
+    void waitIdle();
+
+    /// Cancel outstanding work and stop the workers. Called by the destructor.
+    void shutdown();
+
+private:
+    std::vector<TransferManager*> managers_;
+    // Queue state is shared with outstanding handles so cancel() stays safe
+    // even if a handle outlives the scheduler.
+    std::shared_ptr<detail::SchedulerCore> core_;
+    std::vector<std::thread> workers_;
+
+    void workerLoop(TransferManager& manager);
+};
+
+} // namespace syncv
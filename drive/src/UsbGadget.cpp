@@ -1,18 +1,613 @@
 #include "UsbGadget.h"
+#include "TransferManager.h"
+#include "Fat32Image.h"
+#include "UsbRefreshGate.h"
 
 #include <filesystem>
 #include <fstream>
-#include <iostream>
 #include <sstream>
+#include <iostream>
 #include <cstdlib>
 #include <cstring>
+#include <unordered_set>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cctype>
+#include <limits>
+
+#ifndef _WIN32
+#include <sys/statvfs.h>
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <linux/loop.h>
+#endif
 
 namespace fs = std::filesystem;
 
 namespace syncv {
 
+namespace {
+
+/// Log a failed system call with its errno, so failures are visible instead
+/// of disappearing into a shell's exit status.
+bool sysFail(const std::string& what) {
+    std::cerr << "[usb] " << what << ": " << std::strerror(errno) << std::endl;
+    return false;
+}
+
+/// Where prepareImage() writes: a loop-mounted directory or the image itself.
+class ImageTarget {
+public:
+    virtual ~ImageTarget() = default;
+    /// Size of `name` in the image, -1 if absent.
+    virtual int64_t fileSize(const std::string& name) = 0;
+    /// Copy one file; `sha256` and `size` describe the bytes actually
+    /// copied, which may differ from change.stat for a growing source.
+    virtual bool write(const ManifestChange& change, std::string& sha256, uint64_t& size,
+                       std::string& error) = 0;
+    virtual std::vector<std::string> listFiles() = 0;
+    virtual bool remove(const std::string& name) = 0;
+    /// Remove directories left empty, deepest first.
+    virtual void pruneDirectories() = 0;
+    /// Space left for new data, and the unit it is allocated in.
+    virtual uint64_t freeBytes() = 0;
+    virtual uint64_t allocationUnit() = 0;
+    /// Whole-file access for small generated files.
+    virtual bool readData(const std::string& name, std::string& data) = 0;
+    virtual bool writeData(const std::string& name, const std::string& data) = 0;
+};
+
+class MountedTarget : public ImageTarget {
+public:
+    explicit MountedTarget(const std::string& root) : root_(root) {
+        copier_.setMaxRetries(1);
+        copier_.setHashTransfers(true);
+    }
+
+    int64_t fileSize(const std::string& name) override {
+        std::error_code ec;
+        auto size = fs::file_size(root_ / name, ec);
+        return ec ? -1 : static_cast<int64_t>(size);
+    }
+
+    bool write(const ManifestChange& change, std::string& sha256, uint64_t& size,
+               std::string& error) override {
+        fs::path dst = root_ / change.name;
+        std::error_code ec;
+        fs::create_directories(dst.parent_path(), ec);
+        auto result = copier_.transfer(change.srcPath, dst.string());
+        sha256 = result.sha256;
+        size = result.bytesTransferred;
+        error = result.errorMessage;
+        return result.success;
+    }
+
+    std::vector<std::string> listFiles() override {
+        std::vector<std::string> files;
+        std::error_code ec;
+        for (auto it = fs::recursive_directory_iterator(root_, ec);
+             !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (!it->is_directory(ec)) {
+                files.push_back(it->path().lexically_relative(root_).generic_string());
+            }
+        }
+        return files;
+    }
+
+    bool remove(const std::string& name) override {
+        std::error_code ec;
+        return fs::remove(root_ / name, ec);
+    }
+
+    void pruneDirectories() override {
+        std::vector<fs::path> dirs;
+        std::error_code ec;
+        for (auto it = fs::recursive_directory_iterator(root_, ec);
+             !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (it->is_directory(ec)) dirs.push_back(it->path());
+        }
+        std::sort(dirs.begin(), dirs.end(), [](const fs::path& a, const fs::path& b) {
+            return a.native().size() > b.native().size();
+        });
+        for (const auto& dir : dirs) {
+            if (fs::is_empty(dir, ec)) fs::remove(dir, ec);
+        }
+    }
+
+    uint64_t freeBytes() override {
+#ifndef _WIN32
+        struct statvfs st{};
+        if (::statvfs(root_.c_str(), &st) == 0) {
+            return static_cast<uint64_t>(st.f_bavail) * st.f_frsize;
+        }
+#endif
+        std::error_code ec;
+        auto space = fs::space(root_, ec);
+        return ec ? 0 : space.available;
+    }
+
+    bool readData(const std::string& name, std::string& data) override {
+        std::ifstream in(root_ / name, std::ios::binary);
+        if (!in) return false;
+        data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    bool writeData(const std::string& name, const std::string& data) override {
+        std::ofstream out(root_ / name, std::ios::binary | std::ios::trunc);
+        out << data;
+        return out.good();
+    }
+
+    uint64_t allocationUnit() override {
+#ifndef _WIN32
+        struct statvfs st{};
+        if (::statvfs(root_.c_str(), &st) == 0 && st.f_bsize > 0) return st.f_bsize;
+#endif
+        return 4096;
+    }
+
+private:
+    fs::path        root_;
+    TransferManager copier_;
+};
+
+class FatTarget : public ImageTarget {
+public:
+    explicit FatTarget(Fat32Image& image) : image_(image) {}
+
+    int64_t fileSize(const std::string& name) override {
+        return image_.fileSize(name);
+    }
+
+    bool write(const ManifestChange& change, std::string& sha256, uint64_t& size,
+               std::string& error) override {
+        if (image_.writeFile(change.name, change.srcPath, &sha256, &size)) return true;
+        error = image_.lastError();
+        return false;
+    }
+
+    std::vector<std::string> listFiles() override {
+        return image_.listFiles();
+    }
+
+    bool remove(const std::string& name) override {
+        return image_.remove(name);
+    }
+
+    void pruneDirectories() override {
+        auto dirs = image_.listDirectories();
+        std::sort(dirs.begin(), dirs.end(), [](const std::string& a, const std::string& b) {
+            return a.size() > b.size();
+        });
+        for (const auto& dir : dirs) image_.remove(dir);   // fails if not empty
+    }
+
+    uint64_t freeBytes() override { return image_.freeBytes(); }
+    uint64_t allocationUnit() override { return image_.clusterBytes(); }
+
+    bool readData(const std::string& name, std::string& data) override {
+        return image_.readFile(name, data);
+    }
+
+    bool writeData(const std::string& name, const std::string& data) override {
+        return image_.writeData(name, data);
+    }
+
+private:
+    Fat32Image& image_;
+};
+
+using FileList = std::vector<std::pair<std::string, std::string>>;
+
+/// Bytes a name takes in its FAT directory: the 8.3 entry, plus VFAT
+/// entries (13 UTF-16 units each) unless it is a plain upper-case 8.3 name.
+uint64_t directoryEntryBytes(const std::string& name) {
+    constexpr uint64_t kEntry = 32;
+    auto dot = name.find('.');
+    size_t baseLen = dot == std::string::npos ? name.size() : dot;
+    size_t extLen = dot == std::string::npos ? 0 : name.size() - dot - 1;
+    bool plain = baseLen >= 1 && baseLen <= 8 && extLen <= 3 &&
+                 (dot == std::string::npos || (extLen > 0 && name.find('.', dot + 1) == std::string::npos));
+    for (size_t i = 0; plain && i < name.size(); i++) {
+        unsigned char c = static_cast<unsigned char>(name[i]);
+        plain = i == dot || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                std::strchr("$%'-_@~`!(){}^#&", c) != nullptr;
+    }
+    if (plain) return kEntry;
+
+    size_t units = 0;
+    for (unsigned char c : name) {
+        if ((c & 0xC0) != 0x80) units++;        // one per code point...
+        if (c >= 0xF0) units++;                 // ...two outside the BMP
+    }
+    return kEntry * (1 + (units + 12) / 13);
+}
+
+/// Directory sizes for a set of files, in allocation units. FAT directories
+/// are cluster chains that grow with every entry, so a full directory costs
+/// more than the one cluster it starts with.
+class DirectoryPlan {
+public:
+    explicit DirectoryPlan(uint64_t unit) : unit_(unit) {
+        bytes_[""] = 32;                        // root: the volume label
+    }
+
+    /// Extra bytes adding `name` ("dir/sub/file") would allocate.
+    uint64_t cost(const std::string& name) const { return walk(name, nullptr); }
+
+    /// Add `name` and return what it allocated.
+    uint64_t add(const std::string& name) { return walk(name, &bytes_); }
+
+    /// Everything the directories occupy.
+    uint64_t total() const {
+        uint64_t sum = 0;
+        for (const auto& [_, bytes] : bytes_) sum += clusters(bytes) * unit_;
+        return sum;
+    }
+
+private:
+    static constexpr uint64_t kHeaderBytes = 64;   // "." and ".."
+
+    uint64_t unit_;
+    std::unordered_map<std::string, uint64_t> bytes_;
+
+    uint64_t clusters(uint64_t bytes) const {
+        return std::max<uint64_t>(1, (bytes + unit_ - 1) / unit_);
+    }
+
+    /// Bytes allocated by adding `name`; with `into`, also record it there.
+    uint64_t walk(const std::string& name,
+                  std::unordered_map<std::string, uint64_t>* into) const {
+        // Each directory on the path gains one entry, so one created along
+        // the way holds its header plus that entry
+        uint64_t cost = 0;
+        std::string parent;                     // "" is the root
+        bool parentIsNew = false;
+        for (size_t begin = 0;;) {
+            size_t slash = name.find('/', begin);
+            std::string part = name.substr(begin, slash == std::string::npos ? slash : slash - begin);
+            uint64_t before = parentIsNew ? kHeaderBytes : bytes_.at(parent);
+            uint64_t after = before + directoryEntryBytes(part);
+            cost += (clusters(after) - (parentIsNew ? 0 : clusters(before))) * unit_;
+            if (into) (*into)[parent] = after;
+            if (slash == std::string::npos) return cost;
+
+            std::string dir = parent.empty() ? part : parent + '/' + part;
+            if (!parentIsNew) parentIsNew = bytes_.count(dir) == 0;
+            parent = std::move(dir);
+            begin = slash + 1;
+        }
+    }
+};
+
+/// The subset of `files` that fits in the image. Capacity is the free space
+/// plus what the current files and their directories occupy (they can all
+/// be replaced); each file costs its size rounded up to the allocation unit
+/// plus whatever its directory entries add to the directories' chains.
+/// Files are taken by keepFirst group, newest first, until the next one
+/// doesn't fit; smaller ones further down may still fill the gap.
+FileList fitToCapacity(const FileList& files, ImageTarget& target,
+                       const std::vector<std::string>& keepFirst, uint64_t reserveBytes,
+                       UsbPrepareStats& stats) {
+    const uint64_t unit = std::max<uint64_t>(1, target.allocationUnit());
+    auto allocated = [unit](uint64_t size) { return (size + unit - 1) / unit * unit; };
+
+    uint64_t capacity = target.freeBytes();
+    DirectoryPlan existing(unit);
+    for (const auto& name : target.listFiles()) {
+        int64_t size = target.fileSize(name);
+        if (size > 0) capacity += allocated(static_cast<uint64_t>(size));
+        existing.add(name);
+    }
+    capacity += existing.total();
+    // Slack for rounding, plus room for generated files
+    const uint64_t reserved = unit + allocated(reserveBytes);
+    capacity = capacity > reserved ? capacity - reserved : 0;
+
+    struct Candidate {
+        size_t      index;
+        size_t      rank;
+        int64_t     mtime;
+        uint64_t    size;
+        std::string name;
+    };
+    std::vector<Candidate> candidates;
+    candidates.reserve(files.size());
+    for (size_t i = 0; i < files.size(); i++) {
+        Candidate c{i, keepFirst.size(), 0, 0, ImageManifest::normalizeName(files[i].second)};
+        std::error_code ec;
+        auto size = fs::file_size(files[i].first, ec);
+        if (!ec) c.size = size;
+        auto mtime = fs::last_write_time(files[i].first, ec);
+        if (!ec) c.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+        for (size_t r = 0; r < keepFirst.size(); r++) {
+            if (c.name.compare(0, keepFirst[r].size(), keepFirst[r]) == 0) {
+                c.rank = r;
+                break;
+            }
+        }
+        candidates.push_back(std::move(c));
+    }
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const Candidate& a, const Candidate& b) {
+                         if (a.rank != b.rank) return a.rank < b.rank;
+                         return a.mtime > b.mtime;
+                     });
+
+    std::vector<bool> keep(files.size(), false);
+    DirectoryPlan plan(unit);
+    uint64_t used = plan.total();
+    for (const auto& c : candidates) {
+        uint64_t cost = allocated(c.size) + plan.cost(c.name);
+        if (used + cost > capacity) {
+            stats.evicted++;
+            stats.evictedBytes += c.size;
+            continue;
+        }
+        used += allocated(c.size) + plan.add(c.name);
+        keep[c.index] = true;
+    }
+
+    if (stats.evicted == 0) return files;
+    std::cerr << "[usb] Image full: leaving out " << stats.evicted << " files ("
+              << stats.evictedBytes << " bytes)" << std::endl;
+    FileList kept;
+    kept.reserve(files.size() - stats.evicted);
+    for (size_t i = 0; i < files.size(); i++) {
+        if (keep[i]) kept.push_back(files[i]);
+    }
+    return kept;
+}
+
+/// Host manifest values are tab-separated; keep them on one line.
+std::string escapeField(std::string_view value) {
+    std::string out;
+    out.reserve(value.size());
+    for (char c : value) {
+        switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '\t': out += "\\t"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            default:   out += c;
+        }
+    }
+    return out;
+}
+
+constexpr const char* kHostManifestHeader =
+    "# syncv-manifest 1\tpath\tsize\tsha256\tdevice_id\tdevice_type\tfirmware_version\tkey=value...\n";
+constexpr size_t kHostManifestLineBytes = 160;   // estimate, for capacity planning
+
+/// Write the volume's host manifest: one line per file in the image. The
+/// metadata columns of files whose content was already listed in the
+/// previous manifest are reused, so only new content is parsed.
+void writeHostManifest(const std::string& name, const FileList& files,
+                       const ImageManifest& manifest, ImageTarget& target,
+                       const UsbMetadataProvider& provider) {
+    std::unordered_map<std::string, std::string> known;   // sha256 -> metadata columns
+    std::string previous;
+    if (target.readData(name, previous)) {
+        std::istringstream in(previous);
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            // path \t size \t sha256 \t metadata...
+            size_t a = line.find('\t');
+            size_t b = a == std::string::npos ? a : line.find('\t', a + 1);
+            size_t c = b == std::string::npos ? b : line.find('\t', b + 1);
+            if (c == std::string::npos) continue;
+            known.emplace(line.substr(b + 1, c - b - 1), line.substr(c + 1));
+        }
+    }
+
+    std::vector<std::string> lines;
+    lines.reserve(files.size());
+    for (const auto& [src, dst] : files) {
+        const std::string path = ImageManifest::normalizeName(dst);
+        const ManifestEntry* entry = manifest.find(path);
+        if (!entry || entry->sha256.empty()) continue;   // not in the image
+
+        auto it = known.find(entry->sha256);
+        if (it == known.end()) {
+            std::string columns = "\t\t";
+            if (provider) {
+                DeviceMetadata m = provider(src);
+                if (m.parseSuccessful) {
+                    columns = escapeField(m.deviceId) + '\t' + escapeField(m.deviceType) + '\t' +
+                              escapeField(m.firmwareVersion);
+                    for (const auto& [key, value] : m.fields) {
+                        columns += '\t' + escapeField(key) + '=' + escapeField(value);
+                    }
+                }
+            }
+            it = known.emplace(entry->sha256, std::move(columns)).first;
+        }
+        lines.push_back(escapeField(path) + '\t' + std::to_string(entry->size) + '\t' +
+                        entry->sha256 + '\t' + it->second + '\n');
+    }
+    std::sort(lines.begin(), lines.end());
+
+    std::string text = kHostManifestHeader;
+    for (const auto& line : lines) text += line;
+    if (text != previous && !target.writeData(name, text)) {
+        std::cerr << "[usb] Cannot write host manifest " << name << std::endl;
+    }
+}
+
+/// Bring the image in line with `files`, writing only what the manifest
+/// says is new or changed and removing anything no longer listed. Files
+/// that cannot fit are dropped up front rather than failing mid-copy.
+UsbPrepareStats syncImage(ImageManifest& manifest, const FileList& allFiles,
+                          ImageTarget& target, const UsbGadgetConfig& config,
+                          const UsbMetadataProvider& provider) {
+    UsbPrepareStats stats;
+    const std::string hostManifest = ImageManifest::normalizeName(config.hostManifest);
+    const uint64_t reserve = hostManifest.empty() ? 0 : allFiles.size() * kHostManifestLineBytes;
+    const FileList files = fitToCapacity(allFiles, target, config.keepFirst, reserve, stats);
+
+    // Remove files (at any depth) that are no longer in the set first, so
+    // their space is available to the copies below
+    std::unordered_set<std::string> wanted;
+    wanted.reserve(files.size() + 1);
+    for (const auto& [_, dstName] : files) {
+        wanted.insert(ImageManifest::normalizeName(dstName));
+    }
+    if (!hostManifest.empty()) wanted.insert(hostManifest);
+    for (const auto& name : target.listFiles()) {
+        if (!wanted.count(name) && target.remove(name)) stats.removed++;
+    }
+
+    // The image is the ground truth: forget entries that are missing or
+    // resized there (e.g. the image was replaced), so they get recopied
+    ManifestPlan plan = manifest.plan(files);
+    bool stale = false;
+    for (const auto& name : plan.unchanged) {
+        const ManifestEntry* entry = manifest.find(name);
+        if (!entry || target.fileSize(name) != static_cast<int64_t>(entry->size)) {
+            manifest.erase(name);
+            stale = true;
+        }
+    }
+    if (stale) plan = manifest.plan(files);
+    stats.unchanged = plan.unchanged.size();
+
+    for (const auto& change : plan.changed) {
+        std::string sha256, error;
+        uint64_t size = 0;
+        if (target.write(change, sha256, size, error)) {
+            manifest.record(change, sha256, size);
+            stats.copied++;
+            stats.bytesCopied += size;
+        } else {
+            manifest.erase(change.name);
+            stats.failed++;
+            std::cerr << "[usb] Copy failed: " << change.srcPath << " -> " << change.name
+                      << ": " << error << std::endl;
+        }
+    }
+
+    for (const auto& name : plan.removed) {
+        manifest.erase(name);
+    }
+    target.pruneDirectories();
+
+    if (!hostManifest.empty()) {
+        writeHostManifest(hostManifest, files, manifest, target, provider);
+    }
+    return stats;
+}
+
+uint64_t elapsedUs(std::chrono::steady_clock::time_point since) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - since).count());
+}
+
+/// "850us", "42ms", "3.1s"
+std::string formatUs(uint64_t us) {
+    if (us < 1000) return std::to_string(us) + "us";
+    if (us < 10000000) return std::to_string(us / 1000) + "ms";
+    return std::to_string(us / 1000000) + "." + std::to_string(us / 100000 % 10) + "s";
+}
+
+/// "<dir>/<stem>-b<ext>": where the second image of an A/B pair lives.
+std::string secondImagePath(const std::string& path) {
+    fs::path a(path);
+    return (a.parent_path() / (a.stem().string() + "-b" + a.extension().string())).string();
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// Refresh telemetry
+// ---------------------------------------------------------------------------
+
+void UsbStageStats::record(uint64_t us) {
+    count++;
+    totalUs += us;
+    lastUs = us;
+    maxUs = std::max(maxUs, us);
+    histogram[latency::bucketOf(us, kBuckets)]++;
+}
+
+uint64_t UsbStageStats::percentileUs(double p) const {
+    return latency::percentile(histogram, count, maxUs, p);
+}
+
+const UsbStageStats& UsbRefreshTelemetry::stage(UsbStage s) const {
+    return stages[static_cast<size_t>(s)];
+}
+
+const char* UsbRefreshTelemetry::stageName(UsbStage s) {
+    switch (s) {
+        case UsbStage::Unexpose: return "unexpose";
+        case UsbStage::Mount:    return "mount";
+        case UsbStage::Copy:     return "copy";
+        case UsbStage::Sync:     return "sync";
+        case UsbStage::Unmount:  return "unmount";
+        case UsbStage::Expose:   return "expose";
+        case UsbStage::Swap:     return "swap";
+        case UsbStage::Count:    break;
+    }
+    return "?";
+}
+
+std::string UsbRefreshTelemetry::summary() const {
+    std::ostringstream out;
+    auto line = [&out](const char* name, const UsbStageStats& s) {
+        if (s.count == 0) return;
+        if (out.tellp() > 0) out << "; ";
+        out << name << " n=" << s.count << " p50=" << formatUs(s.percentileUs(50))
+            << " p95=" << formatUs(s.percentileUs(95)) << " max=" << formatUs(s.maxUs);
+    };
+    line("refresh", refresh);
+    for (size_t i = 0; i < stages.size(); i++) {
+        line(stageName(static_cast<UsbStage>(i)), stages[i]);
+    }
+    line("host-down", hostDowntime);
+    return out.str();
+}
+
 UsbGadget::UsbGadget(const UsbGadgetConfig& config)
-    : config_(config) {}
+    : config_(config) {
+    Lun main;
+    main.label  = "SYNCV";
+    main.sizeMB = config_.imageSizeMB;
+    main.slots[0].path = config_.imagePath;
+    main.slots[0].manifestPath = config_.manifestPath.empty() ? config_.imagePath + ".manifest"
+                                                              : config_.manifestPath;
+    main.slots[1].path = config_.imagePathB.empty() ? secondImagePath(config_.imagePath)
+                                                    : config_.imagePathB;
+    main.slots[1].manifestPath = main.slots[1].path + ".manifest";
+    luns_.push_back(std::move(main));
+
+    for (const auto& extra : config_.extraLuns) {
+        Lun lun;
+        lun.prefix = ImageManifest::normalizeName(extra.prefix);
+        if (!lun.prefix.empty() && lun.prefix.back() != '/') lun.prefix += '/';
+        lun.label  = extra.label;
+        lun.sizeMB = extra.imageSizeMB;
+        lun.slots[0].path = extra.imagePath;
+        lun.slots[1].path = secondImagePath(extra.imagePath);
+        for (auto& slot : lun.slots) slot.manifestPath = slot.path + ".manifest";
+        luns_.push_back(std::move(lun));
+    }
+}
+
+UsbGadget::~UsbGadget() {
+#ifdef __linux__
+    // Autoclear detaches the loop device once it is unmounted and closed
+    if (loopFd_ >= 0) ::close(loopFd_);
+#endif
+}
 
 // ---------------------------------------------------------------------------
 // Helpers
@@ -38,44 +633,65 @@ bool UsbGadget::writeFile(const std::string& path, const std::string& content) c
 // Image management
 // ---------------------------------------------------------------------------
 
-bool UsbGadget::createImage() {
-    if (fileExists(config_.imagePath)) {
-        std::cout << "[usb] Image already exists: " << config_.imagePath << std::endl;
+bool UsbGadget::createImage(const Lun& lun, const ImageSlot& slot) {
+    if (fileExists(slot.path)) {
+        std::cout << "[usb] Image already exists: " << slot.path << std::endl;
         return true;
     }
 
     // Ensure parent directory exists
     std::error_code ec;
-    fs::create_directories(fs::path(config_.imagePath).parent_path(), ec);
+    fs::create_directories(fs::path(slot.path).parent_path(), ec);
     if (ec) {
         std::cerr << "[usb] Cannot create image dir: " << ec.message() << std::endl;
         return false;
     }
 
-    std::ostringstream cmd;
-    cmd << "dd if=/dev/zero of=" << config_.imagePath
-        << " bs=1M count=" << config_.imageSizeMB
-        << " status=none 2>/dev/null";
-
-    if (runCommand(cmd.str()) != 0) {
-        std::cerr << "[usb] Failed to create disk image" << std::endl;
+    // Sparse file (ftruncate): no blocks are written or allocated until the
+    // formatter and prepareImage() put data there
+    {
+        std::ofstream out(slot.path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "[usb] Failed to create disk image: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    fs::resize_file(slot.path, lun.sizeMB * 1024 * 1024, ec);
+    if (ec) {
+        std::cerr << "[usb] Failed to size disk image: " << ec.message() << std::endl;
         return false;
     }
-    std::cout << "[usb] Created " << config_.imageSizeMB << " MB image" << std::endl;
+    std::cout << "[usb] Created " << lun.sizeMB << " MB sparse image" << std::endl;
     return true;
 }
 
-bool UsbGadget::formatImage() {
-    std::string cmd = "mkfs.vfat -n SYNCV " + config_.imagePath + " 2>/dev/null";
-    if (runCommand(cmd) != 0) {
+bool UsbGadget::formatImage(const Lun& lun, ImageSlot& slot) {
+    // Same userspace formatter for both modes; the kernel's vfat driver
+    // mounts it just as well as an mkfs.vfat image
+    if (lun.sizeMB < Fat32Image::kMinSizeMB) {
+        std::cerr << "[usb] Image size " << lun.sizeMB << " MB is too small for FAT32 (minimum "
+                  << Fat32Image::kMinSizeMB << " MB)" << std::endl;
+        return false;
+    }
+    if (!Fat32Image::format(slot.path, lun.sizeMB * 1024 * 1024, lun.label)) {
         std::cerr << "[usb] Failed to format image as FAT32" << std::endl;
         return false;
     }
-    std::cout << "[usb] Formatted image as FAT32" << std::endl;
+    return onFormatted(slot);
+}
+
+bool UsbGadget::onFormatted(ImageSlot& slot) {
+    std::cout << "[usb] Formatted " << slot.path << " as FAT32" << std::endl;
+
+    // A fresh filesystem holds none of the files the manifest remembers
+    slot.manifest.clear();
+    slot.manifestLoaded = true;
+    std::error_code ec;
+    fs::remove(slot.manifestPath, ec);
     return true;
 }
 
-bool UsbGadget::mountImage() {
+bool UsbGadget::mountImage(const ImageSlot& slot) {
     std::error_code ec;
     fs::create_directories(config_.mountPoint, ec);
     if (ec) {
@@ -83,23 +699,89 @@ bool UsbGadget::mountImage() {
         return false;
     }
 
-    std::string cmd = "mount -o loop " + config_.imagePath + " " + config_.mountPoint + " 2>/dev/null";
-    if (runCommand(cmd) != 0) {
-        std::cerr << "[usb] Failed to mount image" << std::endl;
+#ifdef __linux__
+    // Attach the image to a free loop device, then mount that
+    int ctl = ::open("/dev/loop-control", O_RDWR | O_CLOEXEC);
+    if (ctl < 0) return sysFail("Cannot open /dev/loop-control");
+    int index = ::ioctl(ctl, LOOP_CTL_GET_FREE);
+    ::close(ctl);
+    if (index < 0) return sysFail("No free loop device");
+
+    const std::string device = "/dev/loop" + std::to_string(index);
+    int loopFd = ::open(device.c_str(), O_RDWR | O_CLOEXEC);
+    if (loopFd < 0) return sysFail("Cannot open " + device);
+    int imageFd = ::open(slot.path.c_str(), O_RDWR | O_CLOEXEC);
+    if (imageFd < 0) {
+        ::close(loopFd);
+        return sysFail("Cannot open " + slot.path);
+    }
+
+    bool attached = false;
+#ifdef LOOP_CONFIGURE
+    loop_config lc{};
+    lc.fd = static_cast<uint32_t>(imageFd);
+    lc.info.lo_flags = LO_FLAGS_AUTOCLEAR;
+    attached = ::ioctl(loopFd, LOOP_CONFIGURE, &lc) == 0;
+#endif
+    if (!attached && ::ioctl(loopFd, LOOP_SET_FD, imageFd) == 0) {
+        // Kernels before 5.8: attach, then set flags separately
+        loop_info64 info{};
+        info.lo_flags = LO_FLAGS_AUTOCLEAR;
+        ::ioctl(loopFd, LOOP_SET_STATUS64, &info);
+        attached = true;
+    }
+    ::close(imageFd);
+    if (!attached) {
+        ::close(loopFd);
+        return sysFail("Cannot attach " + slot.path + " to " + device);
+    }
+
+    if (::mount(device.c_str(), config_.mountPoint.c_str(), "vfat", MS_NOATIME, nullptr) != 0) {
+        sysFail("Failed to mount " + device);
+        ::ioctl(loopFd, LOOP_CLR_FD, 0);
+        ::close(loopFd);
         return false;
     }
+    loopFd_ = loopFd;
+    mountedImage_ = slot.path;
     return true;
+#else
+    (void)slot;
+    std::cerr << "[usb] Loop mounting is only supported on Linux" << std::endl;
+    return false;
+#endif
 }
 
 bool UsbGadget::unmountImage() {
-    // Sync first — flush all pending writes to the image
-    runCommand("sync");
-
-    std::string cmd = "umount " + config_.mountPoint + " 2>/dev/null";
-    if (runCommand(cmd) != 0) {
-        // May already be unmounted; not fatal
-        return true;
+#ifdef __linux__
+    auto start = std::chrono::steady_clock::now();
+    if (loopFd_ >= 0) {
+        // Flush just this filesystem, not every dirty page on the system
+        int dirFd = ::open(config_.mountPoint.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd >= 0) {
+            if (::syncfs(dirFd) != 0) sysFail("syncfs " + config_.mountPoint);
+            ::close(dirFd);
+        }
+        recordStage(UsbStage::Sync, start);
+        start = std::chrono::steady_clock::now();
+    }
+    if (::umount2(config_.mountPoint.c_str(), 0) != 0 && errno != EINVAL && errno != ENOENT) {
+        sysFail("Failed to unmount " + config_.mountPoint);   // not fatal
+    }
+    if (loopFd_ >= 0) {
+        ::ioctl(loopFd_, LOOP_CLR_FD, 0);
+        ::close(loopFd_);
+        loopFd_ = -1;
+        // The loop device wrote through the image's page cache
+        int imageFd = ::open(mountedImage_.c_str(), O_RDONLY | O_CLOEXEC);
+        if (imageFd >= 0) {
+            if (::fsync(imageFd) != 0) sysFail("fsync " + mountedImage_);
+            ::close(imageFd);
+        }
+        mountedImage_.clear();
+        recordStage(UsbStage::Unmount, start);
     }
+#endif
     return true;
 }
 
@@ -109,63 +791,86 @@ bool UsbGadget::unmountImage() {
 
 bool UsbGadget::setupConfigfs() {
     const std::string gadgetDir = "/sys/kernel/config/usb_gadget/" + config_.gadgetName;
+    std::error_code ec;
+    const std::string cfgDir = gadgetDir + "/configs/c.1";
+    const std::string funcDir = gadgetDir + "/functions/mass_storage.usb0";
 
-    // If already configured, skip
-    if (fileExists(gadgetDir + "/UDC")) {
+    // A gadget left by an earlier run is reused, but it may predate LUNs
+    // added to the configuration since: those still need their directories
+    const bool existed = fileExists(gadgetDir + "/UDC");
+    std::string boundUdc;
+    if (existed) {
+        std::ifstream udcFile(gadgetDir + "/UDC");
+        std::getline(udcFile, boundUdc);
         std::cout << "[usb] ConfigFS gadget already exists" << std::endl;
-        return true;
-    }
+    } else {
+        // Create gadget directory structure
+        fs::create_directories(gadgetDir, ec);
+        if (ec) {
+            std::cerr << "[usb] Cannot create configfs gadget — is configfs mounted? "
+                      << "Run: modprobe libcomposite" << std::endl;
+            return false;
+        }
 
-    // Create gadget directory structure
-    std::error_code ec;
-    fs::create_directories(gadgetDir, ec);
-    if (ec) {
-        std::cerr << "[usb] Cannot create configfs gadget — is configfs mounted? "
-                  << "Run: modprobe libcomposite" << std::endl;
-        return false;
+        // Device descriptors
+        writeFile(gadgetDir + "/idVendor",  config_.vendorId);
+        writeFile(gadgetDir + "/idProduct", config_.productId);
+        writeFile(gadgetDir + "/bcdUSB",    "0x0200");
+        writeFile(gadgetDir + "/bcdDevice", "0x0100");
+
+        // English strings (0x409)
+        const std::string strDir = gadgetDir + "/strings/0x409";
+        fs::create_directories(strDir, ec);
+        writeFile(strDir + "/manufacturer", config_.manufacturer);
+        writeFile(strDir + "/product",      config_.product);
+        writeFile(strDir + "/serialnumber", config_.serialNumber);
+
+        // Configuration
+        fs::create_directories(cfgDir, ec);
+        const std::string cfgStrDir = cfgDir + "/strings/0x409";
+        fs::create_directories(cfgStrDir, ec);
+        writeFile(cfgStrDir + "/configuration", "Mass Storage");
+        writeFile(cfgDir + "/MaxPower", "120");
+
+        // Mass storage function
+        fs::create_directories(funcDir, ec);
     }
 
-    // Device descriptors
-    writeFile(gadgetDir + "/idVendor",  config_.vendorId);
-    writeFile(gadgetDir + "/idProduct", config_.productId);
-    writeFile(gadgetDir + "/bcdUSB",    "0x0200");
-    writeFile(gadgetDir + "/bcdDevice", "0x0100");
-
-    // English strings (0x409)
-    const std::string strDir = gadgetDir + "/strings/0x409";
-    fs::create_directories(strDir, ec);
-    writeFile(strDir + "/manufacturer", config_.manufacturer);
-    writeFile(strDir + "/product",      config_.product);
-    writeFile(strDir + "/serialnumber", config_.serialNumber);
-
-    // Configuration
-    const std::string cfgDir = gadgetDir + "/configs/c.1";
-    fs::create_directories(cfgDir, ec);
-    const std::string cfgStrDir = cfgDir + "/strings/0x409";
-    fs::create_directories(cfgStrDir, ec);
-    writeFile(cfgStrDir + "/configuration", "Mass Storage");
-    writeFile(cfgDir + "/MaxPower", "120");
-
-    // Mass storage function
-    const std::string funcDir = gadgetDir + "/functions/mass_storage.usb0";
-    fs::create_directories(funcDir, ec);
-
-    // Configure the LUN (logical unit)
-    const std::string lunDir = funcDir + "/lun.0";
-    // lun.0 is auto-created; set its backing file
-    writeFile(lunDir + "/file",      "");  // clear first
-    writeFile(lunDir + "/removable", "1"); // hotplug-friendly
-    writeFile(lunDir + "/ro",        "1"); // read-only to host (we update offline)
-    writeFile(lunDir + "/nofua",     "1"); // skip Force Unit Access — reduces timeouts
+    // Configure the LUNs (logical units); lun.0 is auto-created, the
+    // others appear when their directory is made. A bound gadget is
+    // unbound first so the host never sees a half-built function.
+    bool unbound = false;
+    for (size_t i = 0; i < luns_.size(); i++) {
+        const std::string dir = lunDir(i);
+        if (existed && fileExists(dir)) continue;
+        if (!boundUdc.empty() && !unbound) {
+            writeFile(gadgetDir + "/UDC", "");
+            unbound = true;
+        }
+        fs::create_directories(dir, ec);
+        writeFile(dir + "/file",      "");  // clear first
+        writeFile(dir + "/removable", "1"); // hotplug-friendly
+        writeFile(dir + "/ro",        "1"); // read-only to host (we update offline)
+        writeFile(dir + "/nofua",     "1"); // skip Force Unit Access — reduces timeouts
+        if (existed) std::cout << "[usb] Added LUN " << i << " to existing gadget" << std::endl;
+    }
 
     // Link function into configuration
     const std::string linkPath = cfgDir + "/mass_storage.usb0";
     if (!fileExists(linkPath)) {
-        std::string cmd = "ln -s " + funcDir + " " + linkPath + " 2>/dev/null";
-        runCommand(cmd);
+#ifndef _WIN32
+        if (::symlink(funcDir.c_str(), linkPath.c_str()) != 0) {
+            return sysFail("Cannot link function into configuration");
+        }
+#endif
     }
 
-    std::cout << "[usb] ConfigFS gadget skeleton created" << std::endl;
+    if (unbound && !writeFile(gadgetDir + "/UDC", boundUdc)) {
+        std::cerr << "[usb] Failed to rebind gadget to UDC " << boundUdc << std::endl;
+        return false;
+    }
+
+    if (!existed) std::cout << "[usb] ConfigFS gadget skeleton created" << std::endl;
     initialized_ = true;
     return true;
 }
@@ -179,16 +884,25 @@ bool UsbGadget::teardownConfigfs() {
 
     // Remove symlink
     const std::string linkPath = gadgetDir + "/configs/c.1/mass_storage.usb0";
-    if (fileExists(linkPath)) {
-        runCommand("rm " + linkPath + " 2>/dev/null");
+#ifndef _WIN32
+    if (::unlink(linkPath.c_str()) != 0 && errno != ENOENT) {
+        sysFail("Cannot remove " + linkPath);
     }
 
     // Remove directories in reverse order (configfs requires this)
-    runCommand("rmdir " + gadgetDir + "/configs/c.1/strings/0x409 2>/dev/null");
-    runCommand("rmdir " + gadgetDir + "/configs/c.1 2>/dev/null");
-    runCommand("rmdir " + gadgetDir + "/functions/mass_storage.usb0 2>/dev/null");
-    runCommand("rmdir " + gadgetDir + "/strings/0x409 2>/dev/null");
-    runCommand("rmdir " + gadgetDir + " 2>/dev/null");
+    for (size_t i = luns_.size() - 1; i > 0; i--) {
+        if (::rmdir(lunDir(i).c_str()) != 0 && errno != ENOENT) {
+            sysFail("Cannot remove " + lunDir(i));
+        }
+    }
+    for (const char* dir : {"/configs/c.1/strings/0x409", "/configs/c.1",
+                            "/functions/mass_storage.usb0", "/strings/0x409", ""}) {
+        const std::string path = gadgetDir + dir;
+        if (::rmdir(path.c_str()) != 0 && errno != ENOENT) {
+            sysFail("Cannot remove " + path);
+        }
+    }
+#endif
 
     std::cout << "[usb] ConfigFS gadget removed" << std::endl;
     exposed_ = false;
@@ -203,12 +917,28 @@ bool UsbGadget::teardownConfigfs() {
 bool UsbGadget::init() {
     std::cout << "[usb] Initializing USB gadget..." << std::endl;
 
-    // Load required kernel modules (idempotent)
-    runCommand("modprobe libcomposite 2>/dev/null");
-    runCommand("modprobe dwc2 2>/dev/null");
+    // Load required kernel modules; usually already loaded from /etc/modules,
+    // in which case no process is spawned
+    for (const char* module : {"libcomposite", "dwc2"}) {
+        if (!fileExists(std::string("/sys/module/") + module)) {
+            runCommand(std::string("modprobe ") + module + " 2>/dev/null");
+        }
+    }
 
-    if (!createImage())  return false;
-    if (!formatImage())  return false;
+    for (auto& lun : luns_) {
+        for (int i = 0; i < slotCount(); i++) {
+            if (config_.userspaceFat) {
+                // Keep a valid image across restarts so the manifest stays usable
+                Fat32Image existing;
+                if (!existing.open(lun.slots[i].path) && !formatImage(lun, lun.slots[i])) {
+                    return false;
+                }
+            } else {
+                if (!createImage(lun, lun.slots[i]))  return false;
+                if (!formatImage(lun, lun.slots[i]))  return false;
+            }
+        }
+    }
     if (!setupConfigfs()) return false;
 
     std::cout << "[usb] USB gadget ready" << std::endl;
@@ -217,51 +947,139 @@ bool UsbGadget::init() {
 
 bool UsbGadget::prepareImage(
     const std::vector<std::pair<std::string, std::string>>& files) {
+    std::vector<size_t> all(luns_.size());
+    for (size_t i = 0; i < all.size(); i++) all[i] = i;
+    return prepareLuns(all, splitByLun(files), false);
+}
+
+bool UsbGadget::prepareLuns(const std::vector<size_t>& which,
+                            const std::vector<FileList>& parts, bool swap) {
+    UsbPrepareStats total;
+    bool ok = true;
+    for (size_t i : which) {
+        Lun& lun = luns_[i];
+        bool prepared = prepareSlotImage(lun, lun.slots[prepareSlot(lun)], parts[i]);
+        total.copied       += lastPrepare_.copied;
+        total.unchanged    += lastPrepare_.unchanged;
+        total.removed      += lastPrepare_.removed;
+        total.failed       += lastPrepare_.failed;
+        total.bytesCopied  += lastPrepare_.bytesCopied;
+        total.evicted      += lastPrepare_.evicted;
+        total.evictedBytes += lastPrepare_.evictedBytes;
+        if (prepared && swap && !swapImages(i)) {
+            std::cerr << "[usb] Failed to swap in LUN " << i << std::endl;
+            prepared = false;
+        }
+        ok = prepared && ok;
+    }
+    lastPrepare_ = total;
+    return ok;
+}
 
-    if (!mountImage()) return false;
+int UsbGadget::slotCount() const {
+    return config_.abImages ? 2 : 1;
+}
 
-    int copied = 0;
-    for (const auto& [src, dstName] : files) {
-        std::string dst = config_.mountPoint + "/" + dstName;
-        std::error_code ec;
-        fs::copy_file(src, dst, fs::copy_options::overwrite_existing, ec);
-        if (ec) {
-            std::cerr << "[usb] Copy failed: " << src << " -> " << dstName
-                      << ": " << ec.message() << std::endl;
-        } else {
-            ++copied;
+int UsbGadget::prepareSlot(const Lun& lun) const {
+    // The exposed image is never written; with A/B the other one is free
+    return (config_.abImages && exposed_) ? 1 - lun.active : lun.active;
+}
+
+std::vector<UsbGadget::FileList> UsbGadget::splitByLun(const FileList& files) const {
+    std::vector<FileList> parts(luns_.size());
+    for (const auto& [src, dst] : files) {
+        const std::string name = ImageManifest::normalizeName(dst);
+        size_t target = 0;
+        for (size_t i = 1; i < luns_.size(); i++) {
+            if (name.compare(0, luns_[i].prefix.size(), luns_[i].prefix) == 0) {
+                target = i;
+                break;
+            }
+        }
+        parts[target].emplace_back(src, name.substr(luns_[target].prefix.size()));
+    }
+    return parts;
+}
+
+std::string UsbGadget::lunDir(size_t lun) const {
+    return "/sys/kernel/config/usb_gadget/" + config_.gadgetName +
+           "/functions/mass_storage.usb0/lun." + std::to_string(lun);
+}
+
+bool UsbGadget::prepareSlotImage(const Lun& lun, ImageSlot& slot, const FileList& files) {
+    const std::string fingerprint = UsbRefreshGate::fingerprint(files);
+
+    if (config_.incremental && !slot.manifestLoaded) {
+        if (!slot.manifest.load(slot.manifestPath)) {
+            std::cerr << "[usb] Cannot read image manifest — full copy" << std::endl;
         }
+        slot.manifestLoaded = true;
+    }
+    if (!config_.incremental) {
+        slot.manifest.clear();
     }
 
-    // Clean files that are no longer in the source set
-    std::error_code ec;
-    for (auto& entry : fs::directory_iterator(config_.mountPoint, ec)) {
-        if (!entry.is_regular_file()) continue;
-        std::string name = entry.path().filename().string();
-        bool found = false;
-        for (const auto& [_, dstName] : files) {
-            if (dstName == name) { found = true; break; }
+    auto start = std::chrono::steady_clock::now();
+    if (config_.userspaceFat) {
+        Fat32Image image;
+        if (!image.open(slot.path)) {
+            // Missing or not ours (e.g. made by mkfs.vfat): lay out a fresh one
+            std::cout << "[usb] " << image.lastError() << " — formatting" << std::endl;
+            if (!formatImage(lun, slot) || !image.open(slot.path)) {
+                std::cerr << "[usb] Cannot open image: " << image.lastError() << std::endl;
+                return false;
+            }
         }
-        if (!found) {
-            fs::remove(entry.path(), ec);
+        recordStage(UsbStage::Mount, start);
+
+        start = std::chrono::steady_clock::now();
+        FatTarget target(image);
+        lastPrepare_ = syncImage(slot.manifest, files, target, config_, metadataProvider_);
+        recordStage(UsbStage::Copy, start);
+
+        start = std::chrono::steady_clock::now();
+        if (!image.flush()) {
+            std::cerr << "[usb] Failed to write image: " << image.lastError() << std::endl;
+            return false;
         }
+        recordStage(UsbStage::Sync, start);
+    } else {
+        if (!mountImage(slot)) return false;
+        recordStage(UsbStage::Mount, start);
+
+        start = std::chrono::steady_clock::now();
+        MountedTarget target(config_.mountPoint);
+        lastPrepare_ = syncImage(slot.manifest, files, target, config_, metadataProvider_);
+        recordStage(UsbStage::Copy, start);
+
+        if (!unmountImage()) return false;   // times Sync and Unmount itself
     }
 
-    std::cout << "[usb] Prepared image: " << copied << "/" << files.size()
-              << " files copied" << std::endl;
+    std::cout << "[usb] Prepared " << slot.path << ": " << lastPrepare_.copied << " copied ("
+              << lastPrepare_.bytesCopied << " bytes), " << lastPrepare_.unchanged
+              << " unchanged, " << lastPrepare_.removed << " removed";
+    if (lastPrepare_.failed) std::cout << ", " << lastPrepare_.failed << " failed";
+    if (lastPrepare_.evicted) std::cout << ", " << lastPrepare_.evicted << " left out (image full)";
+    std::cout << std::endl;
 
-    if (!unmountImage()) return false;
+    // Only after the data is flushed may the manifest claim it is there
+    if (config_.incremental && !slot.manifest.save(slot.manifestPath)) {
+        std::cerr << "[usb] Cannot write image manifest " << slot.manifestPath << std::endl;
+    }
+    // Failed copies are retried on the next refresh, even with no changes
+    slot.fingerprint = lastPrepare_.failed ? std::string() : fingerprint;
     return true;
 }
 
 bool UsbGadget::expose() {
     const std::string gadgetDir = "/sys/kernel/config/usb_gadget/" + config_.gadgetName;
-    const std::string lunFile   = gadgetDir + "/functions/mass_storage.usb0/lun.0/file";
 
-    // Point the LUN at our image
-    if (!writeFile(lunFile, config_.imagePath)) {
-        std::cerr << "[usb] Cannot set LUN backing file" << std::endl;
-        return false;
+    // Point each LUN at its image
+    for (size_t i = 0; i < luns_.size(); i++) {
+        if (!writeFile(lunDir(i) + "/file", luns_[i].slots[luns_[i].active].path)) {
+            std::cerr << "[usb] Cannot set backing file of LUN " << i << std::endl;
+            return false;
+        }
     }
 
     // Find the UDC (USB Device Controller) name
@@ -283,6 +1101,10 @@ bool UsbGadget::expose() {
     }
 
     exposed_ = true;
+    if (hostDown_) {
+        telemetry_.hostDowntime.record(elapsedUs(downSince_));
+        hostDown_ = false;
+    }
     std::cout << "[usb] Gadget exposed on UDC " << udc
               << " — host sees pendrive" << std::endl;
     return true;
@@ -296,10 +1118,14 @@ bool UsbGadget::unexpose() {
     // Unbind from UDC (host will see device disconnect)
     writeFile(gadgetDir + "/UDC", "");
 
-    // Clear LUN backing file
-    writeFile(gadgetDir + "/functions/mass_storage.usb0/lun.0/file", "");
+    // Clear LUN backing files
+    for (size_t i = 0; i < luns_.size(); i++) {
+        writeFile(lunDir(i) + "/file", "");
+    }
 
     exposed_ = false;
+    hostDown_ = true;
+    downSince_ = std::chrono::steady_clock::now();
     std::cout << "[usb] Gadget unexposed — host disconnected" << std::endl;
     return true;
 }
@@ -307,39 +1133,181 @@ bool UsbGadget::unexpose() {
 bool UsbGadget::refresh(
     const std::vector<std::pair<std::string, std::string>>& files) {
 
-    std::cout << "[usb] Refreshing USB drive contents..." << std::endl;
+    // Only LUNs whose file set differs from what the host sees need work
+    auto parts = splitByLun(files);
+    std::vector<size_t> changed;
+    for (size_t i = 0; i < luns_.size(); i++) {
+        const Lun& lun = luns_[i];
+        const std::string& current = lun.slots[lun.active].fingerprint;
+        if (current.empty() || current != UsbRefreshGate::fingerprint(parts[i])) {
+            changed.push_back(i);
+        }
+    }
+    lastPrepare_ = UsbPrepareStats{};
+    if (changed.empty()) {
+        telemetry_.skipped++;
+        std::cout << "[usb] USB drive contents unchanged — nothing to refresh" << std::endl;
+        return true;
+    }
+
+    std::cout << "[usb] Refreshing USB drive contents (" << changed.size() << " of "
+              << luns_.size() << " LUNs)..." << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    bool ok = refreshLuns(changed, parts);
+    telemetry_.refresh.record(elapsedUs(start));
+    if (!ok) telemetry_.failures++;
+    return ok;
+}
+
+bool UsbGadget::refreshLuns(const std::vector<size_t>& changed,
+                            const std::vector<FileList>& parts) {
+    if (config_.abImages && exposed_) {
+        // The host keeps reading the active images while the others are
+        // prepared; each changed LUN is swapped as soon as it is ready
+        if (!prepareLuns(changed, parts, true)) {
+            std::cerr << "[usb] Failed to refresh standby image — keeping current one" << std::endl;
+            return false;
+        }
+        std::cout << "[usb] USB drive refreshed successfully" << std::endl;
+        return true;
+    }
 
     // Step 1: Disconnect from host
+    auto start = std::chrono::steady_clock::now();
     if (!unexpose()) {
         std::cerr << "[usb] Failed to unexpose — aborting refresh" << std::endl;
         return false;
     }
+    recordStage(UsbStage::Unexpose, start);
 
-    // Step 2: Copy fresh files into image
-    if (!prepareImage(files)) {
+    // Step 2: Copy fresh files into the changed images
+    if (!prepareLuns(changed, parts, false)) {
         std::cerr << "[usb] Failed to prepare image — re-exposing stale data" << std::endl;
         expose();  // best effort: re-expose whatever we had
         return false;
     }
 
     // Step 3: Re-expose to host with updated contents
+    start = std::chrono::steady_clock::now();
     if (!expose()) {
         std::cerr << "[usb] Failed to re-expose after refresh" << std::endl;
         return false;
     }
+    recordStage(UsbStage::Expose, start);
 
     std::cout << "[usb] USB drive refreshed successfully" << std::endl;
     return true;
 }
 
+const UsbPrepareStats& UsbGadget::getLastPrepareStats() const {
+    return lastPrepare_;
+}
+
+bool UsbGadget::swapImages(size_t index) {
+    Lun& lun = luns_[index];
+    const std::string dir = lunDir(index);
+    const int next = 1 - lun.active;
+    auto start = std::chrono::steady_clock::now();
+
+    // The LUN is removable: eject + insert is a media change, so the host
+    // keeps the device and just re-reads the volume
+    bool swapped = writeFile(dir + "/forced_eject", "1") &&
+                   writeFile(dir + "/file", lun.slots[next].path);
+    if (swapped) {
+        lun.active = next;
+        // The medium is gone between eject and insert
+        telemetry_.hostDowntime.record(elapsedUs(start));
+    } else {
+        // Older kernels: a quick unbind/rebind around the swap
+        unexpose();
+        lun.active = next;
+        swapped = expose();
+    }
+
+    recordStage(UsbStage::Swap, start);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cout << "[usb] LUN " << index << " swapped to " << lun.slots[lun.active].path
+              << " in " << ms << " ms" << std::endl;
+    return swapped;
+}
+
+const std::string& UsbGadget::activeImagePath(size_t lun) const {
+    return luns_[lun].slots[luns_[lun].active].path;
+}
+
+size_t UsbGadget::lunCount() const {
+    return luns_.size();
+}
+
 bool UsbGadget::isExposed() const {
     return exposed_;
 }
 
+uint64_t UsbGadget::hostReadBytes() const {
+#ifdef __linux__
+    if (!exposed_) return 0;
+
+    // f_mass_storage serves the host from a kernel thread that reads the
+    // backing file with vfs_read(), so its rchar counts the host's reads
+    auto readCounter = [](int pid, uint64_t& rchar) {
+        std::ifstream io("/proc/" + std::to_string(pid) + "/io");
+        std::string key;
+        while (io >> key) {
+            if (key == "rchar:") return static_cast<bool>(io >> rchar);
+            io.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+        return false;
+    };
+
+    uint64_t rchar = 0;
+    if (storagePid_ > 0 && readCounter(storagePid_, rchar)) return rchar;
+
+    storagePid_ = -1;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator("/proc", ec)) {
+        const std::string pid = entry.path().filename().string();
+        if (pid.empty() || !std::isdigit(static_cast<unsigned char>(pid[0]))) continue;
+        std::ifstream comm(entry.path() / "comm");
+        std::string name;
+        if (std::getline(comm, name) && name == "file-storage") {
+            storagePid_ = std::stoi(pid);
+            if (readCounter(storagePid_, rchar)) return rchar;
+        }
+    }
+#endif
+    return 0;
+}
+
+void UsbGadget::recordStage(UsbStage stage, std::chrono::steady_clock::time_point start) {
+    telemetry_.stages[static_cast<size_t>(stage)].record(elapsedUs(start));
+}
+
+void UsbGadget::setMetadataProvider(UsbMetadataProvider provider) {
+    metadataProvider_ = std::move(provider);
+}
+
+const UsbRefreshTelemetry& UsbGadget::getTelemetry() const {
+    return telemetry_;
+}
+
 std::string UsbGadget::getStatus() const {
-    if (!initialized_) return "not initialized";
-    if (exposed_)      return "exposed (host sees pendrive)";
-    return "ready (not exposed)";
+    std::string status;
+    if (!initialized_)  status = "not initialized";
+    else if (exposed_)  status = "exposed (host sees pendrive)";
+    else                status = "ready (not exposed)";
+
+    const auto& t = telemetry_;
+    if (t.refresh.count > 0) {
+        status += ", " + std::to_string(t.refresh.count) + " refreshes (last " +
+                  formatUs(t.refresh.lastUs) + ", p95 " + formatUs(t.refresh.percentileUs(95)) + ")";
+    }
+    if (t.hostDowntime.count > 0) {
+        status += ", host downtime " + formatUs(t.hostDowntime.totalUs) + " total (last " +
+                  formatUs(t.hostDowntime.lastUs) + ")";
+    }
+    return status;
 }
 
 void UsbGadget::cleanup() {
@@ -1,12 +1,29 @@
 #pragma once
 
+#include "ImageManifest.h"
+#include "LatencyHistogram.h"
+#include "MetadataExtractor.h"
+
 #include <string>
 #include <vector>
+#include <array>
+#include <chrono>
 #include <cstdint>
 #include <utility>
+#include <functional>
 
 namespace syncv {
 
+/// An additional logical unit: files whose destination name starts with
+/// `prefix` go to this LUN's own image (prefix stripped) instead of the
+/// main one, and are prepared and swapped independently of it.
+struct UsbLunConfig {
+    std::string prefix;                 // e.g. "firmware/"
+    std::string imagePath;
+    uint64_t    imageSizeMB = 64;
+    std::string label       = "SYNCV";  // FAT volume label (11 chars max)
+};
+
 /// Configuration for the USB mass-storage gadget.
 struct UsbGadgetConfig {
     std::string imagePath    = "/var/syncv/usb/drive.img";  // FAT32 backing file
@@ -18,6 +35,68 @@ struct UsbGadgetConfig {
     std::string manufacturer = "SyncV";
     std::string product      = "SyncV Drive";
     std::string serialNumber = "000000000001";
+    bool        incremental  = true;   // copy only files that changed since the last prepare
+    bool        userspaceFat = true;   // write the FAT32 image directly (no loop mount / root)
+    std::string manifestPath;          // record of image contents (default: imagePath + ".manifest")
+    bool        abImages     = false;  // prepare a second image while the first is exposed, then swap
+    std::string imagePathB;            // second image (default: "<name>-b<ext>" next to imagePath)
+    // When the files don't all fit, names starting with these prefixes are
+    // kept first (in list order); within each group the newest files win
+    std::vector<std::string> keepFirst = {"firmware/"};
+    std::vector<UsbLunConfig> extraLuns;   // lun.1, lun.2, ... (lun.0 is imagePath)
+    // Written at the root of every volume for host tools; "" = none
+    std::string hostManifest = "SYNCV-MANIFEST.TSV";
+};
+
+/// Parsed metadata for a source file, for the host manifest. Only called
+/// for files whose content is new to the volume.
+using UsbMetadataProvider = std::function<DeviceMetadata(const std::string& srcPath)>;
+
+/// What the last prepareImage() did.
+struct UsbPrepareStats {
+    size_t   copied      = 0;
+    size_t   unchanged   = 0;   // already in the image, skipped
+    size_t   removed     = 0;
+    size_t   failed      = 0;
+    uint64_t bytesCopied = 0;
+    size_t   evicted      = 0;  // left out because the image is full
+    uint64_t evictedBytes = 0;
+};
+
+/// Stages of prepareImage()/refresh() that are timed separately. With the
+/// userspace FAT writer, Mount is opening the image and Sync is flushing it.
+enum class UsbStage { Unexpose, Mount, Copy, Sync, Unmount, Expose, Swap, Count };
+
+/// Durations of one stage (or of host downtime) over many refreshes, in a
+/// log-linear histogram of microseconds.
+struct UsbStageStats {
+    static constexpr size_t kBuckets = 36 * latency::kSubBuckets;  // up to ~2^36 us (~19 h)
+
+    uint64_t count   = 0;
+    uint64_t totalUs = 0;
+    uint64_t lastUs  = 0;
+    uint64_t maxUs   = 0;
+    std::array<uint64_t, kBuckets> histogram{};
+
+    void record(uint64_t us);
+
+    /// Upper bound of the bucket holding the p-th percentile (p in [0, 100]).
+    uint64_t percentileUs(double p) const;
+};
+
+/// Where refresh time goes and how long the host goes without a medium.
+struct UsbRefreshTelemetry {
+    std::array<UsbStageStats, static_cast<size_t>(UsbStage::Count)> stages;
+    UsbStageStats refresh;        // whole refresh() calls that did work
+    UsbStageStats hostDowntime;   // each stretch the host saw no (or no new) medium
+    uint64_t      skipped  = 0;   // refresh() calls with nothing to do
+    uint64_t      failures = 0;
+
+    const UsbStageStats& stage(UsbStage s) const;
+    static const char* stageName(UsbStage s);
+
+    /// One line per refresh: "copy n=4 p50=12ms p95=40ms max=41ms; ...".
+    std::string summary() const;
 };
 
 /// Manages the Pi Zero W USB mass-storage gadget via Linux configfs.
@@ -27,9 +106,21 @@ struct UsbGadgetConfig {
 /// occur when the backing file is modified during a host transfer.
 ///
 ///   1. unexpose()        — disconnect from host
-///   2. prepareImage()    — mount locally, copy fresh files, sync
+///   2. prepareImage()    — write fresh files into the image
 ///   3. expose()          — reconnect so host sees updated pendrive
 ///
+/// Every volume carries a host manifest (hostManifest) listing each file's
+/// path, size, SHA-256 and device metadata, so host tools can diff it
+/// instead of re-reading and re-hashing the drive.
+///
+/// By default the FAT32 image is built in userspace (Fat32Image), so
+/// preparing it needs neither root nor a loop mount.  With abImages the
+/// host keeps reading the active image while the other one is prepared;
+/// refresh() then only swaps the LUN's backing file.
+///
+/// With extraLuns the host sees several drives (e.g. logs and firmware).
+/// refresh() only prepares and swaps the LUNs whose files changed.
+///
 class UsbGadget {
 public:
     explicit UsbGadget(const UsbGadgetConfig& config = {});
@@ -38,36 +129,111 @@ public:
     /// Returns false if any step fails (not running as root, etc.).
     bool init();
 
-    /// Copy files into the disk image (mounts locally, copies, syncs, unmounts).
+    /// Copy files into the disk image: written directly with Fat32Image, or
+    /// (userspaceFat = false) via a loop mount, copy, sync and unmount.
+    /// In incremental mode only files that are new or changed since the last
+    /// prepare are written; files no longer listed are removed at any depth.
+    /// If the files would not fit, the lowest-priority ones (see keepFirst,
+    /// then oldest first) are left out before anything is copied.
+    /// With abImages, while exposed this prepares the inactive image; the
+    /// next refresh() swaps it in.
     /// @param files  vector of (source_path, destination_filename) pairs.
     bool prepareImage(const std::vector<std::pair<std::string, std::string>>& files);
 
+    /// Source of device metadata for the host manifest (optional).
+    void setMetadataProvider(UsbMetadataProvider provider);
+
     /// Expose the image to the USB host (start gadget).
     bool expose();
 
     /// Disconnect from the USB host (stop gadget).
     bool unexpose();
 
-    /// Full refresh cycle: unexpose → prepare → expose.
+    /// Full refresh cycle: unexpose → prepare → expose. With abImages and
+    /// the gadget exposed: prepare the inactive image → swap. Only LUNs
+    /// whose file set changed since they were last prepared are touched;
+    /// if none did, nothing happens.
     bool refresh(const std::vector<std::pair<std::string, std::string>>& files);
 
     /// True when the gadget is actively presented to the host.
     bool isExposed() const;
 
+    /// Backing file the host sees (or will see on expose()) on a LUN.
+    const std::string& activeImagePath(size_t lun = 0) const;
+
+    /// Number of LUNs: 1 + extraLuns.
+    size_t lunCount() const;
+
+    /// Counters from the most recent prepareImage() or refresh(), summed
+    /// over the LUNs it prepared.
+    const UsbPrepareStats& getLastPrepareStats() const;
+
+    /// Bytes the kernel has read from the backing file on the host's behalf
+    /// (the mass-storage worker thread's read counter). 0 when unknown.
+    /// The value only matters as a difference between two calls.
+    uint64_t hostReadBytes() const;
+
+    /// Stage timings and host downtime since construction.
+    const UsbRefreshTelemetry& getTelemetry() const;
+
     /// Human-readable status string for logging.
     std::string getStatus() const;
 
     /// Tear down configfs gadget and clean up mounts.
     void cleanup();
 
+    ~UsbGadget();
+    UsbGadget(const UsbGadget&) = delete;
+    UsbGadget& operator=(const UsbGadget&) = delete;
+
 private:
     UsbGadgetConfig config_;
     bool exposed_     = false;
     bool initialized_ = false;
-
-    bool createImage();
-    bool formatImage();
-    bool mountImage();
+    UsbPrepareStats lastPrepare_;
+    UsbRefreshTelemetry telemetry_;
+    UsbMetadataProvider metadataProvider_;
+    std::chrono::steady_clock::time_point downSince_;   // set while unexposed by us
+    bool hostDown_ = false;
+
+    /// One backing image and the manifest of what it holds.
+    struct ImageSlot {
+        std::string   path;
+        std::string   manifestPath;
+        ImageManifest manifest;
+        bool          manifestLoaded = false;
+        std::string   fingerprint;      // file set last prepared into it
+    };
+    /// A logical unit the host sees as a drive, and its image(s).
+    struct Lun {
+        std::string prefix;             // "" for lun.0: whatever no other LUN claims
+        std::string label;
+        uint64_t    sizeMB = 0;
+        ImageSlot   slots[2];
+        int         active = 0;
+    };
+    using FileList = std::vector<std::pair<std::string, std::string>>;
+    std::vector<Lun> luns_;
+
+    int         loopFd_ = -1;      // loop device of the mounted image, if any
+    std::string mountedImage_;
+    mutable int storagePid_ = -1;  // "file-storage" kernel thread, once found
+
+    int  slotCount() const;
+    int  prepareSlot(const Lun& lun) const;
+    std::vector<FileList> splitByLun(const FileList& files) const;
+    bool refreshLuns(const std::vector<size_t>& changed, const std::vector<FileList>& parts);
+    bool prepareLuns(const std::vector<size_t>& which, const std::vector<FileList>& parts,
+                     bool swap);
+    bool prepareSlotImage(const Lun& lun, ImageSlot& slot, const FileList& files);
+    bool swapImages(size_t lun);
+    bool onFormatted(ImageSlot& slot);
+    std::string lunDir(size_t lun) const;
+    void recordStage(UsbStage stage, std::chrono::steady_clock::time_point start);
+
+    bool createImage(const Lun& lun, const ImageSlot& slot);
+    bool formatImage(const Lun& lun, ImageSlot& slot);
+    bool mountImage(const ImageSlot& slot);
     bool unmountImage();
     bool setupConfigfs();
     bool teardownConfigfs();
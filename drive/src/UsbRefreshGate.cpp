@@ -0,0 +1,93 @@
+#include "UsbRefreshGate.h"
+#include "HashVerifier.h"
+
+#include <filesystem>
+#include <algorithm>
+
+namespace fs = std::filesystem;
+
+namespace syncv {
+
+UsbRefreshGate::UsbRefreshGate(const UsbRefreshPolicy& policy)
+    : policy_(policy) {}
+
+std::string UsbRefreshGate::fingerprint(
+    const std::vector<std::pair<std::string, std::string>>& files) {
+    // Size and mtime stand in for content here; prepareImage() re-hashes
+    // whatever actually gets copied
+    std::vector<std::string> lines;
+    lines.reserve(files.size());
+    for (const auto& [src, name] : files) {
+        std::error_code ec;
+        auto size = fs::file_size(src, ec);
+        if (ec) size = 0;
+        auto mtime = fs::last_write_time(src, ec);
+        long long ticks = ec ? 0 : static_cast<long long>(mtime.time_since_epoch().count());
+        lines.push_back(name + '\t' + src + '\t' + std::to_string(size) + '\t' +
+                        std::to_string(ticks) + '\n');
+    }
+    std::sort(lines.begin(), lines.end());
+
+    std::string all;
+    for (const auto& line : lines) all += line;
+    HashVerifier hasher;
+    return hasher.hashString(all);
+}
+
+bool UsbRefreshGate::shouldRefresh(const std::string& fingerprint, uint64_t hostReadBytes,
+                                   Clock::time_point now) {
+    // Sample the host's activity on every call, so "busy" always means
+    // "read something since the previous poll"
+    bool hostBusy = haveReadBytes_ && hostReadBytes != lastReadBytes_;
+    lastReadBytes_ = hostReadBytes;
+    haveReadBytes_ = true;
+
+    if (fingerprint == applied_) {
+        seen_ = fingerprint;
+        pending_ = false;
+        return false;
+    }
+
+    if (fingerprint != seen_) {
+        seen_ = fingerprint;
+        changedAt_ = now;
+        if (!pending_) pendingSince_ = now;
+        pending_ = true;
+    }
+
+    if (now - changedAt_ < std::chrono::seconds(policy_.debounceSeconds)) return false;
+    if (refreshed_ && now - lastRefresh_ < std::chrono::seconds(policy_.minIntervalSeconds)) {
+        return false;
+    }
+    if (policy_.deferWhileHostReads && hostBusy &&
+        now - pendingSince_ < std::chrono::seconds(policy_.maxDeferSeconds)) {
+        return false;
+    }
+    return true;
+}
+
+void UsbRefreshGate::markRefreshed(const std::string& fingerprint, Clock::time_point now) {
+    applied_ = fingerprint;
+    seen_ = fingerprint;
+    pending_ = false;
+    refreshed_ = true;
+    lastRefresh_ = now;
+}
+
+void UsbRefreshGate::markAttempted(Clock::time_point now) {
+    applied_.clear();
+    if (!pending_) pendingSince_ = now;
+    pending_ = true;
+    refreshed_ = true;
+    lastRefresh_ = now;
+}
+
+bool UsbRefreshGate::pending() const {
+    return pending_;
+}
+
+const UsbRefreshPolicy& UsbRefreshGate::policy() const {
+    return policy_;
+}
+
+} // namespace syncv
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+
+namespace syncv {
+
+/// When a USB refresh is allowed to run.
+struct UsbRefreshPolicy {
+    int  debounceSeconds      = 0;     // file set must be unchanged this long
+    int  minIntervalSeconds   = 60;    // at least this long between refreshes
+    bool deferWhileHostReads  = true;  // hold off while the host is reading
+    int  maxDeferSeconds      = 300;   // ...but never longer than this
+};
+
+/// Decides whether the USB image needs refreshing, so the host only sees
+/// a media change (or reconnect) when the exposed files actually changed.
+///
+///   - fingerprint() digests the file set (names, sizes, mtimes); an
+///     unchanged fingerprint never triggers a refresh
+///   - a changed fingerprint waits for debounceSeconds of stability and
+///     minIntervalSeconds since the previous refresh
+///   - while the host's read counter keeps moving the refresh is deferred,
+///     up to maxDeferSeconds after the change was first seen
+class UsbRefreshGate {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit UsbRefreshGate(const UsbRefreshPolicy& policy = {});
+
+    /// Digest of (source, name) pairs; order-independent.
+    static std::string fingerprint(
+        const std::vector<std::pair<std::string, std::string>>& files);
+
+    /// Feed the current fingerprint and the host's cumulative read counter
+    /// (0 if unknown). Returns true when a refresh should run now.
+    bool shouldRefresh(const std::string& fingerprint, uint64_t hostReadBytes,
+                       Clock::time_point now = Clock::now());
+
+    /// Record that the image now holds `fingerprint`.
+    void markRefreshed(const std::string& fingerprint,
+                       Clock::time_point now = Clock::now());
+
+    /// Record a refresh that failed or left files out: the image holds no
+    /// known fingerprint, so a retry is pending even if the files are
+    /// unchanged, but it waits minIntervalSeconds like after any refresh.
+    void markAttempted(Clock::time_point now = Clock::now());
+
+    /// True when a change has been seen but not refreshed yet.
+    bool pending() const;
+
+    const UsbRefreshPolicy& policy() const;
+
+private:
+    UsbRefreshPolicy policy_;
+
+    std::string       applied_;          // fingerprint the image holds
+    std::string       seen_;             // latest fingerprint fed in
+    bool              pending_ = false;
+    bool              refreshed_ = false;
+    Clock::time_point lastRefresh_;
+    Clock::time_point changedAt_;        // when seen_ last changed
+    Clock::time_point pendingSince_;     // first unapplied change
+    uint64_t          lastReadBytes_ = 0;
+    bool              haveReadBytes_ = false;
+};
+
+} // namespace syncv
@@ -5,6 +5,8 @@
 #include "FirmwareReceiver.h"
 #include "TransferManager.h"
 #include "UsbGadget.h"
+#include "UsbRefreshGate.h"
+#include "Fat32Image.h"
 
 #include <iostream>
 #include <string>
@@ -15,6 +17,9 @@
 #include <csignal>
 #include <cstdlib>
 #include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
 #include <atomic>
 
 namespace fs = std::filesystem;
@@ -41,12 +46,37 @@ int main() {
     const std::string authToken  = envOr("SYNCV_AUTH_TOKEN",   "changeme");
     const std::string encKey     = envOr("SYNCV_ENC_KEY",      "");
     const int pollSeconds        = std::atoi(envOr("SYNCV_POLL_INTERVAL", "30").c_str());
+    const std::string journal    = envOr("SYNCV_TRANSFER_JOURNAL", "/var/syncv/transfer.journal");
 
     // USB gadget config
     const bool usbEnabled        = envOr("SYNCV_USB_GADGET", "1") == "1";
     const std::string usbImage   = envOr("SYNCV_USB_IMAGE",  "/var/syncv/usb/drive.img");
     const std::string usbMount   = envOr("SYNCV_USB_MOUNT",  "/var/syncv/usb/mnt");
     const uint64_t usbSizeMB     = std::stoull(envOr("SYNCV_USB_SIZE_MB", "64"));
+    const bool usbUserspaceFat   = envOr("SYNCV_USB_USERSPACE_FAT", "1") == "1";
+    const bool usbAbImages       = envOr("SYNCV_USB_AB", "1") == "1";
+    const bool usbFirmwareLun    = envOr("SYNCV_USB_FIRMWARE_LUN", "0") == "1";
+    const std::string usbFwImage = envOr("SYNCV_USB_FIRMWARE_IMAGE",
+        (fs::path(usbImage).parent_path() / "firmware.img").string());
+    const uint64_t usbFwSizeMB   = std::stoull(envOr("SYNCV_USB_FIRMWARE_SIZE_MB", "64"));
+
+    // USB images are always FAT32, which has a minimum size
+    auto usbSizeOk = [](const char* name, uint64_t sizeMB) {
+        if (sizeMB >= syncv::Fat32Image::kMinSizeMB) return true;
+        std::cerr << "ERROR: " << name << "=" << sizeMB << " is too small; FAT32 needs at least "
+                  << syncv::Fat32Image::kMinSizeMB << " MB" << std::endl;
+        return false;
+    };
+    if (usbEnabled && (!usbSizeOk("SYNCV_USB_SIZE_MB", usbSizeMB) ||
+                       (usbFirmwareLun && !usbSizeOk("SYNCV_USB_FIRMWARE_SIZE_MB", usbFwSizeMB)))) {
+        return 1;
+    }
+
+    syncv::UsbRefreshPolicy usbPolicy;
+    usbPolicy.debounceSeconds     = std::atoi(envOr("SYNCV_USB_DEBOUNCE", "0").c_str());
+    usbPolicy.minIntervalSeconds  = std::atoi(envOr("SYNCV_USB_MIN_INTERVAL", "60").c_str());
+    usbPolicy.deferWhileHostReads = envOr("SYNCV_USB_DEFER_BUSY", "1") == "1";
+    usbPolicy.maxDeferSeconds     = std::atoi(envOr("SYNCV_USB_MAX_DEFER", "300").c_str());
 
     // Ensure directories exist
     for (const auto& dir : {logDir, fwStaging, fwInstall}) {
@@ -71,12 +101,35 @@ int main() {
         std::cout << "[drive] Encryption enabled" << std::endl;
     }
 
+    if (!transfer.setJournalPath(journal)) {
+        std::cerr << "WARN: Could not read transfer journal " << journal << std::endl;
+    }
+
     // Initialize USB gadget (Pi Zero W shows up as pendrive)
     syncv::UsbGadgetConfig usbCfg;
     usbCfg.imagePath  = usbImage;
     usbCfg.mountPoint = usbMount;
     usbCfg.imageSizeMB = usbSizeMB;
+    usbCfg.userspaceFat = usbUserspaceFat;
+    usbCfg.abImages   = usbAbImages;
+    if (usbFirmwareLun) {
+        // Firmware changes rarely: a volume of its own is left alone when logs change
+        usbCfg.extraLuns.push_back({"firmware/", usbFwImage, usbFwSizeMB, "SYNCVFW"});
+    }
     syncv::UsbGadget usb(usbCfg);
+    syncv::UsbRefreshGate usbGate(usbPolicy);
+
+    // Device metadata for the host manifest on the pendrive. Logs are parsed
+    // in one batch per collection cycle; anything else (firmware) on demand
+    std::vector<syncv::DeviceMetadata> logMetadata;
+    std::unordered_map<std::string, const syncv::DeviceMetadata*> metadataByPath;
+    usb.setMetadataProvider([&metadata, &metadataByPath](const std::string& path) {
+        auto it = metadataByPath.find(path);
+        if (it != metadataByPath.end()) return *it->second;
+        std::ifstream in(path, std::ios::binary);
+        std::string raw((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return metadata.extractAny(raw, path);
+    });
 
     bool usbReady = false;
     if (usbEnabled) {
@@ -99,6 +152,8 @@ int main() {
     std::cout << std::endl;
     std::cout << "[drive] Ready — waiting for connection" << std::endl;
 
+    bool usbTried = false;
+
     // Main loop
     while (running) {
         // Collect available log files
@@ -109,9 +164,16 @@ int main() {
             totalBytes += log.fileSize;
         }
 
+        size_t parsed = metadata.extractBatch(logs, logMetadata);
+        metadataByPath.clear();
+        for (size_t i = 0; i < logs.size(); i++) {
+            metadataByPath[logs[i].fullPath] = &logMetadata[i];
+        }
+
         auto files = server.getFileList();
 
-        std::cout << "[drive] " << logs.size() << " logs (" << totalBytes << " bytes), "
+        std::cout << "[drive] " << logs.size() << " logs (" << totalBytes << " bytes, "
+                  << parsed << " with device metadata), "
                   << files.size() << " files servable" << std::endl;
 
         // Refresh USB drive contents (prepare-then-expose pattern)
@@ -130,15 +192,35 @@ int main() {
                 }
             }
 
+            const std::string fingerprint = syncv::UsbRefreshGate::fingerprint(usbFiles);
+            // Only an image holding every file counts as refreshed. After a
+            // failed or partial attempt the change stays pending, and the
+            // retry still waits out the minimum interval: each attempt may
+            // unplug the host
+            auto markDone = [&](bool ok) {
+                if (ok && usb.getLastPrepareStats().failed == 0) {
+                    usbGate.markRefreshed(fingerprint);
+                } else {
+                    usbGate.markAttempted();
+                }
+            };
             if (!usb.isExposed()) {
-                // First time: prepare and expose
-                usb.prepareImage(usbFiles);
-                usb.expose();
-            } else {
-                // Subsequent: full refresh cycle (unexpose → prepare → expose)
-                usb.refresh(usbFiles);
+                // First time, or a failed attempt left the host unplugged:
+                // prepare and expose, retrying only as often as the gate allows
+                if (!usbTried || usbGate.shouldRefresh(fingerprint, 0)) {
+                    usbTried = true;
+                    usb.prepareImage(usbFiles);
+                    markDone(usb.expose());
+                    std::cout << "[drive] USB: " << usb.getStatus() << std::endl;
+                }
+            } else if (usbGate.shouldRefresh(fingerprint, usb.hostReadBytes())) {
+                // Files changed: refresh (A/B swap, or unexpose → prepare → expose)
+                markDone(usb.refresh(usbFiles));
+                std::cout << "[drive] USB: " << usb.getStatus() << std::endl;
+                std::cout << "[drive] USB timing: " << usb.getTelemetry().summary() << std::endl;
+            } else if (usbGate.pending()) {
+                std::cout << "[drive] USB: refresh deferred" << std::endl;
             }
-            std::cout << "[drive] USB: " << usb.getStatus() << std::endl;
         }
 
         // Sleep in small increments so SIGTERM is responsive
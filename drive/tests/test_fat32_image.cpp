@@ -0,0 +1,303 @@
+#include <gtest/gtest.h>
+#include "Fat32Image.h"
+#include "HashVerifier.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+class Fat32ImageTest : public ::testing::Test {
+protected:
+    std::string testDir;
+    std::string imagePath;
+    static constexpr uint64_t kImageSize = 64ULL * 1024 * 1024;
+
+    void SetUp() override {
+        testDir = (fs::temp_directory_path() / "syncv_fat32_test").string();
+        fs::create_directories(testDir + "/src");
+        imagePath = testDir + "/drive.img";
+    }
+
+    void TearDown() override {
+        std::error_code ec;
+        fs::remove_all(testDir, ec);
+    }
+
+    std::string createFile(const std::string& name, const std::string& content) {
+        std::string path = testDir + "/src/" + name;
+        std::ofstream out(path, std::ios::binary);
+        out << content;
+        return path;
+    }
+
+    std::string readRaw(uint64_t offset, size_t len) {
+        std::ifstream in(imagePath, std::ios::binary);
+        in.seekg(static_cast<std::streamoff>(offset));
+        std::string out(len, '\0');
+        in.read(&out[0], static_cast<std::streamsize>(len));
+        return out;
+    }
+};
+
+TEST_F(Fat32ImageTest, FormatsValidFat32BootSector) {
+    ASSERT_TRUE(syncv::Fat32Image::format(imagePath, kImageSize, "SYNCV"));
+    EXPECT_EQ(fs::file_size(imagePath), kImageSize);
+
+    std::string boot = readRaw(0, 512);
+    EXPECT_EQ(static_cast<uint8_t>(boot[510]), 0x55);
+    EXPECT_EQ(static_cast<uint8_t>(boot[511]), 0xAA);
+    EXPECT_EQ(boot.substr(82, 8), "FAT32   ");
+    EXPECT_EQ(boot.substr(71, 11), "SYNCV      ");
+    // Backup boot sector is identical
+    EXPECT_EQ(readRaw(6 * 512, 512), boot);
+}
+
+TEST_F(Fat32ImageTest, RejectsImagesTooSmallForFat32) {
+    const uint64_t mb = 1024 * 1024;
+    EXPECT_FALSE(syncv::Fat32Image::format(imagePath, 8 * mb));
+    EXPECT_FALSE(syncv::Fat32Image::format(imagePath, (syncv::Fat32Image::kMinSizeMB - 1) * mb));
+    EXPECT_TRUE(syncv::Fat32Image::format(imagePath, syncv::Fat32Image::kMinSizeMB * mb));
+}
+
+TEST_F(Fat32ImageTest, FormatIsDeterministic) {
+    ASSERT_TRUE(syncv::Fat32Image::format(imagePath, kImageSize));
+    std::string first = readRaw(0, 2 * 1024 * 1024);   // reserved area, FATs, root
+    ASSERT_TRUE(syncv::Fat32Image::format(imagePath, kImageSize));
+    EXPECT_EQ(readRaw(0, 2 * 1024 * 1024), first);
+}
+
+TEST_F(Fat32ImageTest, ReformatDiscardsOldContents) {
+    ASSERT_TRUE(syncv::Fat32Image::format(imagePath, kImageSize));
+    std::string fresh = readRaw(0, 2 * 1024 * 1024);
+    {
+        syncv::Fat32Image image;
+        ASSERT_TRUE(image.open(imagePath));
+        ASSERT_TRUE(image.writeData("old/data.log", std::string(100000, 'x')));
+        ASSERT_TRUE(image.flush());
+    }
+    ASSERT_TRUE(syncv::Fat32Image::format(imagePath, kImageSize));
+    EXPECT_EQ(readRaw(0, 2 * 1024 * 1024), fresh);
+
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(imagePath));
+    EXPECT_TRUE(image.listFiles().empty());
+}
+
+#ifndef _WIN32
+TEST_F(Fat32ImageTest, LargeFormatIsSparse) {
+    const uint64_t size = 4ULL * 1024 * 1024 * 1024;
+    ASSERT_TRUE(syncv::Fat32Image::format(imagePath, size));
+    EXPECT_EQ(fs::file_size(imagePath), size);
+
+    struct stat st{};
+    ASSERT_EQ(::stat(imagePath.c_str(), &st), 0);
+    EXPECT_LT(static_cast<uint64_t>(st.st_blocks) * 512, 1024ULL * 1024);
+
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(imagePath));
+    EXPECT_GT(image.freeBytes(), size - 64ULL * 1024 * 1024);
+}
+#endif
+
+TEST_F(Fat32ImageTest, OpenRejectsNonFatImage) {
+    std::ofstream(imagePath, std::ios::binary) << std::string(4096, 'x');
+    syncv::Fat32Image image;
+    EXPECT_FALSE(image.open(imagePath));
+    EXPECT_FALSE(image.lastError().empty());
+}
+
+TEST_F(Fat32ImageTest, WritesAndReadsBackFilesWithLongNames) {
+    ASSERT_TRUE(syncv::Fat32Image::format(imagePath, kImageSize));
+    std::string big(300 * 1024, '\0');
+    for (size_t i = 0; i < big.size(); i++) big[i] = static_cast<char>(i * 31 + 7);
+    auto bigSrc = createFile("big.bin", big);
+
+    {
+        syncv::Fat32Image image;
+        ASSERT_TRUE(image.open(imagePath));
+        ASSERT_TRUE(image.writeData("README.TXT", "short name"));
+        ASSERT_TRUE(image.writeData("sensor-data-2026-02-25.csv", "ts,value\n1,2\n"));
+        ASSERT_TRUE(image.writeFile("firmware/v1.2.3.bin", bigSrc));
+        ASSERT_TRUE(image.flush());
+    }
+
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(imagePath));
+    auto files = image.listFiles();
+    std::sort(files.begin(), files.end());
+    EXPECT_EQ(files, (std::vector<std::string>{"README.TXT", "firmware/v1.2.3.bin",
+                                               "sensor-data-2026-02-25.csv"}));
+    std::string out;
+    ASSERT_TRUE(image.readFile("sensor-data-2026-02-25.csv", out));
+    EXPECT_EQ(out, "ts,value\n1,2\n");
+    ASSERT_TRUE(image.readFile("FIRMWARE/V1.2.3.BIN", out));   // case-insensitive
+    EXPECT_EQ(out, big);
+    EXPECT_EQ(image.fileSize("README.TXT"), 10);
+    EXPECT_EQ(image.fileSize("missing.log"), -1);
+}
+
+TEST_F(Fat32ImageTest, NamesOutsideTheBmpRoundTrip) {
+    ASSERT_TRUE(syncv::Fat32Image::format(imagePath, kImageSize));
+    // U+1F4C8 is a surrogate pair; in the second name it straddles two LFN slots
+    const std::string chart = "\xF0\x9F\x93\x88";
+    const std::vector<std::string> names = {"trend-" + chart + ".csv",
+                                            "abcdefghijkl" + chart + ".log"};
+    {
+        syncv::Fat32Image image;
+        ASSERT_TRUE(image.open(imagePath));
+        for (const auto& name : names) ASSERT_TRUE(image.writeData(name, name));
+        ASSERT_TRUE(image.flush());
+    }
+
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(imagePath));
+    auto files = image.listFiles();
+    std::sort(files.begin(), files.end());
+    EXPECT_EQ(files, (std::vector<std::string>{names[1], names[0]}));
+    for (const auto& name : names) {
+        std::string out;
+        ASSERT_TRUE(image.readFile(name, out)) << name;
+        EXPECT_EQ(out, name);
+    }
+}
+
+TEST_F(Fat32ImageTest, ManyLongNamesGetUniqueShortAliases) {
+    ASSERT_TRUE(syncv::Fat32Image::format(imagePath, kImageSize));
+    {
+        syncv::Fat32Image image;
+        ASSERT_TRUE(image.open(imagePath));
+        for (int i = 0; i < 40; i++) {
+            ASSERT_TRUE(image.writeData("device-log-" + std::to_string(i) + ".log",
+                                        "entry " + std::to_string(i)));
+        }
+    }   // close() flushes
+
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(imagePath));
+    EXPECT_EQ(image.listFiles().size(), 40u);
+    std::string out;
+    ASSERT_TRUE(image.readFile("device-log-37.log", out));
+    EXPECT_EQ(out, "entry 37");
+}
+
+TEST_F(Fat32ImageTest, AliasesStayUniqueAcrossRemoveAndReopen) {
+    ASSERT_TRUE(syncv::Fat32Image::format(imagePath, kImageSize));
+    {
+        syncv::Fat32Image image;
+        ASSERT_TRUE(image.open(imagePath));
+        for (int i = 0; i < 20; i++) {
+            ASSERT_TRUE(image.writeData("logs/device-log-" + std::to_string(i) + ".log", "a"));
+        }
+        ASSERT_TRUE(image.remove("logs/device-log-3.log"));
+        ASSERT_TRUE(image.writeData("logs/device-log-new.log", "b"));
+    }
+    {
+        // Reopened: aliases already on disk must not be handed out again
+        syncv::Fat32Image image;
+        ASSERT_TRUE(image.open(imagePath));
+        for (int i = 20; i < 30; i++) {
+            ASSERT_TRUE(image.writeData("logs/device-log-" + std::to_string(i) + ".log", "c"));
+        }
+    }
+
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(imagePath));
+    EXPECT_EQ(image.listFiles().size(), 30u);
+    std::string out;
+    ASSERT_TRUE(image.readFile("logs/device-log-new.log", out));
+    EXPECT_EQ(out, "b");
+    ASSERT_TRUE(image.readFile("logs/device-log-25.log", out));
+    EXPECT_EQ(out, "c");
+}
+
+TEST_F(Fat32ImageTest, RewriteAndRemoveReleaseClusters) {
+    ASSERT_TRUE(syncv::Fat32Image::format(imagePath, kImageSize));
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(imagePath));
+    const uint64_t freeAtStart = image.freeBytes();
+
+    ASSERT_TRUE(image.writeData("a.log", std::string(100 * 1024, 'a')));
+    ASSERT_TRUE(image.flush());
+    EXPECT_LT(image.freeBytes(), freeAtStart);
+
+    // Shrinking in place trims the chain
+    ASSERT_TRUE(image.writeData("a.log", "tiny"));
+    std::string out;
+    ASSERT_TRUE(image.readFile("a.log", out));
+    EXPECT_EQ(out, "tiny");
+
+    ASSERT_TRUE(image.remove("a.log"));
+    ASSERT_TRUE(image.flush());
+    EXPECT_EQ(image.freeBytes(), freeAtStart);
+    EXPECT_EQ(image.fileSize("a.log"), -1);
+}
+
+TEST_F(Fat32ImageTest, SourceTruncatedMidCopyLeavesNoStaleFile) {
+    ASSERT_TRUE(syncv::Fat32Image::format(imagePath, kImageSize));
+    {
+        syncv::Fat32Image image;
+        ASSERT_TRUE(image.open(imagePath));
+        ASSERT_TRUE(image.writeData("logs/app.log", std::string(300 * 1024, 'o')));
+        ASSERT_TRUE(image.flush());
+    }
+
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(imagePath));
+    const uint64_t freeBefore = image.freeBytes();
+
+    // The log was rotated after it was sized: the stream ends early
+    std::istringstream rotated(std::string(200 * 1024, 'n'));
+    EXPECT_FALSE(image.writeStream("logs/app.log", rotated, 600 * 1024, 0));
+    EXPECT_NE(image.lastError().find("Short read"), std::string::npos);
+    EXPECT_EQ(image.fileSize("logs/app.log"), -1);
+    ASSERT_TRUE(image.flush());
+    EXPECT_EQ(image.freeBytes(), freeBefore + 300 * 1024);
+
+    syncv::Fat32Image reopened;
+    ASSERT_TRUE(reopened.open(imagePath));
+    EXPECT_TRUE(reopened.listFiles().empty());
+    EXPECT_EQ(reopened.freeBytes(), freeBefore + 300 * 1024);
+}
+
+TEST_F(Fat32ImageTest, RemoveRefusesNonEmptyDirectory) {
+    ASSERT_TRUE(syncv::Fat32Image::format(imagePath, kImageSize));
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(imagePath));
+    ASSERT_TRUE(image.writeData("firmware/v1.bin", "fw"));
+
+    EXPECT_FALSE(image.remove("firmware"));
+    ASSERT_TRUE(image.remove("firmware/v1.bin"));
+    EXPECT_TRUE(image.remove("firmware"));
+    EXPECT_TRUE(image.listDirectories().empty());
+}
+
+TEST_F(Fat32ImageTest, WriteFileReturnsDigestOfData) {
+    ASSERT_TRUE(syncv::Fat32Image::format(imagePath, kImageSize));
+    auto src = createFile("log.txt", std::string(5000, 'q'));
+
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(imagePath));
+    std::string digest;
+    uint64_t size = 0;
+    ASSERT_TRUE(image.writeFile("log.txt", src, &digest, &size));
+
+    syncv::HashVerifier verifier;
+    EXPECT_EQ(digest, verifier.hashFile(src));
+    EXPECT_EQ(size, 5000u);
+}
+
+TEST_F(Fat32ImageTest, ReportsFullImage) {
+    ASSERT_TRUE(syncv::Fat32Image::format(imagePath, kImageSize));
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(imagePath));
+    std::string tooBig(static_cast<size_t>(image.freeBytes() + image.clusterBytes()), 'x');
+
+    EXPECT_FALSE(image.writeData("huge.bin", tooBig));
+    EXPECT_EQ(image.lastError(), "Image is full");
+    EXPECT_EQ(image.fileSize("huge.bin"), -1);
+}
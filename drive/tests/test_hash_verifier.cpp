@@ -2,6 +2,7 @@
 #include "HashVerifier.h"
 #include <fstream>
 #include <filesystem>
+#include <algorithm>
 
 namespace fs = std::filesystem;
 
@@ -99,3 +100,16 @@ TEST_F(HashVerifierTest, HashOfEmptyStringMatchesExpected) {
     std::string hash = verifier.hashString("");
     EXPECT_EQ(hash, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
 }
+
+TEST_F(HashVerifierTest, StreamingMatchesOneShot) {
+    syncv::HashVerifier verifier;
+    std::string data(10000, 'q');
+    for (size_t i = 0; i < data.size(); i++) data[i] = static_cast<char>(i * 7);
+
+    verifier.begin();
+    // Uneven pieces straddle the 64-byte block boundary
+    for (size_t pos = 0; pos < data.size(); pos += 333) {
+        verifier.update(data.data() + pos, std::min<size_t>(333, data.size() - pos));
+    }
+    EXPECT_EQ(verifier.finish(), verifier.hashString(data));
+}
@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+#include "ImageManifest.h"
+#include "HashVerifier.h"
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+
+namespace fs = std::filesystem;
+
+class ImageManifestTest : public ::testing::Test {
+protected:
+    std::string testDir;
+
+    void SetUp() override {
+        testDir = (fs::temp_directory_path() / "syncv_manifest_test").string();
+        fs::create_directories(testDir + "/src");
+    }
+
+    void TearDown() override {
+        std::error_code ec;
+        fs::remove_all(testDir, ec);
+    }
+
+    std::string createFile(const std::string& name, const std::string& content) {
+        std::string path = testDir + "/src/" + name;
+        std::ofstream out(path, std::ios::binary);
+        out << content;
+        return path;
+    }
+
+    // Simulate a successful copy of everything the plan asked for
+    void applyPlan(syncv::ImageManifest& manifest, const syncv::ManifestPlan& plan) {
+        syncv::HashVerifier hasher;
+        for (const auto& change : plan.changed) {
+            manifest.record(change, hasher.hashFile(change.srcPath), change.stat.size);
+        }
+        for (const auto& name : plan.removed) {
+            manifest.erase(name);
+        }
+    }
+
+    void bumpMtime(const std::string& path) {
+        fs::last_write_time(path, fs::last_write_time(path) + std::chrono::seconds(5));
+    }
+};
+
+TEST_F(ImageManifestTest, EmptyManifestCopiesEverything) {
+    auto a = createFile("a.log", "alpha");
+    auto b = createFile("b.log", "bravo!");
+
+    syncv::ImageManifest manifest;
+    auto plan = manifest.plan({{a, "a.log"}, {b, "firmware/b.log"}});
+
+    EXPECT_EQ(plan.changed.size(), 2u);
+    EXPECT_EQ(plan.changedBytes, 11u);
+    EXPECT_TRUE(plan.unchanged.empty());
+    EXPECT_TRUE(plan.removed.empty());
+}
+
+TEST_F(ImageManifestTest, UnchangedFilesAreSkipped) {
+    auto a = createFile("a.log", "alpha");
+    auto b = createFile("b.log", "bravo");
+    std::vector<std::pair<std::string, std::string>> files = {{a, "a.log"}, {b, "b.log"}};
+
+    syncv::ImageManifest manifest;
+    applyPlan(manifest, manifest.plan(files));
+    auto plan = manifest.plan(files);
+
+    EXPECT_TRUE(plan.changed.empty());
+    EXPECT_EQ(plan.unchanged.size(), 2u);
+    EXPECT_EQ(plan.changedBytes, 0u);
+}
+
+TEST_F(ImageManifestTest, DetectsGrownFile) {
+    auto a = createFile("a.log", "alpha");
+    std::vector<std::pair<std::string, std::string>> files = {{a, "a.log"}};
+
+    syncv::ImageManifest manifest;
+    applyPlan(manifest, manifest.plan(files));
+    createFile("a.log", "alpha + more lines");
+    auto plan = manifest.plan(files);
+
+    ASSERT_EQ(plan.changed.size(), 1u);
+    EXPECT_EQ(plan.changed[0].name, "a.log");
+    EXPECT_EQ(plan.changedBytes, 18u);
+}
+
+TEST_F(ImageManifestTest, RecordsCopiedSizeForFileGrownSincePlan) {
+    auto a = createFile("a.log", "alpha");
+    syncv::ImageManifest manifest;
+    auto plan = manifest.plan({{a, "a.log"}});
+    ASSERT_EQ(plan.changed.size(), 1u);
+
+    // The log grew between planning and copying; the copy saw the new bytes
+    createFile("a.log", "alpha beta");
+    syncv::HashVerifier hasher;
+    manifest.record(plan.changed[0], hasher.hashFile(a), 10);
+
+    const auto* entry = manifest.find("a.log");
+    ASSERT_NE(entry, nullptr);
+    EXPECT_EQ(entry->size, 10u);
+    EXPECT_EQ(entry->sha256, hasher.hashString("alpha beta"));
+}
+
+TEST_F(ImageManifestTest, TouchedButIdenticalFileIsNotCopied) {
+    auto a = createFile("a.log", "alpha");
+    std::vector<std::pair<std::string, std::string>> files = {{a, "a.log"}};
+
+    syncv::ImageManifest manifest;
+    applyPlan(manifest, manifest.plan(files));
+    bumpMtime(a);
+    auto plan = manifest.plan(files);
+
+    EXPECT_TRUE(plan.changed.empty());
+    EXPECT_EQ(plan.unchanged.size(), 1u);
+}
+
+TEST_F(ImageManifestTest, SameSizeRewriteIsDetectedByHash) {
+    auto a = createFile("a.log", "alpha");
+    std::vector<std::pair<std::string, std::string>> files = {{a, "a.log"}};
+
+    syncv::ImageManifest manifest;
+    applyPlan(manifest, manifest.plan(files));
+    createFile("a.log", "ALPHA");
+    bumpMtime(a);
+    auto plan = manifest.plan(files);
+
+    EXPECT_EQ(plan.changed.size(), 1u);
+}
+
+TEST_F(ImageManifestTest, ReportsRemovedNestedEntries) {
+    auto a = createFile("a.log", "alpha");
+    auto fw = createFile("v1.bin", "firmware");
+
+    syncv::ImageManifest manifest;
+    applyPlan(manifest, manifest.plan({{a, "a.log"}, {fw, "firmware/v1.bin"}}));
+    auto plan = manifest.plan({{a, "a.log"}});
+
+    ASSERT_EQ(plan.removed.size(), 1u);
+    EXPECT_EQ(plan.removed[0], "firmware/v1.bin");
+}
+
+TEST_F(ImageManifestTest, NormalizesNames) {
+    EXPECT_EQ(syncv::ImageManifest::normalizeName("/firmware//v1.bin"), "firmware/v1.bin");
+    EXPECT_EQ(syncv::ImageManifest::normalizeName("logs/../a.log"), "a.log");
+}
+
+TEST_F(ImageManifestTest, SaveAndLoadRoundTrip) {
+    auto a = createFile("a.log", "alpha");
+    auto b = createFile("b b.log", "with space");
+    std::vector<std::pair<std::string, std::string>> files = {{a, "a.log"}, {b, "dir/b b.log"}};
+
+    syncv::ImageManifest manifest;
+    applyPlan(manifest, manifest.plan(files));
+    ASSERT_TRUE(manifest.save(testDir + "/image.manifest"));
+
+    syncv::ImageManifest reloaded;
+    ASSERT_TRUE(reloaded.load(testDir + "/image.manifest"));
+    EXPECT_EQ(reloaded.size(), 2u);
+    ASSERT_NE(reloaded.find("dir/b b.log"), nullptr);
+    EXPECT_EQ(reloaded.find("dir/b b.log")->size, 10u);
+    EXPECT_EQ(reloaded.find("a.log")->sha256, manifest.find("a.log")->sha256);
+    EXPECT_TRUE(reloaded.plan(files).changed.empty());
+}
+
+TEST_F(ImageManifestTest, MissingManifestLoadsEmpty) {
+    syncv::ImageManifest manifest;
+    EXPECT_TRUE(manifest.load(testDir + "/does-not-exist"));
+    EXPECT_EQ(manifest.size(), 0u);
+}
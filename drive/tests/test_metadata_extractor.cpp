@@ -1,5 +1,10 @@
 #include <gtest/gtest.h>
 #include "MetadataExtractor.h"
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
 
 class MetadataExtractorTest : public ::testing::Test {
 protected:
@@ -14,8 +19,8 @@ TEST_F(MetadataExtractorTest, ParsesDeviceTypeAFormat) {
 
     EXPECT_EQ(metadata.deviceId, "DEV001");
     EXPECT_EQ(metadata.firmwareVersion, "1.2.3");
-    EXPECT_EQ(metadata.fields["uptime_hours"], "1024");
-    EXPECT_EQ(metadata.fields["status"], "running");
+    EXPECT_EQ(metadata.fields.get("uptime_hours"), "1024");
+    EXPECT_EQ(metadata.fields.get("status"), "running");
     EXPECT_EQ(metadata.deviceType, "typeA");
 }
 
@@ -27,8 +32,8 @@ TEST_F(MetadataExtractorTest, ParsesDeviceTypeBFormat) {
 
     EXPECT_EQ(metadata.deviceId, "DEV002");
     EXPECT_EQ(metadata.firmwareVersion, "2.0.0");
-    EXPECT_EQ(metadata.fields["temp"], "45.5");
-    EXPECT_EQ(metadata.fields["mode"], "active");
+    EXPECT_EQ(metadata.fields.get("temp"), "45.5");
+    EXPECT_EQ(metadata.fields.get("mode"), "active");
     EXPECT_EQ(metadata.deviceType, "typeB");
 }
 
@@ -67,6 +72,91 @@ TEST_F(MetadataExtractorTest, HandlesEmptyInput) {
     EXPECT_TRUE(metadata.deviceId.empty());
 }
 
+TEST_F(MetadataExtractorTest, TypeATrimsWhitespaceAndCrlf) {
+    std::string raw = "  device_id =  DEV003 \r\n\r\nfirmware_version=4.0\r\n note = a=b \r\n";
+
+    auto metadata = extractor.extract(raw, "typeA");
+
+    EXPECT_TRUE(metadata.parseSuccessful);
+    EXPECT_EQ(metadata.deviceId, "DEV003");
+    EXPECT_EQ(metadata.firmwareVersion, "4.0");
+    EXPECT_EQ(metadata.fields.get("note"), "a=b");
+}
+
+TEST_F(MetadataExtractorTest, TypeBUnescapesKeysAndKeepsLiterals) {
+    std::string raw = "{ \"id\": \"DEV004\",\n  \"a\\\"b\": 7, \"ok\": true }";
+
+    auto metadata = extractor.extract(raw, "typeB");
+
+    EXPECT_TRUE(metadata.parseSuccessful);
+    EXPECT_EQ(metadata.deviceId, "DEV004");
+    EXPECT_EQ(metadata.fields.get("a\"b"), "7");
+    EXPECT_EQ(metadata.fields.get("ok"), "true");
+}
+
+TEST_F(MetadataExtractorTest, TypeBFlattensNestedObjectsAndArrays) {
+    std::string raw = R"({"id": "DEV005", "fw": "1.2",
+        "power": {"volts": 3.3, "rails": [5, 12]},
+        "sensors": [{"name": "t0", "temp": -4.5}, {"name": "t1", "temp": 21}],
+        "empty": {}, "none": null})";
+
+    auto metadata = extractor.extract(raw, "typeB");
+
+    EXPECT_TRUE(metadata.parseSuccessful);
+    EXPECT_EQ(metadata.deviceId, "DEV005");
+    EXPECT_EQ(metadata.firmwareVersion, "1.2");
+    EXPECT_EQ(metadata.fields.get("power.volts"), "3.3");
+    EXPECT_EQ(metadata.fields.get("power.rails.0"), "5");
+    EXPECT_EQ(metadata.fields.get("power.rails.1"), "12");
+    EXPECT_EQ(metadata.fields.get("sensors.0.name"), "t0");
+    EXPECT_EQ(metadata.fields.get("sensors.1.temp"), "21");
+    EXPECT_EQ(metadata.fields.get("none"), "null");
+    EXPECT_EQ(metadata.fields.count("empty"), 0u);
+}
+
+TEST_F(MetadataExtractorTest, TypeBStructuralCharactersInsideStrings) {
+    std::string raw = R"({"id": "DEV006", "msg": "a, b: {c} [d]", "path": "C:\\logs\\\"x\"",)"
+                      R"( "text": "line\nnext \u00e9 \ud83d\ude00"})";
+
+    auto metadata = extractor.extract(raw, "typeB");
+
+    EXPECT_TRUE(metadata.parseSuccessful);
+    EXPECT_EQ(metadata.fields.get("msg"), "a, b: {c} [d]");
+    EXPECT_EQ(metadata.fields.get("path"), "C:\\logs\\\"x\"");
+    EXPECT_EQ(metadata.fields.get("text"), "line\nnext \xC3\xA9 \xF0\x9F\x98\x80");
+}
+
+TEST_F(MetadataExtractorTest, TypeBKeepsFieldsBeforeSyntaxError) {
+    std::string raw = R"({"id": "DEV007", "a": 1, "b" 2, "c": 3})";
+
+    auto metadata = extractor.extract(raw, "typeB");
+
+    EXPECT_TRUE(metadata.parseSuccessful);
+    EXPECT_EQ(metadata.fields.get("a"), "1");
+    EXPECT_EQ(metadata.fields.count("c"), 0u);
+}
+
+TEST_F(MetadataExtractorTest, LargeLogWithFewFieldsStaysSmall) {
+    // Megabytes of free-form log lines around a handful of key=value pairs
+    std::string raw = "device_id=BIG1\nfirmware_version=3.1\n";
+    const std::string noise = "2026-10-17 12:00:00 INFO sensor poll ok, no change\n";
+    while (raw.size() < 4 * 1024 * 1024) raw += noise;
+    raw += "status=idle\n";
+
+    auto typeA = extractor.extract(raw, "typeA");
+    ASSERT_TRUE(typeA.parseSuccessful);
+    EXPECT_EQ(typeA.fields.get("status"), "idle");
+    EXPECT_LT(typeA.fields.capacityBytes(), 1024u);
+
+    std::string json = R"({"id":"BIG2","note":")" + std::string(4 * 1024 * 1024, 'x') +
+                       R"(","a":[1,2,3]})";
+    auto typeB = extractor.extract(json, "typeB");
+    ASSERT_TRUE(typeB.parseSuccessful);
+    EXPECT_EQ(typeB.fields.get("a.2"), "3");
+    // The one long value is kept, but nothing like the document size again
+    EXPECT_LT(typeB.fields.capacityBytes(), json.size() + 1024);
+}
+
 TEST_F(MetadataExtractorTest, RegistersCustomParser) {
     // Register a custom parser for a new device type
     extractor.registerParser("typeC", [](const std::string& raw) -> syncv::DeviceMetadata {
@@ -79,7 +169,7 @@ TEST_F(MetadataExtractorTest, RegistersCustomParser) {
         if (comma1 != std::string::npos && comma2 != std::string::npos) {
             m.deviceId = raw.substr(0, comma1);
             m.firmwareVersion = raw.substr(comma1 + 1, comma2 - comma1 - 1);
-            m.fields["extra"] = raw.substr(comma2 + 1);
+            m.fields.set("extra", raw.substr(comma2 + 1));
         }
         return m;
     });
@@ -89,7 +179,7 @@ TEST_F(MetadataExtractorTest, RegistersCustomParser) {
     EXPECT_TRUE(metadata.parseSuccessful);
     EXPECT_EQ(metadata.deviceId, "DEV003");
     EXPECT_EQ(metadata.firmwareVersion, "3.0.0");
-    EXPECT_EQ(metadata.fields["extra"], "customField");
+    EXPECT_EQ(metadata.fields.get("extra"), "customField");
 }
 
 TEST_F(MetadataExtractorTest, ListsRegisteredParsers) {
@@ -100,3 +190,161 @@ TEST_F(MetadataExtractorTest, ListsRegisteredParsers) {
     EXPECT_NE(std::find(parsers.begin(), parsers.end(), "typeA"), parsers.end());
     EXPECT_NE(std::find(parsers.begin(), parsers.end(), "typeB"), parsers.end());
 }
+
+TEST_F(MetadataExtractorTest, ExtractAnyPicksWorkingParser) {
+    auto a = extractor.extractAny("device_id=DEV010\nfirmware_version=1.0\n");
+    auto b = extractor.extractAny(R"({"id": "DEV011", "fw": "2.0"})");
+    auto none = extractor.extractAny("just some text");
+
+    EXPECT_EQ(a.deviceType, "typeA");
+    EXPECT_EQ(a.deviceId, "DEV010");
+    EXPECT_EQ(b.deviceType, "typeB");
+    EXPECT_EQ(b.deviceId, "DEV011");
+    EXPECT_FALSE(none.parseSuccessful);
+}
+
+TEST_F(MetadataExtractorTest, ExtractBatchKeepsOrderAcrossWorkers) {
+    std::vector<syncv::LogEntry> logs(200);
+    for (size_t i = 0; i < logs.size(); i++) {
+        std::string id = "DEV" + std::to_string(i);
+        if (i % 5 == 4) {
+            logs[i].content = "garbage " + id;
+        } else if (i % 2) {
+            logs[i].content = "device_id=" + id + "\nfirmware_version=1\n";
+        } else {
+            logs[i].content = R"({"id": ")" + id + R"(", "fw": "2"})";
+        }
+    }
+
+    std::vector<syncv::DeviceMetadata> results(3);   // stale entries get replaced
+    size_t parsed = extractor.extractBatch(logs, results, 4);
+
+    ASSERT_EQ(results.size(), logs.size());
+    EXPECT_EQ(parsed, 160u);
+    for (size_t i = 0; i < logs.size(); i++) {
+        if (i % 5 == 4) {
+            EXPECT_FALSE(results[i].parseSuccessful) << i;
+        } else {
+            EXPECT_EQ(results[i].deviceId, "DEV" + std::to_string(i));
+            EXPECT_EQ(results[i].deviceType, i % 2 ? "typeA" : "typeB");
+        }
+    }
+
+    logs.resize(10);
+    EXPECT_EQ(extractor.extractBatch(logs, results), 8u);
+    EXPECT_EQ(results.size(), 10u);
+}
+
+TEST_F(MetadataExtractorTest, ExtractBatchSurvivesThrowingParserAndKeepsWorkers) {
+    std::mutex idsMutex;
+    std::set<std::thread::id> ids;
+    extractor.registerDetector("typeC", syncv::MetadataExtractor::bannerDetector("TYPEC"));
+    extractor.registerParser("typeC", [&](const std::string& raw) {
+        {
+            std::lock_guard<std::mutex> lock(idsMutex);
+            ids.insert(std::this_thread::get_id());
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        if (raw.find("boom") != std::string::npos) throw std::runtime_error("bad record");
+        syncv::DeviceMetadata m;
+        m.deviceId = raw.substr(6);
+        m.parseSuccessful = true;
+        return m;
+    });
+
+    std::vector<syncv::LogEntry> logs(64);
+    for (size_t i = 0; i < logs.size(); i++) {
+        logs[i].content = i % 8 == 3 ? "TYPEC boom" : "TYPEC " + std::to_string(i);
+    }
+    std::vector<syncv::DeviceMetadata> results;
+    EXPECT_EQ(extractor.extractBatch(logs, results, 4), 56u);
+    EXPECT_FALSE(results[3].parseSuccessful);
+    EXPECT_EQ(results[4].deviceId, "4");
+
+    // A second batch runs on the same threads
+    EXPECT_EQ(extractor.extractBatch(logs, results, 4), 56u);
+    EXPECT_LE(ids.size(), 4u);
+}
+
+TEST_F(MetadataExtractorTest, DetectsBuiltInTypesFromContent) {
+    auto a = extractor.detectType("# status\ndevice_id=DEV012\nfirmware_version=1.0\nuptime=5\n");
+    auto b = extractor.detectType("\xEF\xBB\xBF  {\"id\": \"DEV013\"}");
+    auto none = extractor.detectType("Mar 3 12:00:01 kernel: usb 1-1: new device\n");
+
+    EXPECT_EQ(a.deviceType, "typeA");
+    EXPECT_GT(a.confidence, 0.7f);
+    EXPECT_EQ(b.deviceType, "typeB");
+    EXPECT_GT(b.confidence, 0.9f);
+    EXPECT_TRUE(none.deviceType.empty());
+    EXPECT_FALSE(extractor.detectType("").cached);
+}
+
+TEST_F(MetadataExtractorTest, DetectsBannerAndCsvHeaderTypes) {
+    extractor.registerParser("acme", [](const std::string&) { return syncv::DeviceMetadata{}; });
+    extractor.registerParser("csv", [](const std::string&) { return syncv::DeviceMetadata{}; });
+    extractor.registerDetector("acme", syncv::MetadataExtractor::bannerDetector("ACME-LOG v"));
+    extractor.registerDetector("csv", syncv::MetadataExtractor::csvHeaderDetector(
+                                          {"timestamp", "device_id", "value"}));
+
+    EXPECT_EQ(extractor.detectType("ACME-LOG v2\nid=1\n").deviceType, "acme");
+    EXPECT_EQ(extractor.detectType("\"timestamp\",device_id , value\n1,DEV,3\n").deviceType,
+              "csv");
+    EXPECT_TRUE(extractor.detectType("timestamp,other\n1,2\n").deviceType.empty());
+}
+
+TEST_F(MetadataExtractorTest, CachesDetectionPerPathAndDirectory) {
+    const std::string kv = "device_id=DEV014\nfirmware_version=1\n";
+
+    auto first = extractor.detectType(kv, "/logs/devA/1.log");
+    auto again = extractor.detectType("{ not looked at }", "/logs/devA/1.log");
+    auto early = extractor.detectType(kv, "/logs/devA/2.log");
+    extractor.detectType(kv, "/logs/devA/3.log");
+    auto sibling = extractor.detectType("{ not looked at }", "/logs/devA/4.log");
+    auto elsewhere = extractor.detectType(R"({"id": "X"})", "/logs/devB/1.log");
+
+    EXPECT_FALSE(first.cached);
+    EXPECT_TRUE(again.cached);
+    EXPECT_EQ(again.deviceType, "typeA");
+    EXPECT_FALSE(early.cached);
+    EXPECT_TRUE(sibling.cached);
+    EXPECT_EQ(sibling.deviceType, "typeA");
+    EXPECT_FALSE(elsewhere.cached);
+    EXPECT_EQ(elsewhere.deviceType, "typeB");
+}
+
+TEST_F(MetadataExtractorTest, MixedDirectoryKeepsPerPathCache) {
+    const std::string kv = "device_id=DEV030\nfirmware_version=1\n";
+    const std::string json = R"({"id": "DEV031"})";
+
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < 10; ++i) {
+            std::string path = "/logs/mixed/" + std::to_string(i) + ".log";
+            auto m = extractor.extractAny(i % 2 ? json : kv, path);
+            ASSERT_TRUE(m.parseSuccessful) << path;
+            EXPECT_EQ(m.deviceType, i % 2 ? "typeB" : "typeA") << path;
+        }
+    }
+
+    // Every file is still remembered on its own...
+    for (int i = 0; i < 10; ++i) {
+        auto hit = extractor.detectType("", "/logs/mixed/" + std::to_string(i) + ".log");
+        EXPECT_TRUE(hit.cached) << i;
+        EXPECT_EQ(hit.deviceType, i % 2 ? "typeB" : "typeA") << i;
+    }
+    // ...but the directory never agreed on one type
+    auto fresh = extractor.detectType(json, "/logs/mixed/new.log");
+    EXPECT_FALSE(fresh.cached);
+    EXPECT_EQ(fresh.deviceType, "typeB");
+}
+
+TEST_F(MetadataExtractorTest, ExtractAnyRecoversFromStaleCachedType) {
+    auto a = extractor.extractAny("device_id=DEV015\n", "/logs/dev/status.txt");
+    auto b = extractor.extractAny(R"({"id": "DEV016"})", "/logs/dev/status.txt");
+
+    EXPECT_EQ(a.deviceType, "typeA");
+    EXPECT_EQ(b.deviceType, "typeB");
+    EXPECT_EQ(b.deviceId, "DEV016");
+    auto cached = extractor.detectType("", "/logs/dev/status.txt");
+    EXPECT_TRUE(cached.cached);
+    EXPECT_EQ(cached.deviceType, "typeB");
+}
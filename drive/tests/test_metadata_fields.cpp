@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include "MetadataFields.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST(FieldKeysTest, InternsEachNameOnce) {
+    auto a = syncv::FieldKeys::intern("fields_test.alpha");
+    auto b = syncv::FieldKeys::intern("fields_test.beta");
+    auto again = syncv::FieldKeys::intern(std::string("fields_test.") + "alpha");
+
+    EXPECT_EQ(a, again);
+    EXPECT_NE(a, b);
+    EXPECT_EQ(syncv::FieldKeys::name(b), "fields_test.beta");
+
+    syncv::FieldKeys::Id id = 0;
+    EXPECT_TRUE(syncv::FieldKeys::lookup("fields_test.alpha", id));
+    EXPECT_EQ(id, a);
+    EXPECT_FALSE(syncv::FieldKeys::lookup("fields_test.never_interned", id));
+}
+
+TEST(FieldKeysTest, ConcurrentInterningAgrees) {
+    constexpr int kThreads = 4;
+    constexpr int kNames = 2000;
+    std::vector<std::vector<syncv::FieldKeys::Id>> ids(kThreads);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&ids, t] {
+            for (int i = 0; i < kNames; i++) {
+                ids[t].push_back(syncv::FieldKeys::intern("concurrent." + std::to_string(i)));
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+
+    for (int t = 1; t < kThreads; t++) EXPECT_EQ(ids[t], ids[0]);
+    for (int i = 0; i < kNames; i++) {
+        EXPECT_EQ(syncv::FieldKeys::name(ids[0][i]), "concurrent." + std::to_string(i));
+    }
+}
+
+TEST(MetadataFieldsTest, SetGetAndReplace) {
+    syncv::MetadataFields fields;
+    EXPECT_TRUE(fields.empty());
+
+    fields.set("status", "running");
+    fields.set("uptime", "12");
+    fields.set("status", "idle");           // shorter: replaced in place
+    fields.set("uptime", "123456789");      // longer: appended
+
+    EXPECT_EQ(fields.size(), 2u);
+    EXPECT_EQ(fields.get("status"), "idle");
+    EXPECT_EQ(fields.get("uptime"), "123456789");
+    EXPECT_TRUE(fields.get("missing").empty());
+    EXPECT_EQ(fields.count("status"), 1u);
+    EXPECT_FALSE(fields.contains("missing"));
+}
+
+TEST(MetadataFieldsTest, IteratesInInsertionOrder) {
+    syncv::MetadataFields fields;
+    fields.set("zeta", "1");
+    fields.set("alpha", "2");
+    fields.set("mid", "");
+
+    std::vector<std::pair<std::string, std::string>> seen;
+    for (const auto& [key, value] : fields) seen.emplace_back(key, value);
+
+    std::vector<std::pair<std::string, std::string>> expected = {
+        {"zeta", "1"}, {"alpha", "2"}, {"mid", ""}};
+    EXPECT_EQ(seen, expected);
+}
+
+TEST(MetadataFieldsTest, LargeRecordsStayConsistent) {
+    syncv::MetadataFields fields;
+    for (int i = 0; i < 500; i++) {
+        fields.set("large." + std::to_string(i), "v" + std::to_string(i));
+    }
+    fields.set("large.7", "changed");
+
+    EXPECT_EQ(fields.size(), 500u);
+    for (int i = 0; i < 500; i++) {
+        if (i == 7) continue;
+        EXPECT_EQ(fields.get("large." + std::to_string(i)), "v" + std::to_string(i));
+    }
+    EXPECT_EQ(fields.get("large.7"), "changed");
+
+    fields.clear();
+    EXPECT_TRUE(fields.empty());
+    EXPECT_FALSE(fields.contains("large.1"));
+    fields.set("large.1", "again");
+    EXPECT_EQ(fields.get("large.1"), "again");
+}
+
+TEST(MetadataFieldsTest, CopiesAreIndependent) {
+    syncv::MetadataFields a;
+    a.set("k", "one");
+    syncv::MetadataFields b = a;
+    b.set("k", "two");
+
+    EXPECT_EQ(a.get("k"), "one");
+    EXPECT_EQ(b.get("k"), "two");
+}
+
+// Fills the process-wide key table, so it has to stay the last test here
+TEST(MetadataFieldsTest, KeysBeyondTableCapacityStayInRecord) {
+    for (size_t i = 0; syncv::FieldKeys::size() < syncv::FieldKeys::kMaxKeys; i++) {
+        syncv::FieldKeys::intern("filler." + std::to_string(i));
+    }
+    EXPECT_EQ(syncv::FieldKeys::intern("readings.99999.temp"), syncv::FieldKeys::kNoId);
+
+    syncv::MetadataFields fields;
+    fields.set("status", "ok");                  // interned earlier
+    for (int i = 0; i < 40; i++) {
+        fields.set("readings." + std::to_string(i) + ".temp", std::to_string(20 + i));
+    }
+    fields.set("readings.3.temp", "7");          // shorter: in place
+    fields.set("readings.5.temp", "123456");     // longer: moved with its name
+
+    EXPECT_EQ(syncv::FieldKeys::size(), syncv::FieldKeys::kMaxKeys);
+    EXPECT_EQ(fields.size(), 41u);
+    EXPECT_EQ(fields.get("status"), "ok");
+    EXPECT_EQ(fields.get("readings.3.temp"), "7");
+    EXPECT_EQ(fields.get("readings.5.temp"), "123456");
+    EXPECT_EQ(fields.get("readings.39.temp"), "59");
+    EXPECT_TRUE(fields.contains("readings.0.temp"));
+    EXPECT_FALSE(fields.contains("readings.40.temp"));
+
+    std::vector<std::string> keys;
+    for (const auto& [key, value] : fields) keys.emplace_back(key);
+    ASSERT_EQ(keys.size(), 41u);
+    EXPECT_EQ(keys[0], "status");
+    EXPECT_EQ(keys[6], "readings.5.temp");
+}
@@ -1,9 +1,11 @@
 #include <gtest/gtest.h>
 #include "TransferManager.h"
+#include "HashVerifier.h"
 #include <filesystem>
 #include <fstream>
 #include <thread>
 #include <chrono>
+#include <algorithm>
 
 namespace fs = std::filesystem;
 
@@ -159,3 +161,668 @@ TEST_F(TransferManagerTest, CalculatesTransferSpeed) {
     EXPECT_GT(result.bytesPerSecond, 0.0);
     EXPECT_EQ(result.bytesTransferred, 102400);
 }
+
+TEST_F(TransferManagerTest, JournalSurvivesRestart) {
+    std::string content(8192, 'J');
+    createFile(testDir + "/source/j.bin", content);
+    const std::string journal = testDir + "/transfer.journal";
+
+    {
+        // Simulate a crash part-way through: abort from the progress callback
+        syncv::TransferManager manager;
+        ASSERT_TRUE(manager.setJournalPath(journal));
+        manager.setCheckpointInterval(0, 0);
+        manager.setChunkSize(2048);
+        manager.onProgress([](float pct) {
+            if (pct >= 50.0f) throw std::runtime_error("power loss");
+        });
+        EXPECT_THROW(manager.transfer(testDir + "/source/j.bin", testDir + "/dest/j.bin"),
+                     std::runtime_error);
+    }
+    ASSERT_TRUE(fs::exists(journal));
+
+    syncv::TransferManager restarted;
+    ASSERT_TRUE(restarted.setJournalPath(journal));
+    EXPECT_EQ(restarted.getCompletedBytes(testDir + "/source/j.bin"), 4096u);
+
+    auto result = restarted.resumeTransfer(testDir + "/source/j.bin", testDir + "/dest/j.bin");
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(readFileContent(testDir + "/dest/j.bin"), content);
+
+    // Completed transfers are dropped from the journal
+    EXPECT_EQ(restarted.getCompletedBytes(testDir + "/source/j.bin"), 0u);
+    EXPECT_FALSE(fs::exists(journal));
+}
+
+TEST_F(TransferManagerTest, JournalCheckpointsAreThrottled) {
+    std::string content(16384, 'K');
+    createFile(testDir + "/source/k.bin", content);
+    const std::string journal = testDir + "/transfer.journal";
+
+    {
+        syncv::TransferManager manager;
+        ASSERT_TRUE(manager.setJournalPath(journal));
+        manager.setChunkSize(1024);
+        manager.setCheckpointInterval(5120, 60000);
+        manager.onProgress([](float pct) {
+            if (pct >= 75.0f) throw std::runtime_error("power loss");
+        });
+        EXPECT_THROW(manager.transfer(testDir + "/source/k.bin", testDir + "/dest/k.bin"),
+                     std::runtime_error);
+    }
+
+    // 12 KB were copied but the journal only moves in 5 KB steps
+    syncv::TransferManager restarted;
+    ASSERT_TRUE(restarted.setJournalPath(journal));
+    EXPECT_EQ(restarted.getCompletedBytes(testDir + "/source/k.bin"), 10240u);
+
+    auto result = restarted.resumeTransfer(testDir + "/source/k.bin", testDir + "/dest/k.bin");
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(readFileContent(testDir + "/dest/k.bin"), content);
+}
+
+TEST_F(TransferManagerTest, AbortCheckpointsProgressSinceLastInterval) {
+    std::string content(8192, 'L');
+    createFile(testDir + "/source/l.bin", content);
+    const std::string journal = testDir + "/transfer.journal";
+
+    syncv::TransferManager manager;
+    ASSERT_TRUE(manager.setJournalPath(journal));
+    manager.setChunkSize(1024);
+    int chunks = 0;
+    manager.onProgress([&](float) { chunks++; });
+    manager.setAbortCheck([&]() { return chunks >= 3; });
+    auto result = manager.transfer(testDir + "/source/l.bin", testDir + "/dest/l.bin");
+    EXPECT_FALSE(result.success);
+
+    // Far below the default interval, yet the abort still saved the progress
+    syncv::TransferManager restarted;
+    ASSERT_TRUE(restarted.setJournalPath(journal));
+    EXPECT_EQ(restarted.getCompletedBytes(testDir + "/source/l.bin"), 3072u);
+}
+
+TEST_F(TransferManagerTest, ResumeClampsStaleJournalOffset) {
+    std::string content(4096, 'S');
+    createFile(testDir + "/source/s.bin", content);
+    // Destination lost its tail (e.g. unsynced data after power loss)
+    createFile(testDir + "/dest/s.bin", content.substr(0, 1000));
+
+    syncv::TransferManager manager;
+    manager.recordPartialTransfer(testDir + "/source/s.bin", testDir + "/dest/s.bin", 3000);
+
+    auto result = manager.resumeTransfer(testDir + "/source/s.bin", testDir + "/dest/s.bin");
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(readFileContent(testDir + "/dest/s.bin"), content);
+}
+
+TEST_F(TransferManagerTest, VerifiedResumeTruncatesToLastGoodBlock) {
+    std::string content;
+    for (int i = 0; i < 8192; i++) content += static_cast<char>('a' + i % 26);
+    createFile(testDir + "/source/v.bin", content);
+    const std::string journal = testDir + "/transfer.journal";
+
+    {
+        syncv::TransferManager manager;
+        ASSERT_TRUE(manager.setJournalPath(journal));
+        manager.setCheckpointInterval(0, 0);
+        manager.setChunkSize(1024);
+        manager.setVerifyBlockSize(1024);
+        manager.onProgress([](float pct) {
+            if (pct >= 75.0f) throw std::runtime_error("power loss");
+        });
+        EXPECT_THROW(manager.transfer(testDir + "/source/v.bin", testDir + "/dest/v.bin"),
+                     std::runtime_error);
+    }
+
+    // Corrupt the third block of the partial destination
+    {
+        std::fstream f(testDir + "/dest/v.bin", std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(2048 + 10);
+        f.put('#');
+    }
+
+    syncv::TransferManager restarted;
+    ASSERT_TRUE(restarted.setJournalPath(journal));
+    restarted.setVerifyBlockSize(1024);
+    EXPECT_EQ(restarted.getCompletedBytes(testDir + "/source/v.bin"), 6144u);
+
+    auto result = restarted.resumeTransfer(testDir + "/source/v.bin", testDir + "/dest/v.bin");
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(result.resumedFrom, 2048u);
+    EXPECT_EQ(readFileContent(testDir + "/dest/v.bin"), content);
+}
+
+TEST_F(TransferManagerTest, VerifiedResumeDetectsTruncatedDestination) {
+    std::string content(6144, 'T');
+    createFile(testDir + "/source/t.bin", content);
+    const std::string journal = testDir + "/transfer.journal";
+
+    {
+        syncv::TransferManager manager;
+        ASSERT_TRUE(manager.setJournalPath(journal));
+        manager.setCheckpointInterval(0, 0);
+        manager.setChunkSize(1024);
+        manager.setVerifyBlockSize(1024);
+        manager.onProgress([](float pct) {
+            if (pct >= 66.0f) throw std::runtime_error("power loss");
+        });
+        EXPECT_THROW(manager.transfer(testDir + "/source/t.bin", testDir + "/dest/t.bin"),
+                     std::runtime_error);
+    }
+    fs::resize_file(testDir + "/dest/t.bin", 1500);
+
+    syncv::TransferManager restarted;
+    ASSERT_TRUE(restarted.setJournalPath(journal));
+    restarted.setVerifyBlockSize(1024);
+    auto result = restarted.resumeTransfer(testDir + "/source/t.bin", testDir + "/dest/t.bin");
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(result.resumedFrom, 1024u);
+    EXPECT_EQ(readFileContent(testDir + "/dest/t.bin"), content);
+}
+
+TEST_F(TransferManagerTest, AdaptiveChunkingStaysWithinBounds) {
+    std::string content;
+    for (int i = 0; i < 2 * 1024 * 1024; i++) content += static_cast<char>(i * 31);
+    createFile(testDir + "/source/adapt.bin", content);
+
+    syncv::TransferManager manager;
+    manager.setChunkSize(4096);
+    manager.setAdaptiveChunking(true, 8 * 1024, 64 * 1024);
+    EXPECT_EQ(manager.getChunkSize(), 8u * 1024);
+
+    std::vector<size_t> sizes;
+    manager.onProgress([&](float) { sizes.push_back(manager.getChunkSize()); });
+
+    auto result = manager.transfer(testDir + "/source/adapt.bin",
+                                   testDir + "/dest/adapt.bin");
+
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(readFileContent(testDir + "/dest/adapt.bin"), content);
+    EXPECT_GT(manager.getMeasuredBytesPerSecond(), 0.0);
+    EXPECT_EQ(result.chunkSize, manager.getChunkSize());
+    for (size_t s : sizes) {
+        EXPECT_GE(s, 8u * 1024);
+        EXPECT_LE(s, 64u * 1024);
+    }
+    // The size must actually have been probed away from its starting point
+    EXPECT_NE(std::count(sizes.begin(), sizes.end(), 8u * 1024),
+              static_cast<long>(sizes.size()));
+}
+
+TEST_F(TransferManagerTest, FixedChunkSizeWithoutAdaptiveMode) {
+    std::string content(100000, 'F');
+    createFile(testDir + "/source/fixed.bin", content);
+
+    syncv::TransferManager manager;
+    manager.setChunkSize(4096);
+    auto result = manager.transfer(testDir + "/source/fixed.bin", testDir + "/dest/fixed.bin");
+
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(result.chunkSize, 4096u);
+    EXPECT_EQ(manager.getMeasuredBytesPerSecond(), 0.0);
+}
+
+TEST_F(TransferManagerTest, RecordsPerChunkTelemetry) {
+    std::string content(10240, 'H');
+    createFile(testDir + "/source/tel.bin", content);
+
+    syncv::TransferManager manager;
+    manager.setChunkSize(1024);
+    auto result = manager.transfer(testDir + "/source/tel.bin", testDir + "/dest/tel.bin");
+
+    ASSERT_TRUE(result.success);
+    const auto& t = result.telemetry;
+    EXPECT_EQ(t.transfers, 1u);
+    EXPECT_EQ(t.chunks, 10u);
+    EXPECT_EQ(t.bytes, 10240u);
+    EXPECT_GT(t.totalNs, 0u);
+    EXPECT_GE(t.totalNs, t.readNs + t.writeNs);
+    EXPECT_LE(t.percentileNs(50), t.percentileNs(99));
+    EXPECT_LE(t.percentileNs(99), t.maxChunkNs);
+    EXPECT_EQ(t.stalls, 0u);
+    // Short transfers still report a sensible rate
+    EXPECT_GT(result.bytesPerSecond, 10240.0);
+}
+
+TEST_F(TransferManagerTest, DetectsStalledChunks) {
+    std::string content(4096, 'W');
+    createFile(testDir + "/source/stall.bin", content);
+
+    syncv::TransferManager manager;
+    manager.setChunkSize(1024);
+    manager.setStallThresholdMs(10000);
+    auto fast = manager.transfer(testDir + "/source/stall.bin", testDir + "/dest/stall.bin");
+    EXPECT_EQ(fast.telemetry.stalls, 0u);
+
+    // With a zero threshold every chunk counts as stalled
+    manager.setStallThresholdMs(0);
+    auto slow = manager.transfer(testDir + "/source/stall.bin", testDir + "/dest/stall2.bin");
+    EXPECT_EQ(slow.telemetry.stalls, slow.telemetry.chunks);
+    EXPECT_GT(slow.telemetry.stalledNs, 0u);
+}
+
+TEST_F(TransferManagerTest, AggregatesTelemetryAcrossBatches) {
+    createFile(testDir + "/source/a.bin", std::string(3000, 'a'));
+    createFile(testDir + "/source/b.bin", std::string(5000, 'b'));
+
+    syncv::TransferManager manager;
+    manager.setChunkSize(1024);
+    auto results = manager.transferBatch({
+        {testDir + "/source/a.bin", testDir + "/dest/a.bin"},
+        {testDir + "/source/b.bin", testDir + "/dest/b.bin"},
+        {testDir + "/source/missing.bin", testDir + "/dest/missing.bin"},
+    });
+    ASSERT_EQ(results.size(), 3u);
+
+    const auto& agg = manager.getTelemetry();
+    EXPECT_EQ(agg.transfers, 2u);
+    EXPECT_EQ(agg.bytes, 8000u);
+    EXPECT_EQ(agg.chunks, results[0].telemetry.chunks + results[1].telemetry.chunks);
+
+    manager.resetTelemetry();
+    EXPECT_EQ(manager.getTelemetry().chunks, 0u);
+}
+
+TEST_F(TransferManagerTest, AtomicCommitNeverExposesPartialFile) {
+    std::string content(8192, 'A');
+    createFile(testDir + "/source/atomic.bin", content);
+    const std::string dst = testDir + "/dest/atomic.bin";
+    const std::string journal = testDir + "/transfer.journal";
+
+    syncv::TransferManager manager;
+    manager.setAtomicCommit(true);
+    ASSERT_TRUE(manager.setJournalPath(journal));
+    manager.setCheckpointInterval(0, 0);
+    manager.setChunkSize(1024);
+    manager.onProgress([](float pct) {
+        if (pct >= 50.0f) throw std::runtime_error("power loss");
+    });
+    EXPECT_THROW(manager.transfer(testDir + "/source/atomic.bin", dst), std::runtime_error);
+
+    // Only the staged file exists; the final name is untouched
+    EXPECT_FALSE(fs::exists(dst));
+    EXPECT_TRUE(fs::exists(dst + ".syncv-part"));
+
+    manager.onProgress(nullptr);
+    auto result = manager.resumeTransfer(testDir + "/source/atomic.bin", dst);
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(readFileContent(dst), content);
+    EXPECT_FALSE(fs::exists(dst + ".syncv-part"));
+    EXPECT_EQ(result.telemetry.syncs, 2u);  // file data + directory entry
+}
+
+TEST_F(TransferManagerTest, AtomicCommitReplacesExistingDestination) {
+    createFile(testDir + "/source/new.bin", "new contents");
+    createFile(testDir + "/dest/new.bin", "old contents that are longer");
+
+    syncv::TransferManager manager;
+    manager.setAtomicCommit(true);
+    auto result = manager.transfer(testDir + "/source/new.bin", testDir + "/dest/new.bin");
+
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(readFileContent(testDir + "/dest/new.bin"), "new contents");
+}
+
+TEST_F(TransferManagerTest, AtomicBatchUsesGroupCommit) {
+    std::vector<std::pair<std::string, std::string>> files;
+    for (int i = 0; i < 5; i++) {
+        std::string name = "g" + std::to_string(i) + ".bin";
+        createFile(testDir + "/source/" + name, std::string(2000 + i, 'g'));
+        files.emplace_back(testDir + "/source/" + name, testDir + "/dest/" + name);
+    }
+
+    syncv::TransferManager manager;
+    manager.setAtomicCommit(true);
+    auto results = manager.transferBatch(files);
+
+    ASSERT_EQ(results.size(), 5u);
+    for (size_t i = 0; i < files.size(); i++) {
+        EXPECT_TRUE(results[i].success);
+        EXPECT_EQ(readFileContent(files[i].second), std::string(2000 + i, 'g'));
+        EXPECT_FALSE(fs::exists(files[i].second + ".syncv-part"));
+    }
+    // Far fewer syncs than the 2-per-file a sequence of single commits costs
+    EXPECT_GE(manager.getTelemetry().syncs, 2u);
+    EXPECT_LT(manager.getTelemetry().syncs, 2u * files.size());
+}
+
+TEST_F(TransferManagerTest, FailedGroupSyncRemovesStagedParts) {
+    std::vector<std::pair<std::string, std::string>> files;
+    for (int i = 0; i < 3; i++) {
+        std::string name = "f" + std::to_string(i) + ".bin";
+        createFile(testDir + "/source/" + name, std::string(3000, 'f'));
+        files.emplace_back(testDir + "/source/" + name, testDir + "/dest/" + name);
+    }
+
+    syncv::TransferManager manager;
+    manager.setAtomicCommit(true);
+    // Lose the first staged file while the last one is copied, so the
+    // group sync cannot find it
+    const std::string lost = files[0].second + ".syncv-part";
+    manager.onProgress([&](float) {
+        std::error_code ec;
+        if (fs::exists(files[2].second + ".syncv-part")) fs::remove(lost, ec);
+    });
+    auto results = manager.transferBatch(files);
+
+    ASSERT_EQ(results.size(), 3u);
+    for (size_t i = 0; i < files.size(); i++) {
+        EXPECT_FALSE(results[i].success);
+        EXPECT_EQ(results[i].errorMessage, "Failed to sync destination");
+        EXPECT_FALSE(fs::exists(files[i].second));
+        EXPECT_FALSE(fs::exists(files[i].second + ".syncv-part"));
+    }
+    EXPECT_GT(manager.getTelemetry().syncNs, 0u);
+}
+
+TEST_F(TransferManagerTest, SparseCopySkipsHolesAndZeroRuns) {
+    const std::string srcPath = testDir + "/source/image.img";
+    const uint64_t imageSize = 8 * 1024 * 1024;
+    {
+        // Mostly-empty image: a header, a block in the middle, nothing at the end
+        std::ofstream f(srcPath, std::ios::binary);
+        f << "BOOTSECTOR";
+        f.seekp(4 * 1024 * 1024);
+        f << "DATA";
+    }
+    fs::resize_file(srcPath, imageSize);
+
+    syncv::TransferManager manager;
+    manager.setSparseCopy(true);
+    auto result = manager.transfer(srcPath, testDir + "/dest/image.img");
+
+    ASSERT_TRUE(result.success);
+    EXPECT_EQ(fs::file_size(testDir + "/dest/image.img"), imageSize);
+    EXPECT_EQ(readFileContent(testDir + "/dest/image.img"), readFileContent(srcPath));
+    // Nearly all of the image was skipped rather than copied
+    EXPECT_GT(result.telemetry.holeBytes, imageSize - 256 * 1024);
+}
+
+TEST_F(TransferManagerTest, SparseCopyWithJournalResumesCorrectly) {
+    const std::string srcPath = testDir + "/source/zeros.img";
+    std::string content(16384, '\0');
+    content.replace(9000, 5, "HELLO");
+    createFile(srcPath, content);
+    const std::string journal = testDir + "/transfer.journal";
+
+    {
+        syncv::TransferManager manager;
+        ASSERT_TRUE(manager.setJournalPath(journal));
+        manager.setCheckpointInterval(0, 0);
+        manager.setSparseCopy(true);
+        manager.setChunkSize(1024);
+        manager.setVerifyBlockSize(2048);
+        manager.onProgress([](float pct) {
+            if (pct >= 75.0f) throw std::runtime_error("power loss");
+        });
+        EXPECT_THROW(manager.transfer(srcPath, testDir + "/dest/zeros.img"), std::runtime_error);
+    }
+
+    syncv::TransferManager restarted;
+    ASSERT_TRUE(restarted.setJournalPath(journal));
+    restarted.setSparseCopy(true);
+    restarted.setVerifyBlockSize(2048);
+    auto result = restarted.resumeTransfer(srcPath, testDir + "/dest/zeros.img");
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(result.resumedFrom, 8192u);  // holes verify as zeros
+    EXPECT_EQ(readFileContent(testDir + "/dest/zeros.img"), content);
+}
+
+namespace {
+std::string patternedContent(size_t size, unsigned seed) {
+    std::string s(size, '\0');
+    uint32_t x = seed;
+    for (auto& c : s) {
+        x = x * 1103515245u + 12345u;
+        c = static_cast<char>(x >> 16);
+    }
+    return s;
+}
+}
+
+TEST_F(TransferManagerTest, DeltaTransferWritesOnlyAppendedTail) {
+    std::string old = patternedContent(100 * 1024, 1);
+    std::string grown = old + patternedContent(5000, 2);
+    createFile(testDir + "/source/grow.log", grown);
+    createFile(testDir + "/dest/grow.log", old);
+
+    syncv::TransferManager manager;
+    auto result = manager.transferDelta(testDir + "/source/grow.log", testDir + "/dest/grow.log");
+
+    ASSERT_TRUE(result.success);
+    EXPECT_EQ(readFileContent(testDir + "/dest/grow.log"), grown);
+    EXPECT_EQ(result.bytesSkipped, 100u * 1024);
+    EXPECT_EQ(result.telemetry.bytes, 5000u);
+}
+
+TEST_F(TransferManagerTest, DeltaTransferRewritesOnlyChangedBlock) {
+    std::string old = patternedContent(64 * 1024, 3);
+    std::string changed = old;
+    changed[30000] ^= 0x5a;
+    createFile(testDir + "/source/img.bin", changed);
+    createFile(testDir + "/dest/img.bin", old);
+
+    syncv::TransferManager manager;
+    manager.setDeltaBlockSize(1024);
+    auto result = manager.transferDelta(testDir + "/source/img.bin", testDir + "/dest/img.bin");
+
+    ASSERT_TRUE(result.success);
+    EXPECT_EQ(readFileContent(testDir + "/dest/img.bin"), changed);
+    EXPECT_LE(result.telemetry.bytes, 1024u);
+    EXPECT_GE(result.bytesSkipped, 63u * 1024);
+    // Hashed while rolling, without reading either file again
+    EXPECT_EQ(result.sha256, syncv::HashVerifier().hashString(changed));
+}
+
+TEST_F(TransferManagerTest, DeltaTransferHandlesShiftedAndShrunkContent) {
+    std::string old = patternedContent(20000, 4);
+    std::string shifted = "INSERTED" + old.substr(0, 15000);
+    createFile(testDir + "/source/shift.bin", shifted);
+    createFile(testDir + "/dest/shift.bin", old);
+
+    syncv::TransferManager manager;
+    manager.setDeltaBlockSize(512);
+    auto result = manager.transferDelta(testDir + "/source/shift.bin", testDir + "/dest/shift.bin");
+
+    ASSERT_TRUE(result.success);
+    EXPECT_EQ(readFileContent(testDir + "/dest/shift.bin"), shifted);
+    EXPECT_EQ(fs::file_size(testDir + "/dest/shift.bin"), shifted.size());
+}
+
+TEST_F(TransferManagerTest, DeltaVerifyRepairsBlocksTrustedByMistake) {
+    std::string old = patternedContent(64 * 1024, 5);
+    std::string changed = old;
+    changed[100] ^= 0x11;
+    const std::string dst = testDir + "/dest/drift.bin";
+
+    for (bool verify : {true, false}) {
+        createFile(testDir + "/source/drift.bin", changed);
+        createFile(dst, old);
+
+        // Damage a block after it was indexed, so its stale match is wrong
+        syncv::TransferManager manager;
+        manager.setDeltaBlockSize(1024);
+        manager.setChunkSize(4096);
+        manager.setDeltaVerify(verify);
+        bool damaged = false;
+        manager.onProgress([&](float) {
+            if (damaged) return;
+            std::fstream f(dst, std::ios::in | std::ios::out | std::ios::binary);
+            f.seekp(50000);
+            f.put('#');
+            damaged = true;
+        });
+        auto result = manager.transferDelta(testDir + "/source/drift.bin", dst);
+
+        ASSERT_TRUE(result.success);
+        EXPECT_EQ(readFileContent(dst) == changed, verify);
+    }
+}
+
+TEST_F(TransferManagerTest, AbortedDeltaLeavesSourcePrefixAndOldTail) {
+    std::string old = patternedContent(32 * 1024, 6);
+    std::string fresh = patternedContent(32 * 1024, 7);
+    createFile(testDir + "/source/part.bin", fresh);
+    createFile(testDir + "/dest/part.bin", old);
+
+    syncv::TransferManager manager;
+    manager.setDeltaBlockSize(1024);
+    manager.setChunkSize(4096);
+    int refills = 0;
+    manager.onProgress([&](float) { refills++; });
+    manager.setAbortCheck([&]() { return refills >= 3; });
+    auto result = manager.transferDelta(testDir + "/source/part.bin", testDir + "/dest/part.bin");
+
+    EXPECT_FALSE(result.success);
+    EXPECT_EQ(result.errorMessage, "Transfer aborted");
+    const uint64_t done = result.bytesTransferred;
+    ASSERT_GT(done, 0u);
+    ASSERT_LT(done, fresh.size());
+    std::string onDisk = readFileContent(testDir + "/dest/part.bin");
+    EXPECT_EQ(onDisk, fresh.substr(0, done) + old.substr(done));
+    EXPECT_EQ(manager.getTelemetry().bytes, done);
+
+    // Running it again finishes the job and skips the prefix already written
+    manager.setAbortCheck(nullptr);
+    result = manager.transferDelta(testDir + "/source/part.bin", testDir + "/dest/part.bin");
+    ASSERT_TRUE(result.success);
+    EXPECT_EQ(readFileContent(testDir + "/dest/part.bin"), fresh);
+    EXPECT_GE(result.bytesSkipped, done / 1024 * 1024);
+}
+
+TEST_F(TransferManagerTest, DeltaTransferWithoutDestinationCopiesFully) {
+    createFile(testDir + "/source/fresh.bin", "brand new");
+
+    syncv::TransferManager manager;
+    auto result = manager.transferDelta(testDir + "/source/fresh.bin", testDir + "/dest/fresh.bin");
+
+    ASSERT_TRUE(result.success);
+    EXPECT_EQ(result.bytesSkipped, 0u);
+    EXPECT_EQ(readFileContent(testDir + "/dest/fresh.bin"), "brand new");
+}
+
+TEST_F(TransferManagerTest, VerifiedTransferReturnsSha256OfData) {
+    std::string content = patternedContent(200 * 1024, 5);
+    createFile(testDir + "/source/fw.bin", content);
+
+    syncv::TransferManager manager;
+    manager.setChunkSize(4096);
+    auto result = manager.transferVerified(testDir + "/source/fw.bin", testDir + "/dest/fw.bin");
+
+    ASSERT_TRUE(result.success);
+    syncv::HashVerifier verifier;
+    EXPECT_EQ(result.sha256, verifier.hashFile(testDir + "/source/fw.bin"));
+    EXPECT_EQ(readFileContent(testDir + "/dest/fw.bin"), content);
+}
+
+TEST_F(TransferManagerTest, VerifiedTransferRejectsWrongHash) {
+    createFile(testDir + "/source/fw.bin", "firmware image");
+
+    syncv::TransferManager manager;
+    manager.setAtomicCommit(true);
+    auto result = manager.transferVerified(testDir + "/source/fw.bin", testDir + "/dest/fw.bin",
+                                           std::string(64, '0'));
+
+    EXPECT_FALSE(result.success);
+    EXPECT_EQ(result.errorMessage, "Hash mismatch");
+    EXPECT_FALSE(fs::exists(testDir + "/dest/fw.bin"));
+    EXPECT_FALSE(fs::exists(testDir + "/dest/fw.bin.syncv-part"));
+}
+
+TEST_F(TransferManagerTest, VerifiedTransferAcceptsUppercaseExpectedHash) {
+    createFile(testDir + "/source/fw.bin", "firmware image");
+    syncv::HashVerifier verifier;
+    std::string expected = verifier.hashFile(testDir + "/source/fw.bin");
+    std::transform(expected.begin(), expected.end(), expected.begin(), ::toupper);
+
+    syncv::TransferManager manager;
+    auto result = manager.transferVerified(testDir + "/source/fw.bin", testDir + "/dest/fw.bin",
+                                           expected);
+
+    EXPECT_TRUE(result.success);
+}
+
+TEST_F(TransferManagerTest, HashedResumeCoversWholeFile) {
+    std::string content = patternedContent(50000, 6);
+    createFile(testDir + "/source/log.bin", content);
+    createFile(testDir + "/dest/log.bin", content.substr(0, 20000));
+
+    syncv::TransferManager manager;
+    manager.setHashTransfers(true);
+    manager.recordPartialTransfer(testDir + "/source/log.bin", testDir + "/dest/log.bin", 20000);
+    auto result = manager.resumeTransfer(testDir + "/source/log.bin", testDir + "/dest/log.bin");
+
+    ASSERT_TRUE(result.success);
+    syncv::HashVerifier verifier;
+    EXPECT_EQ(result.sha256, verifier.hashFile(testDir + "/source/log.bin"));
+}
+
+TEST_F(TransferManagerTest, HashedSparseCopyMatchesSource) {
+    std::string content(64 * 1024, '\0');
+    content += patternedContent(10000, 7);
+    content += std::string(64 * 1024, '\0');
+    createFile(testDir + "/source/img.bin", content);
+
+    syncv::TransferManager manager;
+    manager.setSparseCopy(true);
+    manager.setHashTransfers(true);
+    auto result = manager.transfer(testDir + "/source/img.bin", testDir + "/dest/img.bin");
+
+    ASSERT_TRUE(result.success);
+    syncv::HashVerifier verifier;
+    EXPECT_EQ(result.sha256, verifier.hashFile(testDir + "/source/img.bin"));
+}
+
+TEST_F(TransferManagerTest, FanOutWritesEveryDestinationFromOneRead) {
+    std::string content = patternedContent(300 * 1024, 8);
+    createFile(testDir + "/source/log.bin", content);
+    fs::create_directories(testDir + "/dest/a");
+    fs::create_directories(testDir + "/dest/b");
+
+    syncv::TransferManager manager;
+    manager.setChunkSize(8192);
+    manager.setHashTransfers(true);
+    auto results = manager.transferFanOut(testDir + "/source/log.bin",
+        {testDir + "/dest/a/log.bin", testDir + "/dest/b/log.bin", testDir + "/dest/log.bin"});
+
+    ASSERT_EQ(results.size(), 3u);
+    syncv::HashVerifier verifier;
+    std::string expected = verifier.hashFile(testDir + "/source/log.bin");
+    for (const auto& r : results) {
+        EXPECT_TRUE(r.success);
+        EXPECT_EQ(r.bytesTransferred, content.size());
+        EXPECT_EQ(r.sha256, expected);
+    }
+    EXPECT_EQ(readFileContent(testDir + "/dest/a/log.bin"), content);
+    EXPECT_EQ(readFileContent(testDir + "/dest/b/log.bin"), content);
+    EXPECT_EQ(readFileContent(testDir + "/dest/log.bin"), content);
+    // The source was read once, not once per destination
+    EXPECT_EQ(manager.getTelemetry().chunks, (content.size() + 8191) / 8192);
+}
+
+TEST_F(TransferManagerTest, FanOutIsolatesFailingDestination) {
+    std::string content = patternedContent(50000, 9);
+    createFile(testDir + "/source/log.bin", content);
+
+    syncv::TransferManager manager;
+    manager.setAtomicCommit(true);
+    auto results = manager.transferFanOut(testDir + "/source/log.bin",
+        {testDir + "/missing-dir/log.bin", testDir + "/dest/log.bin"});
+
+    ASSERT_EQ(results.size(), 2u);
+    EXPECT_FALSE(results[0].success);
+    EXPECT_EQ(results[0].errorMessage, "Cannot open destination file");
+    EXPECT_TRUE(results[1].success);
+    EXPECT_EQ(readFileContent(testDir + "/dest/log.bin"), content);
+    EXPECT_FALSE(fs::exists(testDir + "/dest/log.bin.syncv-part"));
+}
+
+TEST_F(TransferManagerTest, FanOutMissingSourceFailsAllDestinations) {
+    syncv::TransferManager manager;
+    auto results = manager.transferFanOut(testDir + "/source/none.bin",
+        {testDir + "/dest/a.bin", testDir + "/dest/b.bin"});
+
+    ASSERT_EQ(results.size(), 2u);
+    EXPECT_FALSE(results[0].success);
+    EXPECT_FALSE(results[1].success);
+}
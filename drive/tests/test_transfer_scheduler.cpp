@@ -0,0 +1,233 @@
+#include <gtest/gtest.h>
+#include "TransferScheduler.h"
+#include <filesystem>
+#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+class TransferSchedulerTest : public ::testing::Test {
+protected:
+    std::string testDir;
+
+    void SetUp() override {
+        testDir = "test_scheduler_" + std::to_string(::testing::UnitTest::GetInstance()->random_seed());
+        fs::create_directories(testDir + "/source");
+        fs::create_directories(testDir + "/dest");
+    }
+
+    void TearDown() override {
+        fs::remove_all(testDir);
+    }
+
+    void createFile(const std::string& path, const std::string& content) {
+        std::ofstream f(path, std::ios::binary);
+        f << content;
+    }
+
+    std::string readFileContent(const std::string& path) {
+        std::ifstream f(path, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(f)),
+                           std::istreambuf_iterator<char>());
+    }
+};
+
+TEST_F(TransferSchedulerTest, CompletesSubmittedTransfer) {
+    createFile(testDir + "/source/a.bin", "async content");
+
+    syncv::TransferManager manager;
+    syncv::TransferScheduler scheduler(manager);
+    auto handle = scheduler.submit(testDir + "/source/a.bin", testDir + "/dest/a.bin");
+
+    auto result = handle.result().get();
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(handle.state(), syncv::TransferState::Completed);
+    EXPECT_EQ(readFileContent(testDir + "/dest/a.bin"), "async content");
+}
+
+TEST_F(TransferSchedulerTest, SubmitDoesNotBlockCaller) {
+    createFile(testDir + "/source/slow.bin", std::string(64 * 1024, 'S'));
+
+    syncv::TransferManager manager;
+    manager.setChunkSize(1024);
+    std::atomic<bool> release{false};
+    manager.onProgress([&](float) {
+        while (!release) std::this_thread::sleep_for(1ms);
+    });
+
+    syncv::TransferScheduler scheduler(manager);
+    auto start = std::chrono::steady_clock::now();
+    auto handle = scheduler.submit(testDir + "/source/slow.bin", testDir + "/dest/slow.bin");
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 100ms);
+
+    release = true;
+    EXPECT_TRUE(handle.result().get().success);
+}
+
+TEST_F(TransferSchedulerTest, RunsHigherPriorityFirst) {
+    createFile(testDir + "/source/gate.bin", std::string(4096, 'G'));
+    createFile(testDir + "/source/low.bin", "low");
+    createFile(testDir + "/source/high.bin", "high");
+
+    syncv::TransferManager manager;
+    manager.setChunkSize(1024);
+    std::atomic<bool> release{false};
+    std::vector<std::string> order;  // only touched by the worker until waitIdle()
+    manager.onProgress([&](float) {
+        while (!release) std::this_thread::sleep_for(1ms);
+        for (const char* name : {"high", "low"}) {
+            if (fs::exists(testDir + "/dest/" + name + ".bin") &&
+                std::find(order.begin(), order.end(), name) == order.end()) {
+                order.push_back(name);
+            }
+        }
+    });
+
+    syncv::TransferScheduler scheduler(manager);
+    // Occupy the worker so the next two are queued together
+    auto gate = scheduler.submit(testDir + "/source/gate.bin", testDir + "/dest/gate.bin");
+    while (gate.state() != syncv::TransferState::Running) std::this_thread::sleep_for(1ms);
+
+    scheduler.submit(testDir + "/source/low.bin", testDir + "/dest/low.bin",
+                     syncv::TransferPriority::Low);
+    scheduler.submit(testDir + "/source/high.bin", testDir + "/dest/high.bin",
+                     syncv::TransferPriority::High);
+    EXPECT_EQ(scheduler.pendingCount(), 2u);
+
+    release = true;
+    scheduler.waitIdle();
+    ASSERT_EQ(order.size(), 2u);
+    EXPECT_EQ(order[0], "high");
+    EXPECT_EQ(order[1], "low");
+}
+
+TEST_F(TransferSchedulerTest, CancelsQueuedAndRunningTransfers) {
+    createFile(testDir + "/source/gate.bin", std::string(8192, 'G'));
+    createFile(testDir + "/source/next.bin", "next");
+
+    syncv::TransferManager manager;
+    manager.setChunkSize(1024);
+    std::atomic<bool> release{false};
+    manager.onProgress([&](float) {
+        while (!release) std::this_thread::sleep_for(1ms);
+    });
+
+    syncv::TransferScheduler scheduler(manager);
+    auto gate = scheduler.submit(testDir + "/source/gate.bin", testDir + "/dest/gate.bin");
+    while (gate.state() != syncv::TransferState::Running) std::this_thread::sleep_for(1ms);
+    auto queued = scheduler.submit(testDir + "/source/next.bin", testDir + "/dest/next.bin");
+
+    // A queued job resolves immediately, without waiting for the worker
+    queued.cancel();
+    ASSERT_EQ(queued.result().wait_for(0s), std::future_status::ready);
+    EXPECT_FALSE(queued.result().get().success);
+    EXPECT_EQ(queued.state(), syncv::TransferState::Cancelled);
+
+    // A running job stops at the next chunk boundary
+    gate.cancel();
+    release = true;
+    auto result = gate.result().get();
+    EXPECT_FALSE(result.success);
+    EXPECT_EQ(gate.state(), syncv::TransferState::Cancelled);
+    EXPECT_LT(result.bytesTransferred, 8192u);
+    EXPECT_FALSE(fs::exists(testDir + "/dest/next.bin"));
+}
+
+TEST_F(TransferSchedulerTest, FailsTransfersPastTheirDeadline) {
+    createFile(testDir + "/source/late.bin", "late");
+
+    syncv::TransferManager manager;
+    syncv::TransferScheduler scheduler(manager);
+
+    syncv::TransferRequest request;
+    request.srcPath = testDir + "/source/late.bin";
+    request.dstPath = testDir + "/dest/late.bin";
+    request.deadline = std::chrono::steady_clock::now() - 1ms;
+    auto handle = scheduler.submit(request);
+
+    auto result = handle.result().get();
+    EXPECT_FALSE(result.success);
+    EXPECT_EQ(result.errorMessage, "Deadline exceeded");
+    EXPECT_EQ(handle.state(), syncv::TransferState::Failed);
+}
+
+TEST_F(TransferSchedulerTest, BackoffDoesNotBlockOtherTransfers) {
+    createFile(testDir + "/source/ok.bin", "ok");
+
+    syncv::TransferManager manager;
+    manager.setMaxRetries(3);
+    manager.setBaseBackoffMs(200);
+    syncv::TransferScheduler scheduler(manager);
+
+    // First attempt fails (source not there yet) and backs off
+    auto retried = scheduler.submit(testDir + "/source/later.bin", testDir + "/dest/later.bin");
+    while (retried.state() != syncv::TransferState::Waiting) std::this_thread::sleep_for(1ms);
+
+    // Another transfer runs to completion while the first is waiting
+    auto other = scheduler.submit(testDir + "/source/ok.bin", testDir + "/dest/ok.bin");
+    EXPECT_TRUE(other.result().get().success);
+    EXPECT_EQ(retried.state(), syncv::TransferState::Waiting);
+
+    createFile(testDir + "/source/later.bin", "arrived");
+    auto result = retried.result().get();
+    EXPECT_TRUE(result.success);
+    EXPECT_EQ(readFileContent(testDir + "/dest/later.bin"), "arrived");
+}
+
+TEST_F(TransferSchedulerTest, StalledTransferDoesNotBlockOtherWorkers) {
+    createFile(testDir + "/source/stuck.bin", std::string(8 * 1024, 'S'));
+    createFile(testDir + "/source/quick.bin", "quick");
+
+    // Whichever worker reports progress first stalls until released
+    syncv::TransferManager first, second;
+    std::atomic<bool> release{false};
+    std::mutex stallMutex;
+    std::thread::id stalled;
+    for (auto* m : {&first, &second}) {
+        m->setChunkSize(1024);
+        m->onProgress([&](float) {
+            {
+                std::lock_guard<std::mutex> lock(stallMutex);
+                if (stalled == std::thread::id()) stalled = std::this_thread::get_id();
+                if (stalled != std::this_thread::get_id()) return;
+            }
+            while (!release) std::this_thread::sleep_for(1ms);
+        });
+    }
+
+    syncv::TransferScheduler scheduler({&first, &second});
+    auto stuck = scheduler.submit(testDir + "/source/stuck.bin", testDir + "/dest/stuck.bin");
+    while (stuck.state() != syncv::TransferState::Running) std::this_thread::sleep_for(1ms);
+    auto quick = scheduler.submit(testDir + "/source/quick.bin", testDir + "/dest/quick.bin");
+
+    EXPECT_EQ(quick.result().wait_for(5s), std::future_status::ready);
+    EXPECT_TRUE(quick.result().get().success);
+    EXPECT_EQ(stuck.state(), syncv::TransferState::Running);
+
+    release = true;
+    EXPECT_TRUE(stuck.result().get().success);
+    EXPECT_EQ(readFileContent(testDir + "/dest/stuck.bin"), std::string(8 * 1024, 'S'));
+}
+
+TEST_F(TransferSchedulerTest, ShutdownCancelsPendingWork) {
+    createFile(testDir + "/source/a.bin", "a");
+
+    syncv::TransferManager manager;
+    manager.setBaseBackoffMs(10000);
+    auto scheduler = std::make_unique<syncv::TransferScheduler>(manager);
+    auto waiting = scheduler->submit(testDir + "/source/missing.bin", testDir + "/dest/m.bin");
+    while (waiting.state() != syncv::TransferState::Waiting) std::this_thread::sleep_for(1ms);
+
+    scheduler.reset();
+    EXPECT_EQ(waiting.state(), syncv::TransferState::Cancelled);
+
+    // Handles stay usable after the scheduler is gone
+    waiting.cancel();
+    EXPECT_FALSE(waiting.result().get().success);
+}
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 #include "UsbGadget.h"
+#include "Fat32Image.h"
+#include "HashVerifier.h"
 #include <filesystem>
 #include <fstream>
 
@@ -131,3 +133,331 @@ TEST_F(UsbGadgetTest, RefreshEmptyFilesParam) {
     // Just verify it doesn't crash with empty file list
     EXPECT_FALSE(gadget.isExposed());
 }
+
+// With the userspace FAT32 writer, image preparation runs without root
+
+TEST_F(UsbGadgetTest, PrepareImageBuildsImageWithoutRoot) {
+    createTestFile("device-001.log", "boot ok\n");
+    createTestFile("v1.2.3.bin", std::string(10000, 'f'));
+
+    syncv::UsbGadgetConfig cfg;
+    cfg.imagePath = imageDir + "/drive.img";
+    syncv::UsbGadget gadget(cfg);
+
+    ASSERT_TRUE(gadget.prepareImage({{srcDir + "/device-001.log", "device-001.log"},
+                                     {srcDir + "/v1.2.3.bin", "firmware/v1.2.3.bin"}}));
+    EXPECT_EQ(gadget.getLastPrepareStats().copied, 2u);
+
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(cfg.imagePath));
+    std::string out;
+    ASSERT_TRUE(image.readFile("device-001.log", out));
+    EXPECT_EQ(out, "boot ok\n");
+    EXPECT_EQ(image.fileSize("firmware/v1.2.3.bin"), 10000);
+}
+
+TEST_F(UsbGadgetTest, IncrementalPrepareCopiesOnlyChanges) {
+    createTestFile("a.log", "alpha");
+    createTestFile("b.log", "bravo");
+    std::vector<std::pair<std::string, std::string>> files = {
+        {srcDir + "/a.log", "a.log"}, {srcDir + "/b.log", "b.log"}};
+
+    syncv::UsbGadgetConfig cfg;
+    cfg.imagePath = imageDir + "/drive.img";
+    syncv::UsbGadget gadget(cfg);
+    ASSERT_TRUE(gadget.prepareImage(files));
+    EXPECT_EQ(gadget.getLastPrepareStats().copied, 2u);
+
+    ASSERT_TRUE(gadget.prepareImage(files));
+    EXPECT_EQ(gadget.getLastPrepareStats().copied, 0u);
+    EXPECT_EQ(gadget.getLastPrepareStats().unchanged, 2u);
+
+    createTestFile("b.log", "bravo, now longer");
+    ASSERT_TRUE(gadget.prepareImage(files));
+    EXPECT_EQ(gadget.getLastPrepareStats().copied, 1u);
+    EXPECT_EQ(gadget.getLastPrepareStats().bytesCopied, 17u);
+
+    // A new gadget picks up the saved manifest
+    syncv::UsbGadget restarted(cfg);
+    ASSERT_TRUE(restarted.prepareImage(files));
+    EXPECT_EQ(restarted.getLastPrepareStats().copied, 0u);
+}
+
+TEST_F(UsbGadgetTest, PrepareImageRemovesStaleNestedFiles) {
+    createTestFile("a.log", "alpha");
+    createTestFile("old.bin", "old firmware");
+
+    syncv::UsbGadgetConfig cfg;
+    cfg.imagePath = imageDir + "/drive.img";
+    syncv::UsbGadget gadget(cfg);
+    ASSERT_TRUE(gadget.prepareImage({{srcDir + "/a.log", "a.log"},
+                                     {srcDir + "/old.bin", "firmware/old.bin"}}));
+    ASSERT_TRUE(gadget.prepareImage({{srcDir + "/a.log", "a.log"}}));
+    EXPECT_EQ(gadget.getLastPrepareStats().removed, 1u);
+
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(cfg.imagePath));
+    EXPECT_EQ(image.listFiles(), (std::vector<std::string>{"a.log", "SYNCV-MANIFEST.TSV"}));
+    EXPECT_TRUE(image.listDirectories().empty());
+}
+
+TEST_F(UsbGadgetTest, AbImagesPrepareActiveImageBeforeFirstExpose) {
+    createTestFile("a.log", "alpha");
+
+    syncv::UsbGadgetConfig cfg;
+    cfg.imagePath = imageDir + "/drive.img";
+    cfg.abImages = true;
+    syncv::UsbGadget gadget(cfg);
+    EXPECT_EQ(gadget.activeImagePath(), cfg.imagePath);
+
+    // Nothing is exposed yet, so the active image is prepared in place
+    ASSERT_TRUE(gadget.prepareImage({{srcDir + "/a.log", "a.log"}}));
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(cfg.imagePath));
+    EXPECT_EQ(image.fileSize("a.log"), 5);
+    EXPECT_FALSE(fs::exists(imageDir + "/drive-b.img"));
+}
+
+// Capacity planning: a 34 MB image holds about 33 MB of data
+
+TEST_F(UsbGadgetTest, FullImageKeepsNewestFilesAndCopiesNothingDoomed) {
+    const uint64_t mb = 1024 * 1024;
+    std::vector<std::pair<std::string, std::string>> files;
+    for (int i = 0; i < 3; i++) {
+        std::string name = "day" + std::to_string(i) + ".log";
+        createTestFile(name, "");
+        fs::resize_file(srcDir + "/" + name, 15 * mb);
+        fs::last_write_time(srcDir + "/" + name,
+                            fs::file_time_type::clock::now() - std::chrono::hours(24 * (3 - i)));
+        files.emplace_back(srcDir + "/" + name, name);
+    }
+
+    syncv::UsbGadgetConfig cfg;
+    cfg.imagePath = imageDir + "/drive.img";
+    cfg.imageSizeMB = 34;
+    syncv::UsbGadget gadget(cfg);
+    ASSERT_TRUE(gadget.prepareImage(files));
+
+    const auto& stats = gadget.getLastPrepareStats();
+    EXPECT_EQ(stats.copied, 2u);
+    EXPECT_EQ(stats.failed, 0u);
+    EXPECT_EQ(stats.evicted, 1u);
+    EXPECT_EQ(stats.evictedBytes, 15 * mb);
+
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(cfg.imagePath));
+    EXPECT_EQ(image.fileSize("day0.log"), -1);       // oldest left out
+    EXPECT_EQ(image.fileSize("day2.log"), static_cast<int64_t>(15 * mb));
+}
+
+TEST_F(UsbGadgetTest, FullImageMakesRoomForPriorityFiles) {
+    const uint64_t mb = 1024 * 1024;
+    createTestFile("old.log", "");
+    fs::resize_file(srcDir + "/old.log", 20 * mb);
+    fs::last_write_time(srcDir + "/old.log",
+                        fs::file_time_type::clock::now() - std::chrono::hours(24));
+    createTestFile("new.log", "");
+    fs::resize_file(srcDir + "/new.log", 8 * mb);
+
+    syncv::UsbGadgetConfig cfg;
+    cfg.imagePath = imageDir + "/drive.img";
+    cfg.imageSizeMB = 34;
+    syncv::UsbGadget gadget(cfg);
+    ASSERT_TRUE(gadget.prepareImage({{srcDir + "/old.log", "old.log"},
+                                     {srcDir + "/new.log", "new.log"}}));
+    EXPECT_EQ(gadget.getLastPrepareStats().evicted, 0u);
+
+    // Firmware outranks logs even though it is older, and the evicted log
+    // is removed before the firmware is copied into its space
+    createTestFile("v2.bin", "");
+    fs::resize_file(srcDir + "/v2.bin", 12 * mb);
+    fs::last_write_time(srcDir + "/v2.bin",
+                        fs::file_time_type::clock::now() - std::chrono::hours(48));
+    ASSERT_TRUE(gadget.prepareImage({{srcDir + "/old.log", "old.log"},
+                                     {srcDir + "/new.log", "new.log"},
+                                     {srcDir + "/v2.bin", "firmware/v2.bin"}}));
+    EXPECT_EQ(gadget.getLastPrepareStats().failed, 0u);
+    EXPECT_EQ(gadget.getLastPrepareStats().evicted, 1u);
+
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(cfg.imagePath));
+    EXPECT_EQ(image.fileSize("firmware/v2.bin"), static_cast<int64_t>(12 * mb));
+    EXPECT_EQ(image.fileSize("new.log"), static_cast<int64_t>(8 * mb));
+    EXPECT_EQ(image.fileSize("old.log"), -1);
+}
+
+TEST_F(UsbGadgetTest, OverfullImageWithManyFilesStaysValid) {
+    // Thousands of small files: the directory itself needs hundreds of clusters
+    const std::string block(16 * 1024, 'x');
+    std::vector<std::pair<std::string, std::string>> files;
+    for (int i = 0; i < 2300; i++) {
+        std::string name = "log_" + std::to_string(i) + ".txt";
+        createTestFile(name, block);
+        files.emplace_back(srcDir + "/" + name, "logs/" + name);
+    }
+
+    syncv::UsbGadgetConfig cfg;
+    cfg.imagePath = imageDir + "/drive.img";
+    cfg.imageSizeMB = 34;
+    cfg.hostManifest.clear();                   // its reserve would hide the growth
+    syncv::UsbGadget gadget(cfg);
+    ASSERT_TRUE(gadget.prepareImage(files));
+
+    const auto& stats = gadget.getLastPrepareStats();
+    EXPECT_EQ(stats.failed, 0u);
+    EXPECT_GT(stats.evicted, 0u);
+    EXPECT_EQ(stats.copied + stats.evicted, files.size());
+
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(cfg.imagePath));
+    EXPECT_EQ(image.listFiles().size(), stats.copied);
+}
+
+// Multi-LUN: firmware on its own volume
+
+TEST_F(UsbGadgetTest, ExtraLunTakesPrefixedFiles) {
+    createTestFile("a.log", "alpha");
+    createTestFile("v1.bin", "firmware v1");
+
+    syncv::UsbGadgetConfig cfg;
+    cfg.imagePath = imageDir + "/drive.img";
+    cfg.extraLuns.push_back({"firmware/", imageDir + "/firmware.img", 40, "SYNCVFW"});
+    syncv::UsbGadget gadget(cfg);
+    ASSERT_EQ(gadget.lunCount(), 2u);
+    EXPECT_EQ(gadget.activeImagePath(1), imageDir + "/firmware.img");
+
+    ASSERT_TRUE(gadget.prepareImage({{srcDir + "/a.log", "a.log"},
+                                     {srcDir + "/v1.bin", "firmware/v1.bin"}}));
+    EXPECT_EQ(gadget.getLastPrepareStats().copied, 2u);
+
+    syncv::Fat32Image logs;
+    ASSERT_TRUE(logs.open(cfg.imagePath));
+    EXPECT_EQ(logs.fileSize("a.log"), 5);
+    EXPECT_EQ(logs.fileSize("v1.bin"), -1);
+
+    syncv::Fat32Image firmware;
+    ASSERT_TRUE(firmware.open(imageDir + "/firmware.img"));
+    EXPECT_EQ(firmware.fileSize("v1.bin"), 11);
+    EXPECT_EQ(firmware.fileSize("a.log"), -1);
+}
+
+TEST_F(UsbGadgetTest, RefreshTouchesOnlyChangedLuns) {
+    createTestFile("a.log", "alpha");
+    createTestFile("v1.bin", "firmware v1");
+    std::vector<std::pair<std::string, std::string>> files = {
+        {srcDir + "/a.log", "a.log"}, {srcDir + "/v1.bin", "firmware/v1.bin"}};
+
+    syncv::UsbGadgetConfig cfg;
+    cfg.imagePath = imageDir + "/drive.img";
+    cfg.extraLuns.push_back({"firmware/", imageDir + "/firmware.img", 40, "SYNCVFW"});
+    syncv::UsbGadget gadget(cfg);
+    ASSERT_TRUE(gadget.prepareImage(files));
+
+    // Nothing changed: no LUN is prepared, nothing is unbound
+    EXPECT_TRUE(gadget.refresh(files));
+    EXPECT_EQ(gadget.getLastPrepareStats().copied, 0u);
+    EXPECT_EQ(gadget.getLastPrepareStats().unchanged, 0u);
+
+    // A log changed: only the log LUN is prepared (re-exposing needs
+    // configfs, so refresh() itself reports failure here)
+    createTestFile("a.log", "alpha, appended");
+    gadget.refresh(files);
+    EXPECT_EQ(gadget.getLastPrepareStats().copied, 1u);
+    EXPECT_EQ(gadget.getLastPrepareStats().unchanged, 0u);
+
+    syncv::Fat32Image logs;
+    ASSERT_TRUE(logs.open(cfg.imagePath));
+    EXPECT_EQ(logs.fileSize("a.log"), 15);
+}
+
+// Refresh telemetry
+
+TEST_F(UsbGadgetTest, StageStatsPercentiles) {
+    syncv::UsbStageStats stats;
+    EXPECT_EQ(stats.percentileUs(50), 0u);
+    for (uint64_t us = 1; us <= 100; us++) stats.record(us * 1000);
+
+    EXPECT_EQ(stats.count, 100u);
+    EXPECT_EQ(stats.maxUs, 100000u);
+    EXPECT_EQ(stats.lastUs, 100000u);
+    // Log-linear buckets: within 25% of the true percentile
+    EXPECT_NEAR(static_cast<double>(stats.percentileUs(50)), 50000.0, 12500.0);
+    EXPECT_NEAR(static_cast<double>(stats.percentileUs(95)), 95000.0, 23750.0);
+    EXPECT_EQ(stats.percentileUs(100), 100000u);
+}
+
+TEST_F(UsbGadgetTest, PrepareRecordsStageTimings) {
+    createTestFile("a.log", "alpha");
+
+    syncv::UsbGadgetConfig cfg;
+    cfg.imagePath = imageDir + "/drive.img";
+    syncv::UsbGadget gadget(cfg);
+    EXPECT_TRUE(gadget.getTelemetry().summary().empty());
+
+    ASSERT_TRUE(gadget.prepareImage({{srcDir + "/a.log", "a.log"}}));
+    const auto& t = gadget.getTelemetry();
+    EXPECT_EQ(t.stage(syncv::UsbStage::Mount).count, 1u);
+    EXPECT_EQ(t.stage(syncv::UsbStage::Copy).count, 1u);
+    EXPECT_EQ(t.stage(syncv::UsbStage::Sync).count, 1u);
+    EXPECT_EQ(t.stage(syncv::UsbStage::Swap).count, 0u);
+    EXPECT_NE(t.summary().find("copy n=1"), std::string::npos);
+
+    // An unchanged refresh does no work and is only counted
+    EXPECT_TRUE(gadget.refresh({{srcDir + "/a.log", "a.log"}}));
+    EXPECT_EQ(t.skipped, 1u);
+    EXPECT_EQ(t.refresh.count, 0u);
+    EXPECT_EQ(gadget.getStatus(), "not initialized");
+}
+
+// Host manifest at the volume root
+
+TEST_F(UsbGadgetTest, HostManifestListsFilesWithHashesAndMetadata) {
+    createTestFile("dev1.log", "device_id=PUMP-7\nfirmware_version=2.1\npressure=3\n");
+    createTestFile("v1.bin", "firmware v1");
+
+    syncv::UsbGadgetConfig cfg;
+    cfg.imagePath = imageDir + "/drive.img";
+    syncv::UsbGadget gadget(cfg);
+    int parsed = 0;
+    syncv::MetadataExtractor extractor;
+    gadget.setMetadataProvider([&](const std::string& path) {
+        parsed++;
+        std::ifstream in(path);
+        std::string raw((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return extractor.extract(raw, "typeA");
+    });
+
+    std::vector<std::pair<std::string, std::string>> files = {
+        {srcDir + "/dev1.log", "dev1.log"}, {srcDir + "/v1.bin", "firmware/v1.bin"}};
+    ASSERT_TRUE(gadget.prepareImage(files));
+    EXPECT_EQ(parsed, 2);
+
+    syncv::Fat32Image image;
+    ASSERT_TRUE(image.open(cfg.imagePath));
+    std::string manifest;
+    ASSERT_TRUE(image.readFile("SYNCV-MANIFEST.TSV", manifest));
+    image.close();
+
+    syncv::HashVerifier hasher;
+    const std::string logLine = "dev1.log\t" + std::to_string(fs::file_size(srcDir + "/dev1.log")) +
+                                "\t" + hasher.hashFile(srcDir + "/dev1.log") +
+                                "\tPUMP-7\ttypeA\t2.1\tpressure=3\n";
+    const std::string fwLine = "firmware/v1.bin\t11\t" + hasher.hashFile(srcDir + "/v1.bin") +
+                               "\t\t\t\n";
+    EXPECT_EQ(manifest.rfind("# syncv-manifest 1", 0), 0u);
+    EXPECT_NE(manifest.find(logLine), std::string::npos);
+    EXPECT_NE(manifest.find(fwLine), std::string::npos);
+
+    // Unchanged content is not parsed again, even by a fresh gadget
+    syncv::UsbGadget restarted(cfg);
+    restarted.setMetadataProvider([&](const std::string&) {
+        parsed++;
+        return syncv::DeviceMetadata{};
+    });
+    ASSERT_TRUE(restarted.prepareImage(files));
+    EXPECT_EQ(parsed, 2);
+    ASSERT_TRUE(image.open(cfg.imagePath));
+    std::string again;
+    ASSERT_TRUE(image.readFile("SYNCV-MANIFEST.TSV", again));
+    EXPECT_EQ(again, manifest);
+}
@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+#include "UsbRefreshGate.h"
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+using Clock = syncv::UsbRefreshGate::Clock;
+using std::chrono::seconds;
+
+class UsbRefreshGateTest : public ::testing::Test {
+protected:
+    std::string testDir;
+    Clock::time_point t0 = Clock::now();
+
+    void SetUp() override {
+        testDir = (fs::temp_directory_path() / "syncv_refresh_gate_test").string();
+        fs::create_directories(testDir);
+    }
+
+    void TearDown() override {
+        std::error_code ec;
+        fs::remove_all(testDir, ec);
+    }
+
+    std::string createFile(const std::string& name, const std::string& content) {
+        std::string path = testDir + "/" + name;
+        std::ofstream out(path, std::ios::binary);
+        out << content;
+        return path;
+    }
+
+    static syncv::UsbRefreshPolicy policy(int debounce, int minInterval) {
+        syncv::UsbRefreshPolicy p;
+        p.debounceSeconds = debounce;
+        p.minIntervalSeconds = minInterval;
+        p.maxDeferSeconds = 300;
+        return p;
+    }
+};
+
+TEST_F(UsbRefreshGateTest, FingerprintIgnoresOrderButTracksChanges) {
+    auto a = createFile("a.log", "alpha");
+    auto b = createFile("b.log", "bravo");
+
+    auto fp1 = syncv::UsbRefreshGate::fingerprint({{a, "a.log"}, {b, "b.log"}});
+    auto fp2 = syncv::UsbRefreshGate::fingerprint({{b, "b.log"}, {a, "a.log"}});
+    EXPECT_EQ(fp1, fp2);
+
+    createFile("b.log", "bravo, longer");
+    EXPECT_NE(syncv::UsbRefreshGate::fingerprint({{a, "a.log"}, {b, "b.log"}}), fp1);
+    EXPECT_NE(syncv::UsbRefreshGate::fingerprint({{a, "a.log"}}), fp1);
+}
+
+TEST_F(UsbRefreshGateTest, UnchangedFilesNeverRefresh) {
+    syncv::UsbRefreshGate gate(policy(0, 0));
+    gate.markRefreshed("fp1", t0);
+
+    for (int i = 1; i <= 10; i++) {
+        EXPECT_FALSE(gate.shouldRefresh("fp1", 0, t0 + seconds(30 * i)));
+    }
+    EXPECT_FALSE(gate.pending());
+}
+
+TEST_F(UsbRefreshGateTest, ChangeRefreshesAfterMinInterval) {
+    syncv::UsbRefreshGate gate(policy(0, 60));
+    gate.markRefreshed("fp1", t0);
+
+    EXPECT_FALSE(gate.shouldRefresh("fp2", 0, t0 + seconds(30)));
+    EXPECT_TRUE(gate.pending());
+    EXPECT_TRUE(gate.shouldRefresh("fp2", 0, t0 + seconds(60)));
+
+    gate.markRefreshed("fp2", t0 + seconds(60));
+    EXPECT_FALSE(gate.pending());
+    EXPECT_FALSE(gate.shouldRefresh("fp2", 0, t0 + seconds(200)));
+}
+
+TEST_F(UsbRefreshGateTest, PartialRefreshIsRetriedAfterMinInterval) {
+    syncv::UsbRefreshGate gate(policy(0, 60));
+    gate.markRefreshed("fp1", t0);
+
+    EXPECT_TRUE(gate.shouldRefresh("fp2", 0, t0 + seconds(60)));
+    gate.markAttempted(t0 + seconds(60));   // some files failed to copy
+
+    EXPECT_TRUE(gate.pending());
+    EXPECT_FALSE(gate.shouldRefresh("fp2", 0, t0 + seconds(90)));
+    EXPECT_TRUE(gate.shouldRefresh("fp2", 0, t0 + seconds(120)));
+}
+
+TEST_F(UsbRefreshGateTest, FailedRefreshOfUnchangedFilesIsRetried) {
+    syncv::UsbRefreshGate gate(policy(0, 60));
+    gate.markRefreshed("fp1", t0);
+
+    // Same files, but the last attempt failed: the image state is unknown
+    gate.markAttempted(t0 + seconds(10));
+    EXPECT_TRUE(gate.pending());
+    EXPECT_FALSE(gate.shouldRefresh("fp1", 0, t0 + seconds(30)));
+    EXPECT_TRUE(gate.shouldRefresh("fp1", 0, t0 + seconds(70)));
+
+    gate.markRefreshed("fp1", t0 + seconds(70));
+    EXPECT_FALSE(gate.shouldRefresh("fp1", 0, t0 + seconds(200)));
+}
+
+TEST_F(UsbRefreshGateTest, DebounceWaitsForStableFileSet) {
+    syncv::UsbRefreshGate gate(policy(20, 0));
+    gate.markRefreshed("fp1", t0);
+
+    EXPECT_FALSE(gate.shouldRefresh("fp2", 0, t0 + seconds(10)));
+    EXPECT_FALSE(gate.shouldRefresh("fp3", 0, t0 + seconds(25)));   // still changing
+    EXPECT_FALSE(gate.shouldRefresh("fp3", 0, t0 + seconds(40)));   // stable for 15s
+    EXPECT_TRUE(gate.shouldRefresh("fp3", 0, t0 + seconds(45)));
+}
+
+TEST_F(UsbRefreshGateTest, RevertedChangeCancelsPendingRefresh) {
+    syncv::UsbRefreshGate gate(policy(0, 60));
+    gate.markRefreshed("fp1", t0);
+
+    EXPECT_FALSE(gate.shouldRefresh("fp2", 0, t0 + seconds(30)));
+    EXPECT_TRUE(gate.pending());
+    EXPECT_FALSE(gate.shouldRefresh("fp1", 0, t0 + seconds(90)));
+    EXPECT_FALSE(gate.pending());
+}
+
+TEST_F(UsbRefreshGateTest, DefersWhileHostReadsUpToLimit) {
+    auto p = policy(0, 0);
+    p.maxDeferSeconds = 90;
+    syncv::UsbRefreshGate gate(p);
+    gate.markRefreshed("fp1", t0);
+
+    EXPECT_FALSE(gate.shouldRefresh("fp1", 1000, t0 + seconds(10)));
+    EXPECT_FALSE(gate.shouldRefresh("fp2", 5000, t0 + seconds(30)));   // host busy
+    EXPECT_FALSE(gate.shouldRefresh("fp2", 9000, t0 + seconds(60)));   // still busy
+    EXPECT_TRUE(gate.shouldRefresh("fp2", 9500, t0 + seconds(120)));   // deferred long enough
+}
+
+TEST_F(UsbRefreshGateTest, RefreshesOnceHostGoesIdle) {
+    syncv::UsbRefreshGate gate(policy(0, 0));
+    gate.markRefreshed("fp1", t0);
+
+    EXPECT_FALSE(gate.shouldRefresh("fp1", 1000, t0 + seconds(30)));
+    EXPECT_FALSE(gate.shouldRefresh("fp2", 2000, t0 + seconds(60)));  // busy
+    EXPECT_TRUE(gate.shouldRefresh("fp2", 2000, t0 + seconds(90)));   // idle
+}
+
+TEST_F(UsbRefreshGateTest, DeferralCanBeDisabled) {
+    auto p = policy(0, 0);
+    p.deferWhileHostReads = false;
+    syncv::UsbRefreshGate gate(p);
+    gate.markRefreshed("fp1", t0);
+
+    EXPECT_FALSE(gate.shouldRefresh("fp1", 1000, t0 + seconds(30)));
+    EXPECT_TRUE(gate.shouldRefresh("fp2", 2000, t0 + seconds(60)));
+}